@@ -6,30 +6,14 @@
 */
 #include "control.h"
 #include "globals.h"
+#include "statestore.h"
+#include "storage.h"
 
 #include <KDirWatch>
-#include <QDir>
-#include <QFile>
-#include <QJsonDocument>
 #include <QStringBuilder>
 
 #include <kscreen/config.h>
 
-// clang-format off
-#define nameString                      QStringLiteral("name")
-#define scaleString                     QStringLiteral("scale")
-#define metadataString                  QStringLiteral("metadata")
-#define idString                        QStringLiteral("id")
-#define autorotateString                QStringLiteral("autorotate")
-#define autorotateTabletOnlyString      QStringLiteral("autorotate-tablet-only")
-#define replicateHashString             QStringLiteral("replicate-hash")
-#define replicateNameString             QStringLiteral("replicate-name")
-#define overscanString                  QStringLiteral("overscan")
-#define vrrPolicyString                 QStringLiteral("vrrpolicy")
-#define rgbRangeString                  QStringLiteral("rgbrange")
-#define outputsString                   QStringLiteral("outputs")
-// clang-format on
-
 QString Control::s_dirName = QStringLiteral("control/");
 
 Control::Control(QObject *parent)
@@ -43,6 +27,19 @@ void Control::activateWatcher()
         return;
     }
     m_watcher = new KDirWatch(this);
+    if (StateStore *store = Storage::stateStore()) {
+        // All controls share the store file, only tell about changes to ours
+        m_watcher->addFile(store->path());
+        connect(m_watcher, &KDirWatch::dirty, this, [this, store]() {
+            store->refresh();
+            const QCborMap oldInfo = encode();
+            readFile();
+            if (encode() != oldInfo) {
+                Q_EMIT changed();
+            }
+        });
+        return;
+    }
     m_watcher->addFile(filePath());
     connect(m_watcher, &KDirWatch::dirty, this, [this]() {
         readFile();
@@ -58,27 +55,25 @@ KDirWatch *Control::watcher() const
 bool Control::writeFile()
 {
     const QString path = filePath();
-    const auto infoMap = constInfo();
+    const QCborMap infoMap = encode();
 
     if (infoMap.isEmpty()) {
         // Nothing to write. Default control. Remove file if it exists.
-        QFile::remove(path);
+        Storage::remove(path);
         return true;
     }
-    if (!QDir().mkpath(dirPath())) {
+    if (!Globals::mkpath(dirPath())) {
         // TODO: error message
         return false;
     }
 
     // write updated data to file
-    QFile file(path);
-    if (!file.open(QIODevice::WriteOnly)) {
+    if (!Storage::writeValue(path, infoMap)) {
         // TODO: logging category?
-        //        qCWarning(KSCREEN_COMMON) << "Failed to open config control file for writing! " << file.errorString();
+        //        qCWarning(KSCREEN_COMMON) << "Failed to write config control file" << path;
         return false;
     }
-    file.write(QJsonDocument::fromVariant(infoMap).toJson());
-    //    qCDebug(KSCREEN_COMMON) << "Control saved on: " << file.fileName();
+    //    qCDebug(KSCREEN_COMMON) << "Control saved on: " << path;
     return true;
 }
 
@@ -89,12 +84,10 @@ QString Control::dirPath() const
 
 void Control::readFile()
 {
-    QFile file(filePath());
-    if (file.open(QIODevice::ReadOnly)) {
+    if (const auto data = Storage::readValue(filePath())) {
         // This might not be reached, bus this is ok. The control file will
         // eventually be created on first write later on.
-        QJsonDocument parser;
-        m_info = parser.fromJson(file.readAll()).toVariant().toMap();
+        decode(*data);
     }
 }
 
@@ -103,16 +96,6 @@ QString Control::filePathFromHash(const QString &hash) const
     return dirPath() % hash;
 }
 
-QVariantMap &Control::info()
-{
-    return m_info;
-}
-
-const QVariantMap &Control::constInfo() const
-{
-    return m_info;
-}
-
 ControlConfig::ControlConfig(KScreen::ConfigPtr config, QObject *parent)
     : Control(parent)
     , m_config(config)
@@ -125,23 +108,15 @@ ControlConfig::ControlConfig(KScreen::ConfigPtr config, QObject *parent)
 
     // As global outputs are indexed by a hash of their edid, which is not unique,
     // to be able to tell apart multiple identical outputs, these need special treatment
-    QStringList allIds;
     const auto outputs = config->outputs();
-    allIds.reserve(outputs.count());
-    for (const KScreen::OutputPtr &output : outputs) {
-        const auto outputId = output->hashMd5();
-        if (allIds.contains(outputId) && !m_duplicateOutputIds.contains(outputId)) {
-            m_duplicateOutputIds << outputId;
-        }
-        allIds << outputId;
-    }
+    m_identities = OutputIdentityTable(outputs);
 
     for (const auto &output : outputs) {
-        m_outputsControls << new ControlOutput(output, this);
+        auto *control = new ControlOutput(output, this);
+        m_outputsControls << control;
+        m_outputControlsById.insert(output->id(), control);
     }
 
-    // TODO: this is same in Output::readInOutputs of the daemon. Combine?
-
     // TODO: connect to outputs added/removed signals and reevaluate duplicate ids
     //       in case of such a change while object exists?
 }
@@ -171,6 +146,21 @@ QString ControlConfig::filePath() const
     return filePathFromHash(m_config->connectedOutputsHash());
 }
 
+const OutputIdentityTable &ControlConfig::identities() const
+{
+    return m_identities;
+}
+
+void ControlConfig::decode(const QCborValue &data)
+{
+    m_info = Schema::ControlRecord::decode(data);
+}
+
+QCborMap ControlConfig::encode() const
+{
+    return m_info.encode();
+}
+
 bool ControlConfig::writeFile()
 {
     bool success = true;
@@ -180,21 +170,19 @@ bool ControlConfig::writeFile()
     return success && Control::writeFile();
 }
 
-bool ControlConfig::infoIsOutput(const QVariantMap &info, const QString &outputId, const QString &outputName) const
+bool ControlConfig::infoIsOutput(const Schema::ControlOutputRecord &info, const QString &outputId, const QString &outputName) const
 {
-    const QString outputIdInfo = info[idString].toString();
-    if (outputIdInfo.isEmpty()) {
+    if (info.id.isEmpty()) {
         return false;
     }
-    if (outputId != outputIdInfo) {
+    if (outputId != info.id) {
         return false;
     }
 
-    if (!outputName.isEmpty() && m_duplicateOutputIds.contains(outputId)) {
+    if (!outputName.isEmpty() && m_identities.isDuplicate(outputId)) {
         // We may have identical outputs connected, these will have the same id in the config
         // in order to find the right one, also check the output's name (usually the connector)
-        const auto metadata = info[metadataString].toMap();
-        const auto outputNameInfo = metadata[nameString].toString();
+        const QString outputNameInfo = info.metadata ? info.metadata->name : QString();
         if (outputName != outputNameInfo) {
             // was a duplicate id, but info not for this output
             return false;
@@ -203,58 +191,43 @@ bool ControlConfig::infoIsOutput(const QVariantMap &info, const QString &outputI
     return true;
 }
 
-static QVariantMap metadata(const QString &outputName)
+static Schema::ControlOutputRecord createOutputInfo(const QString &outputId, const QString &outputName)
 {
-    QVariantMap metadata;
-    metadata[nameString] = outputName;
-    return metadata;
+    Schema::ControlOutputRecord outputInfo;
+    outputInfo.id = outputId;
+    outputInfo.metadata = Schema::OutputMetadata{outputName, std::nullopt};
+    return outputInfo;
 }
 
-QVariantMap createOutputInfo(const QString &outputId, const QString &outputName)
+Schema::ControlOutputRecord &ControlConfig::outputInfo(const QString &outputId, const QString &outputName)
 {
-    QVariantMap outputInfo;
-    outputInfo[idString] = outputId;
-    outputInfo[metadataString] = metadata(outputName);
-    return outputInfo;
+    for (Schema::ControlOutputRecord &info : m_info.outputs) {
+        if (infoIsOutput(info, outputId, outputName)) {
+            return info;
+        }
+    }
+    // no entry yet, create one
+    m_info.outputs.append(createOutputInfo(outputId, outputName));
+    return m_info.outputs.last();
 }
 
 template<typename T, typename F>
 T ControlConfig::get(const KScreen::OutputPtr &output, F globalRetentionFunc, T defaultValue) const
 {
-    if (auto *outputControl = getOutputControl(output->hashMd5(), output->name())) {
+    if (auto *outputControl = getOutputControl(m_identities.hashMd5(output), output->name())) {
         return (outputControl->*globalRetentionFunc)();
     } else {
         return defaultValue;
     }
 }
 
-template<typename T, typename F, typename V>
-void ControlConfig::set(const KScreen::OutputPtr &output, const QString &name, F globalRetentionFunc, V value)
+template<typename F, typename V>
+void ControlConfig::set(const KScreen::OutputPtr &output, std::optional<uint32_t> Schema::ControlOutputRecord::*field, F globalRetentionFunc, V value)
 {
-    const auto &outputId = output->hashMd5();
+    const auto outputId = m_identities.hashMd5(output);
     const auto &outputName = output->name();
-    QList<QVariant>::iterator it;
-    QVariantList outputsInfo = getOutputs();
-
-    for (it = outputsInfo.begin(); it != outputsInfo.end(); ++it) {
-        QVariantMap outputInfo = (*it).toMap();
-        if (!infoIsOutput(outputInfo, outputId, outputName)) {
-            continue;
-        }
-        outputInfo[name] = static_cast<T>(value);
-        *it = outputInfo;
-        setOutputs(outputsInfo);
-        if (auto *control = getOutputControl(outputId, outputName)) {
-            (control->*globalRetentionFunc)(value);
-        }
-        return;
-    }
-    // no entry yet, create one
-    auto outputInfo = createOutputInfo(outputId, outputName);
-    outputInfo[name] = static_cast<T>(value);
 
-    outputsInfo << outputInfo;
-    setOutputs(outputsInfo);
+    outputInfo(outputId, outputName).*field = static_cast<uint32_t>(value);
     if (auto *control = getOutputControl(outputId, outputName)) {
         (control->*globalRetentionFunc)(value);
     }
@@ -262,25 +235,21 @@ void ControlConfig::set(const KScreen::OutputPtr &output, const QString &name, F
 
 KScreen::OutputPtr ControlConfig::getReplicationSource(const KScreen::OutputPtr &output) const
 {
-    const QVariantList outputsInfo = getOutputs();
-    for (const auto &variantInfo : outputsInfo) {
-        const QVariantMap info = variantInfo.toMap();
-        if (!infoIsOutput(info, output->hashMd5(), output->name())) {
+    const QString outputId = m_identities.hashMd5(output);
+    for (const Schema::ControlOutputRecord &info : m_info.outputs) {
+        if (!infoIsOutput(info, outputId, output->name())) {
             continue;
         }
-        const QString sourceHash = info[replicateHashString].toString();
-        const QString sourceName = info[replicateNameString].toString();
+        const QString sourceHash = info.replicateHash.value_or(QString());
+        const QString sourceName = info.replicateName.value_or(QString());
 
         if (sourceHash.isEmpty() && sourceName.isEmpty()) {
             // Common case when the replication source has been unset.
             return nullptr;
         }
 
-        const auto outputs = m_config->outputs();
-        for (const auto &output : outputs) {
-            if (output->hashMd5() == sourceHash && output->name() == sourceName) {
-                return output;
-            }
+        if (const auto sourceId = m_identities.find(sourceHash, sourceName)) {
+            return m_config->output(*sourceId);
         }
         // No match.
         return nullptr;
@@ -291,30 +260,9 @@ KScreen::OutputPtr ControlConfig::getReplicationSource(const KScreen::OutputPtr
 
 void ControlConfig::setReplicationSource(const KScreen::OutputPtr &output, const KScreen::OutputPtr &source)
 {
-    QList<QVariant>::iterator it;
-    QVariantList outputsInfo = getOutputs();
-    const QString sourceHash = source ? source->hashMd5() : QString();
-    const QString sourceName = source ? source->name() : QString();
-
-    for (it = outputsInfo.begin(); it != outputsInfo.end(); ++it) {
-        QVariantMap outputInfo = (*it).toMap();
-        if (!infoIsOutput(outputInfo, output->hashMd5(), output->name())) {
-            continue;
-        }
-        outputInfo[replicateHashString] = sourceHash;
-        outputInfo[replicateNameString] = sourceName;
-        *it = outputInfo;
-        setOutputs(outputsInfo);
-        // TODO: shall we set this information also as new global value (like with auto-rotate)?
-        return;
-    }
-    // no entry yet, create one
-    auto outputInfo = createOutputInfo(output->hashMd5(), output->name());
-    outputInfo[replicateHashString] = sourceHash;
-    outputInfo[replicateNameString] = sourceName;
-
-    outputsInfo << outputInfo;
-    setOutputs(outputsInfo);
+    Schema::ControlOutputRecord &info = outputInfo(m_identities.hashMd5(output), output->name());
+    info.replicateHash = source ? m_identities.hashMd5(source) : QString();
+    info.replicateName = source ? source->name() : QString();
     // TODO: shall we set this information also as new global value (like with auto-rotate)?
 }
 
@@ -325,7 +273,7 @@ uint32_t ControlConfig::getOverscan(const KScreen::OutputPtr &output) const
 
 void ControlConfig::setOverscan(const KScreen::OutputPtr &output, const uint32_t value)
 {
-    set<uint32_t>(output, overscanString, &ControlOutput::setOverscan, value);
+    set(output, &Schema::ControlOutputRecord::overscan, &ControlOutput::setOverscan, value);
 }
 
 KScreen::Output::VrrPolicy ControlConfig::getVrrPolicy(const KScreen::OutputPtr &output) const
@@ -335,7 +283,7 @@ KScreen::Output::VrrPolicy ControlConfig::getVrrPolicy(const KScreen::OutputPtr
 
 void ControlConfig::setVrrPolicy(const KScreen::OutputPtr &output, const KScreen::Output::VrrPolicy value)
 {
-    set<uint32_t>(output, vrrPolicyString, &ControlOutput::setVrrPolicy, value);
+    set(output, &Schema::ControlOutputRecord::vrrPolicy, &ControlOutput::setVrrPolicy, value);
 }
 
 KScreen::Output::RgbRange ControlConfig::getRgbRange(const KScreen::OutputPtr &output) const
@@ -345,28 +293,13 @@ KScreen::Output::RgbRange ControlConfig::getRgbRange(const KScreen::OutputPtr &o
 
 void ControlConfig::setRgbRange(const KScreen::OutputPtr &output, const KScreen::Output::RgbRange value)
 {
-    set<uint32_t>(output, rgbRangeString, &ControlOutput::setRgbRange, value);
-}
-
-QVariantList ControlConfig::getOutputs() const
-{
-    return constInfo()[outputsString].toList();
-}
-
-void ControlConfig::setOutputs(QVariantList outputsInfo)
-{
-    auto &infoMap = info();
-    infoMap[outputsString] = outputsInfo;
+    set(output, &Schema::ControlOutputRecord::rgbRange, &ControlOutput::setRgbRange, value);
 }
 
 ControlOutput *ControlConfig::getOutputControl(const QString &outputId, const QString &outputName) const
 {
-    for (auto *control : m_outputsControls) {
-        if (control->id() == outputId && control->name() == outputName) {
-            return control;
-        }
-    }
-    return nullptr;
+    const auto id = m_identities.find(outputId, outputName);
+    return id ? m_outputControlsById.value(*id) : nullptr;
 }
 
 ControlOutput::ControlOutput(KScreen::OutputPtr output, QObject *parent)
@@ -399,58 +332,58 @@ QString ControlOutput::filePath() const
     return filePathFromHash(m_output->hashMd5());
 }
 
-uint32_t ControlOutput::overscan() const
+void ControlOutput::decode(const QCborValue &data)
 {
-    const auto val = constInfo()[overscanString];
-    if (val.canConvert<uint>()) {
-        return val.toUInt();
+    m_info = Schema::ControlOutputRecord::decode(data);
+}
+
+QCborMap ControlOutput::encode() const
+{
+    return m_info.encode();
+}
+
+Schema::ControlOutputRecord &ControlOutput::info()
+{
+    if (m_info.isEmpty()) {
+        m_info = createOutputInfo(m_output->hashMd5(), m_output->name());
     }
-    return 0;
+    return m_info;
+}
+
+uint32_t ControlOutput::overscan() const
+{
+    return m_info.overscan.value_or(0);
 }
 
 void ControlOutput::setOverscan(uint32_t value)
 {
-    auto &infoMap = info();
-    if (infoMap.isEmpty()) {
-        infoMap = createOutputInfo(m_output->hashMd5(), m_output->name());
-    }
-    infoMap[overscanString] = static_cast<uint>(value);
+    info().overscan = value;
 }
 
 KScreen::Output::VrrPolicy ControlOutput::vrrPolicy() const
 {
-    const auto val = constInfo()[vrrPolicyString];
-    if (val.canConvert<uint>()) {
-        return static_cast<KScreen::Output::VrrPolicy>(val.toUInt());
+    if (m_info.vrrPolicy) {
+        return static_cast<KScreen::Output::VrrPolicy>(*m_info.vrrPolicy);
     }
     return KScreen::Output::VrrPolicy::Automatic;
 }
 
 void ControlOutput::setVrrPolicy(KScreen::Output::VrrPolicy value)
 {
-    auto &infoMap = info();
-    if (infoMap.isEmpty()) {
-        infoMap = createOutputInfo(m_output->hashMd5(), m_output->name());
-    }
-    infoMap[vrrPolicyString] = static_cast<uint>(value);
+    info().vrrPolicy = static_cast<uint32_t>(value);
 }
 
 KScreen::Output::RgbRange ControlOutput::rgbRange() const
 {
-    const auto val = constInfo()[rgbRangeString];
-    if (val.canConvert<uint>()) {
-        return static_cast<KScreen::Output::RgbRange>(val.toUInt());
+    if (m_info.rgbRange) {
+        return static_cast<KScreen::Output::RgbRange>(*m_info.rgbRange);
     }
     return KScreen::Output::RgbRange::Automatic;
 }
 
 void ControlOutput::setRgbRange(KScreen::Output::RgbRange value)
 {
-    auto &infoMap = info();
-    if (infoMap.isEmpty()) {
-        infoMap = createOutputInfo(m_output->hashMd5(), m_output->name());
-    }
-    infoMap[rgbRangeString] = static_cast<uint>(value);
+    info().rgbRange = static_cast<uint32_t>(value);
 }
 
 #include "moc_control.cpp"
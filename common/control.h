@@ -5,12 +5,15 @@
 */
 #pragma once
 
+#include "outputidentity.h"
+#include "schema.h"
+
 #include <kscreen/output.h>
 #include <kscreen/types.h>
 
+#include <QHash>
 #include <QList>
 #include <QObject>
-#include <QVariantMap>
 
 class KDirWatch;
 
@@ -33,13 +36,18 @@ protected:
     virtual QString filePath() const = 0;
     QString filePathFromHash(const QString &hash) const;
     void readFile();
-    QVariantMap &info();
-    const QVariantMap &constInfo() const;
+    /**
+     * Replaces the record of the control with @p data, the content of its file.
+     */
+    virtual void decode(const QCborValue &data) = 0;
+    /**
+     * @returns the record of the control, an empty map if there is nothing to write
+     */
+    virtual QCborMap encode() const = 0;
     KDirWatch *watcher() const;
 
 private:
     static QString s_dirName;
-    QVariantMap m_info;
     KDirWatch *m_watcher = nullptr;
 };
 
@@ -69,20 +77,33 @@ public:
     bool writeFile() override;
     void activateWatcher() override;
 
+    /**
+     * @returns the identities of the outputs the control was created for
+     */
+    const OutputIdentityTable &identities() const;
+
+protected:
+    void decode(const QCborValue &data) override;
+    QCborMap encode() const override;
+
 private:
-    QVariantList getOutputs() const;
-    void setOutputs(QVariantList outputsInfo);
-    bool infoIsOutput(const QVariantMap &info, const QString &outputId, const QString &outputName) const;
+    bool infoIsOutput(const Schema::ControlOutputRecord &info, const QString &outputId, const QString &outputName) const;
+    /**
+     * @returns the entry of the output, created if there is none yet
+     */
+    Schema::ControlOutputRecord &outputInfo(const QString &outputId, const QString &outputName);
     ControlOutput *getOutputControl(const QString &outputId, const QString &outputName) const;
 
     template<typename T, typename F>
     T get(const KScreen::OutputPtr &output, F globalRetentionFunc, T defaultValue) const;
-    template<typename T, typename F, typename V>
-    void set(const KScreen::OutputPtr &output, const QString &name, F globalRetentionFunc, V value);
+    template<typename F, typename V>
+    void set(const KScreen::OutputPtr &output, std::optional<uint32_t> Schema::ControlOutputRecord::*field, F globalRetentionFunc, V value);
 
     KScreen::ConfigPtr m_config;
-    QStringList m_duplicateOutputIds;
+    Schema::ControlRecord m_info;
+    OutputIdentityTable m_identities;
     QList<ControlOutput *> m_outputsControls;
+    QHash<int, ControlOutput *> m_outputControlsById;
 };
 
 class ControlOutput : public Control
@@ -108,6 +129,14 @@ public:
     QString dirPath() const override;
     QString filePath() const override;
 
+protected:
+    void decode(const QCborValue &data) override;
+    QCborMap encode() const override;
+
 private:
+    // Fills in which output the record is about when the first value is set
+    Schema::ControlOutputRecord &info();
+
     KScreen::OutputPtr m_output;
+    Schema::ControlOutputRecord m_info;
 };
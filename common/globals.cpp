@@ -5,20 +5,179 @@
     SPDX-License-Identifier: GPL-2.0-or-later
 */
 #include "globals.h"
+#include "statestore.h"
+#include "storage.h"
 
+#include <KDirWatch>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
 #include <QStandardPaths>
 #include <QStringBuilder>
 
+#include <algorithm>
+
 namespace Globals
 {
 
+namespace
+{
+// QStandardPaths::locate() stats the file in every XDG data directory in turn, and a hotplug
+// looks up a few files per output
+struct PathCache {
+    QMutex mutex;
+    KDirWatch *watch = nullptr;
+    // Relative to dirPath(), with a trailing slash
+    QStringList watchedDirs;
+    // Relative to dirPath(), resolved to an empty string if there is no file
+    QHash<QString, QString> files;
+    // Those of watchedDirs known to exist
+    QSet<QString> dirs;
+};
+}
+
+Q_GLOBAL_STATIC(PathCache, s_paths)
+
 QString dirPath()
 {
     return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) % QStringLiteral("/kscreen/");
 }
 
-QString findFile(const QString &filePath)
+static QString locate(const QString &filePath)
 {
+    if (Storage::stateStore()) {
+        // Files left in the writable location were imported into the store, only presets remain
+        const QStringList files = QStandardPaths::locateAll(QStandardPaths::GenericDataLocation, QStringLiteral("kscreen/") % filePath);
+        for (const QString &file : files) {
+            if (!file.startsWith(dirPath())) {
+                return file;
+            }
+        }
+        return QString();
+    }
     return QStandardPaths::locate(QStandardPaths::GenericDataLocation, QStringLiteral("kscreen/") % filePath);
 }
+
+QString findFile(const QString &filePath)
+{
+    if (StateStore *store = Storage::stateStore()) {
+        if (store->contains(filePath)) {
+            return dirPath() % filePath;
+        }
+    }
+
+    QMutexLocker locker(&s_paths->mutex);
+    const bool watched = std::any_of(s_paths->watchedDirs.cbegin(), s_paths->watchedDirs.cend(), [&filePath](const QString &dir) {
+        return filePath.startsWith(dir);
+    });
+    if (!s_paths->watch || !watched) {
+        locker.unlock();
+        return locate(filePath);
+    }
+    const auto it = s_paths->files.constFind(filePath);
+    if (it != s_paths->files.cend()) {
+        return *it;
+    }
+    // Changes the watch reports meanwhile wait for the lock, so they drop the entry inserted here
+    const QString path = locate(filePath);
+    s_paths->files.insert(filePath, path);
+    return path;
+}
+
+bool mkpath(const QString &dirPath)
+{
+    QMutexLocker locker(&s_paths->mutex);
+    if (s_paths->dirs.contains(dirPath)) {
+        return true;
+    }
+    if (!QDir().mkpath(dirPath)) {
+        return false;
+    }
+    if (s_paths->watch && dirPath.startsWith(Globals::dirPath()) && s_paths->watchedDirs.contains(dirPath.mid(Globals::dirPath().length()))) {
+        s_paths->dirs.insert(dirPath);
+    }
+    return true;
+}
+
+static void pathChanged(const QString &path)
+{
+    QMutexLocker locker(&s_paths->mutex);
+    // Directories may have been removed with everything below them
+    s_paths->dirs.removeIf([&path](const QString &dir) {
+        return dir.startsWith(path);
+    });
+    if (!path.startsWith(dirPath())) {
+        // A preset, or the data directory as a whole
+        s_paths->files.clear();
+        return;
+    }
+    const QString name = path.mid(dirPath().length());
+    s_paths->files.removeIf([&name](const QHash<QString, QString>::iterator it) {
+        return it.key().startsWith(name);
+    });
+}
+
+void watchPaths(const QStringList &dirPaths)
+{
+    QMutexLocker locker(&s_paths->mutex);
+    if (s_paths->watch) {
+        return;
+    }
+    s_paths->watch = new KDirWatch();
+    StateStore *store = Storage::stateStore();
+    if (store) {
+        s_paths->watch->addFile(store->path());
+    }
+    // Presets may appear in any of the directories, which needn't exist yet
+    const QStringList locations = QStandardPaths::standardLocations(QStandardPaths::GenericDataLocation);
+    for (const QString &path : dirPaths) {
+        Q_ASSERT(path.startsWith(dirPath()) && path.endsWith(QLatin1Char('/')));
+        const QString name = path.mid(dirPath().length());
+        s_paths->watchedDirs.append(name);
+        for (const QString &location : locations) {
+            const QString dir = location % QStringLiteral("/kscreen/") % name;
+            if (store && dir == path) {
+                // Imported into the store
+                continue;
+            }
+            s_paths->watch->addDir(dir.chopped(1), KDirWatch::WatchFiles);
+        }
+    }
+    QObject::connect(s_paths->watch, &KDirWatch::created, s_paths->watch, &pathChanged);
+    QObject::connect(s_paths->watch, &KDirWatch::deleted, s_paths->watch, &pathChanged);
+    // Files added to a directory may only show up as a change of it
+    QObject::connect(s_paths->watch, &KDirWatch::dirty, s_paths->watch, [](const QString &path) {
+        if (QFileInfo(path).isDir()) {
+            pathChanged(path);
+        }
+    });
+}
+
+void stopWatchingPaths()
+{
+    QMutexLocker locker(&s_paths->mutex);
+    delete s_paths->watch;
+    s_paths->watch = nullptr;
+    s_paths->watchedDirs.clear();
+    s_paths->files.clear();
+    s_paths->dirs.clear();
+}
+
+KDirWatch *pathWatch()
+{
+    QMutexLocker locker(&s_paths->mutex);
+    return s_paths->watch;
+}
+
+void forgetPath(const QString &path)
+{
+    QMutexLocker locker(&s_paths->mutex);
+    if (s_paths->watch && path.startsWith(dirPath())) {
+        s_paths->files.remove(path.mid(dirPath().length()));
+    }
+}
 }
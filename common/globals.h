@@ -7,6 +7,9 @@
 #pragma once
 
 #include <QString>
+#include <QStringList>
+
+class KDirWatch;
 
 namespace Globals
 {
@@ -17,4 +20,27 @@ QString dirPath();
  * @returns The abosolute path to a matching file if on exists or an empty string
  */
 QString findFile(const QString &filePath);
+/**
+ * Like QDir::mkpath(), but only touches the file system the first time while paths are watched.
+ */
+bool mkpath(const QString &dirPath);
+
+/**
+ * Starts the one watch on the files kept in memory: those in @p dirPaths, which are below
+ * dirPath(), and in the same directories of the presets, or the StateStore instead of the
+ * former if there is one. findFile() and mkpath() remember their results for these from now on.
+ * Has to be called on the main thread, lookups may then happen from any thread.
+ */
+void watchPaths(const QStringList &dirPaths);
+void stopWatchingPaths();
+/**
+ * @returns the watch started by watchPaths(), for others keeping files in memory to connect
+ * to, or nullptr if paths aren't watched
+ */
+KDirWatch *pathWatch();
+/**
+ * Drops what is remembered about @p path, for files created or removed below dirPath()
+ * before the watch gets to tell.
+ */
+void forgetPath(const QString &path);
 }
@@ -0,0 +1,279 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "modeindex.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+namespace
+{
+// What the fingerprint is made of, compared in full as fingerprints can collide
+struct ModeSignature {
+    QString id;
+    QSize size;
+    float refreshRate;
+
+    bool operator==(const ModeSignature &other) const = default;
+};
+
+QList<ModeSignature> signatures(const KScreen::ModeList &modes)
+{
+    QList<ModeSignature> signatures;
+    signatures.reserve(modes.count());
+    for (const KScreen::ModePtr &mode : modes) {
+        signatures.append(ModeSignature{mode->id(), mode->size(), mode->refreshRate()});
+    }
+    return signatures;
+}
+
+struct Cache {
+    // Enough for every output of a few configs, dropped as a whole when exceeded
+    static constexpr int MaxIndexes = 64;
+
+    struct Entry {
+        QList<ModeSignature> modes;
+        std::shared_ptr<const ModeIndex> index;
+    };
+
+    QMutex mutex;
+    QHash<size_t, Entry> indexes;
+};
+}
+
+Q_GLOBAL_STATIC(Cache, s_cache)
+
+size_t ModeIndex::fingerprint(const KScreen::ModeList &modes)
+{
+    size_t seed = modes.count();
+    for (const KScreen::ModePtr &mode : modes) {
+        seed = qHashMulti(seed, mode->id(), mode->size().width(), mode->size().height(), mode->refreshRate());
+    }
+    return seed;
+}
+
+ModeKey ModeKey::of(const QSize &size, float refreshRate)
+{
+    return ModeKey{size.width(), size.height(), qRound(refreshRate * 1000.0)};
+}
+
+ModeKey ModeKey::of(const KScreen::ModePtr &mode)
+{
+    return of(mode->size(), mode->refreshRate());
+}
+
+bool ModeKey::isValid() const
+{
+    return width > 0 && height > 0 && refreshMilliHz > 0;
+}
+
+QSize ModeKey::size() const
+{
+    return QSize(width, height);
+}
+
+size_t qHash(const ModeKey &key, size_t seed)
+{
+    return qHashMulti(seed, key.width, key.height, key.refreshMilliHz);
+}
+
+ModeIndex::ModeIndex(const KScreen::ModeList &modes)
+{
+    m_entries.reserve(modes.count());
+    m_keys.reserve(modes.count());
+    for (const KScreen::ModePtr &mode : modes) {
+        const QSize size = mode->size();
+        m_entries.append(Entry{qint64(size.width()) * size.height(), size.width(), size.height(), mode->refreshRate(), int(m_entries.count()), mode});
+        m_keys.tryEmplace(ModeKey::of(mode), mode);
+    }
+    // The mode list is ordered by id, which the stable sort keeps for equal modes
+    std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry &left, const Entry &right) {
+        return std::tie(left.area, left.width, left.refreshRate) < std::tie(right.area, right.width, right.refreshRate);
+    });
+
+    for (int i = 0; i < m_entries.count(); ++i) {
+        const Entry &entry = m_entries.at(i);
+        if (m_sizes.isEmpty() || m_sizes.last().first != QSize(entry.width, entry.height)) {
+            m_sizes.append({QSize(entry.width, entry.height), i});
+        }
+    }
+}
+
+std::shared_ptr<const ModeIndex> ModeIndex::of(const KScreen::OutputPtr &output)
+{
+    const KScreen::ModeList modes = output->modes();
+    const size_t key = fingerprint(modes);
+    QList<ModeSignature> modeSignatures = signatures(modes);
+
+    QMutexLocker locker(&s_cache->mutex);
+    const auto it = s_cache->indexes.constFind(key);
+    if (it != s_cache->indexes.cend() && it->modes == modeSignatures) {
+        return it->index;
+    }
+    if (s_cache->indexes.count() >= Cache::MaxIndexes) {
+        s_cache->indexes.clear();
+    }
+    // Replaces the index of other modes with the same fingerprint, if any
+    auto index = std::make_shared<const ModeIndex>(modes);
+    s_cache->indexes.insert(key, Cache::Entry{std::move(modeSignatures), index});
+    return index;
+}
+
+void ModeIndex::clearCache()
+{
+    QMutexLocker locker(&s_cache->mutex);
+    s_cache->indexes.clear();
+}
+
+bool ModeIndex::isEmpty() const
+{
+    return m_entries.isEmpty();
+}
+
+int ModeIndex::count() const
+{
+    return m_entries.count();
+}
+
+std::pair<ModeIndex::Iterator, ModeIndex::Iterator> ModeIndex::range(const QSize &size) const
+{
+    const qint64 area = qint64(size.width()) * size.height();
+    const auto it = std::lower_bound(m_sizes.cbegin(), m_sizes.cend(), std::pair(area, size.width()), [](const auto &entry, const auto &key) {
+        return std::pair(qint64(entry.first.width()) * entry.first.height(), entry.first.width()) < key;
+    });
+    if (it == m_sizes.cend() || it->first != size) {
+        return {m_entries.cend(), m_entries.cend()};
+    }
+    const auto next = it + 1;
+    return {m_entries.cbegin() + it->second, next == m_sizes.cend() ? m_entries.cend() : m_entries.cbegin() + next->second};
+}
+
+KScreen::ModePtr ModeIndex::biggest() const
+{
+    if (m_entries.isEmpty()) {
+        return nullptr;
+    }
+    // Modes of different sizes can have the same area, the last of them in the mode list wins a tie
+    const Entry *biggest = &m_entries.last();
+    for (auto it = m_entries.crbegin(); it != m_entries.crend() && it->area == biggest->area; ++it) {
+        if (it->refreshRate > biggest->refreshRate || (it->refreshRate == biggest->refreshRate && it->position > biggest->position)) {
+            biggest = &*it;
+        }
+    }
+    return biggest->mode;
+}
+
+KScreen::ModePtr ModeIndex::bestForSize(const QSize &size) const
+{
+    auto [begin, end] = range(size);
+    if (begin == end) {
+        return nullptr;
+    }
+    // The first of the modes with the highest refresh rate
+    auto best = end - 1;
+    while (best != begin && (best - 1)->refreshRate == best->refreshRate) {
+        --best;
+    }
+    return best->mode;
+}
+
+KScreen::ModePtr ModeIndex::find(const ModeKey &key) const
+{
+    return m_keys.value(key);
+}
+
+KScreen::ModePtr ModeIndex::findClosest(const QSize &size, float refreshRate, float tolerance) const
+{
+    auto [begin, end] = range(size);
+    if (begin == end) {
+        return nullptr;
+    }
+    auto it = std::lower_bound(begin, end, refreshRate, [](const Entry &entry, float rate) {
+        return entry.refreshRate < rate;
+    });
+    if (it == end || (it != begin && refreshRate - (it - 1)->refreshRate < it->refreshRate - refreshRate)) {
+        --it;
+        // The first of the modes with that rate
+        while (it != begin && (it - 1)->refreshRate == it->refreshRate) {
+            --it;
+        }
+    }
+    if (std::abs(it->refreshRate - refreshRate) >= tolerance) {
+        return nullptr;
+    }
+    return it->mode;
+}
+
+bool ModeIndex::contains(const QSize &size) const
+{
+    const auto [begin, end] = range(size);
+    return begin != end;
+}
+
+QList<QSize> ModeIndex::sizes() const
+{
+    QList<QSize> sizes;
+    sizes.reserve(m_sizes.count());
+    for (const auto &[size, first] : m_sizes) {
+        sizes.append(size);
+    }
+    return sizes;
+}
+
+QList<float> ModeIndex::refreshRates(const QSize &size) const
+{
+    QList<float> rates;
+    const auto [begin, end] = range(size);
+    for (auto it = end; it != begin; --it) {
+        const float rate = (it - 1)->refreshRate;
+        if (rates.isEmpty() || rates.last() != rate) {
+            rates.append(rate);
+        }
+    }
+    return rates;
+}
+
+QSize ModeIndex::largestCommonSize(const QList<std::shared_ptr<const ModeIndex>> &indexes, const QSize &maxSize)
+{
+    if (indexes.isEmpty()) {
+        return QSize();
+    }
+    const auto &sizes = indexes.first()->m_sizes;
+    for (auto it = sizes.crbegin(); it != sizes.crend(); ++it) {
+        const QSize size = it->first;
+        if (maxSize.isValid() && (size.width() > maxSize.width() || size.height() > maxSize.height())) {
+            continue;
+        }
+        const bool common = std::all_of(indexes.cbegin() + 1, indexes.cend(), [size](const std::shared_ptr<const ModeIndex> &index) {
+            return index->contains(size);
+        });
+        if (common) {
+            return size;
+        }
+    }
+    return QSize();
+}
+
+QSize ModeIndex::smallestCommonSize(const QList<std::shared_ptr<const ModeIndex>> &indexes)
+{
+    if (indexes.isEmpty()) {
+        return QSize();
+    }
+    for (const auto &entry : indexes.first()->m_sizes) {
+        const QSize size = entry.first;
+        const bool common = std::all_of(indexes.cbegin() + 1, indexes.cend(), [size](const std::shared_ptr<const ModeIndex> &index) {
+            return index->contains(size);
+        });
+        if (common) {
+            return size;
+        }
+    }
+    return QSize();
+}
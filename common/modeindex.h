@@ -0,0 +1,134 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QSize>
+#include <QString>
+
+#include <kscreen/mode.h>
+#include <kscreen/output.h>
+#include <kscreen/types.h>
+
+#include <memory>
+
+/**
+ * Identifies a mode by its size and its refresh rate in millihertz.
+ *
+ * Unlike the float refresh rate, the key compares exactly, so that modes like 59.94 Hz and
+ * 60 Hz can't be mistaken for each other. It is what the daemon stores in its files.
+ */
+struct ModeKey {
+    int width = 0;
+    int height = 0;
+    int refreshMilliHz = 0;
+
+    static ModeKey of(const QSize &size, float refreshRate);
+    static ModeKey of(const KScreen::ModePtr &mode);
+
+    bool isValid() const;
+    QSize size() const;
+    bool operator==(const ModeKey &other) const = default;
+};
+
+size_t qHash(const ModeKey &key, size_t seed = 0);
+
+/**
+ * The modes of an output sorted by area, width and refresh rate, for lookups that don't scan
+ * the whole mode list.
+ *
+ * Some monitors advertise well over a hundred modes, and picking one used to mean a linear
+ * scan for every question asked about them. An index is immutable once built. of() shares the
+ * index between all outputs with the same modes, including the copies made by
+ * KScreen::Config::clone(), so the modes returned may belong to another copy of the output.
+ * Only use their id, size and refresh rate.
+ *
+ * Lookups may happen from any thread.
+ */
+class ModeIndex
+{
+public:
+    explicit ModeIndex(const KScreen::ModeList &modes);
+
+    /**
+     * @returns the index of the modes of @p output, built on first use
+     */
+    static std::shared_ptr<const ModeIndex> of(const KScreen::OutputPtr &output);
+
+    bool isEmpty() const;
+    int count() const;
+
+    /**
+     * @returns the mode with the largest area and, among those, the highest refresh rate, the
+     * last one in the mode list if there are several
+     */
+    KScreen::ModePtr biggest() const;
+    /**
+     * @returns the mode of @p size with the highest refresh rate, or nullptr if there is none
+     */
+    KScreen::ModePtr bestForSize(const QSize &size) const;
+    /**
+     * @returns the mode matching @p key, the one with the lowest id if there are several
+     */
+    KScreen::ModePtr find(const ModeKey &key) const;
+    /**
+     * @returns the mode of @p size whose refresh rate is closest to @p refreshRate, or nullptr if
+     * none is closer than @p tolerance
+     */
+    KScreen::ModePtr findClosest(const QSize &size, float refreshRate, float tolerance) const;
+    bool contains(const QSize &size) const;
+
+    /**
+     * @returns the distinct sizes, smallest area first
+     */
+    QList<QSize> sizes() const;
+    /**
+     * @returns the distinct refresh rates of @p size, highest first
+     */
+    QList<float> refreshRates(const QSize &size) const;
+
+    /**
+     * @returns the largest size all of @p indexes have a mode of, not exceeding @p maxSize if
+     * it is valid, or an invalid size if there is none
+     */
+    static QSize largestCommonSize(const QList<std::shared_ptr<const ModeIndex>> &indexes, const QSize &maxSize = QSize());
+    /**
+     * @returns the smallest size all of @p indexes have a mode of, or an invalid size if there is none
+     */
+    static QSize smallestCommonSize(const QList<std::shared_ptr<const ModeIndex>> &indexes);
+
+    /**
+     * Drops the indexes kept by of().
+     */
+    static void clearCache();
+
+    /**
+     * @returns a hash of the ids, sizes and refresh rates of @p modes, which is what of() looks
+     * up shared indexes by before comparing the modes themselves
+     */
+    static size_t fingerprint(const KScreen::ModeList &modes);
+
+private:
+    struct Entry {
+        qint64 area;
+        int width;
+        int height;
+        float refreshRate;
+        // In the mode list
+        int position;
+        KScreen::ModePtr mode;
+    };
+    using Iterator = QList<Entry>::const_iterator;
+
+    std::pair<Iterator, Iterator> range(const QSize &size) const;
+
+    // Sorted by area, width, refresh rate and id
+    QList<Entry> m_entries;
+    // Distinct sizes in the order of m_entries, with the index of their first entry
+    QList<std::pair<QSize, int>> m_sizes;
+    QHash<ModeKey, KScreen::ModePtr> m_keys;
+};
@@ -11,6 +11,7 @@
 */
 
 #include "osdaction.h"
+#include "modeindex.h"
 
 #include <KLocalizedString>
 #include <KScreen/Config>
@@ -69,38 +70,14 @@ KScreen::SetConfigOperation *OsdAction::applyAction(const QSharedPointer<KScreen
         external->setEnabled(true);
         internal->setPos(QPoint());
         external->setPos(QPoint());
-        QList<KScreen::ModePtr> commonModes;
-        const auto internalModes = internal->modes();
-        const auto externalModes = external->modes();
-        for (const auto &mode : internalModes) {
-            const bool shared = std::any_of(externalModes.begin(), externalModes.end(), [&mode](const auto &otherMode) {
-                return mode->size() == otherMode->size();
-            });
-            if (shared) {
-                commonModes.push_back(mode);
-            }
-        }
-        if (commonModes.isEmpty()) {
+        const auto internalModes = ModeIndex::of(internal);
+        const auto externalModes = ModeIndex::of(external);
+        const QSize biggestSize = ModeIndex::largestCommonSize({internalModes, externalModes});
+        if (!biggestSize.isValid()) {
             return nullptr;
         }
-        std::sort(commonModes.begin(), commonModes.end(), [](const auto &left, const auto &right) {
-            return left->size().width() < right->size().width() && left->size().height() < right->size().height();
-        });
-        const auto biggestSize = commonModes.back()->size();
-        const auto findBestMode = [&biggestSize](const KScreen::OutputPtr &output) {
-            auto list = output->modes();
-            list.erase(std::remove_if(list.begin(),
-                                      list.end(),
-                                      [&biggestSize](const auto &mode) {
-                                          return mode->size() != biggestSize;
-                                      }),
-                       list.end());
-            return *std::max_element(list.begin(), list.end(), [](const auto &left, const auto &right) {
-                return left->refreshRate() < right->refreshRate();
-            });
-        };
-        internal->setCurrentModeId(findBestMode(internal)->id());
-        external->setCurrentModeId(findBestMode(external)->id());
+        internal->setCurrentModeId(internalModes->bestForSize(biggestSize)->id());
+        external->setCurrentModeId(externalModes->bestForSize(biggestSize)->id());
         external->setScale(internal->scale());
         break;
     }
@@ -111,15 +88,8 @@ KScreen::SetConfigOperation *OsdAction::applyAction(const QSharedPointer<KScreen
         const double internalScale = internal->scale();
         ModePtr currentMode = internal->currentMode();
         if (!currentMode) { // When the internal display is not enabled
-            const auto internalModesMap = internal->modes();
-            Q_ASSERT(!internalModesMap.empty());
-            auto bestModeIt = std::max_element(internalModesMap.cbegin(), internalModesMap.cend(), [](const auto &left, const auto &right) {
-                const QSize leftSize = left->size();
-                const QSize rightSize = right->size();
-                return (leftSize.width() < rightSize.width() && leftSize.height() < rightSize.height())
-                    || (leftSize == rightSize && left->refreshRate() < right->refreshRate());
-            });
-            currentMode = bestModeIt.value();
+            currentMode = ModeIndex::of(internal)->biggest();
+            Q_ASSERT(currentMode);
             internal->setCurrentModeId(currentMode->id());
         }
         external->setPos(QPoint(std::ceil(currentMode->size().width() / internalScale), 0));
@@ -132,15 +102,8 @@ KScreen::SetConfigOperation *OsdAction::applyAction(const QSharedPointer<KScreen
         const double externalScale = external->scale();
         ModePtr currentMode = external->currentMode();
         if (!currentMode) { // When the external display is not enabled
-            const auto externalModesMap = external->modes();
-            Q_ASSERT(!externalModesMap.empty());
-            auto bestModeIt = std::max_element(externalModesMap.cbegin(), externalModesMap.cend(), [](const auto &left, const auto &right) {
-                const QSize leftSize = left->size();
-                const QSize rightSize = right->size();
-                return (leftSize.width() < rightSize.width() && leftSize.height() < rightSize.height())
-                    || (leftSize == rightSize && left->refreshRate() < right->refreshRate());
-            });
-            currentMode = bestModeIt.value();
+            currentMode = ModeIndex::of(external)->biggest();
+            Q_ASSERT(currentMode);
             external->setCurrentModeId(currentMode->id());
         }
         internal->setPos(QPoint(std::ceil(currentMode->size().width() / externalScale), 0));
@@ -0,0 +1,85 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "outputidentity.h"
+
+#include <algorithm>
+
+OutputIdentityTable::OutputIdentityTable(const KScreen::OutputList &outputs)
+{
+    m_identities.reserve(outputs.count());
+    m_byOutputId.reserve(outputs.count());
+    for (const KScreen::OutputPtr &output : outputs) {
+        const QString hashMd5 = output->hashMd5();
+        m_byOutputId.insert(output->id(), m_identities.count());
+        m_byHashMd5[hashMd5].append(m_identities.count());
+        m_identities.append(Identity{output->id(), output->hash(), hashMd5, output->name(), output->isConnected()});
+    }
+
+    for (const QList<qsizetype> &indexes : std::as_const(m_byHashMd5)) {
+        if (indexes.count() < 2) {
+            continue;
+        }
+        const auto connected = std::count_if(indexes.cbegin(), indexes.cend(), [this](qsizetype index) {
+            return m_identities.at(index).connected;
+        });
+        for (qsizetype index : indexes) {
+            Identity &identity = m_identities[index];
+            identity.duplicate = true;
+            // Duplicated ids only matter if the duplicates are actually connected. Duplicates may also be transient.
+            identity.connectedDuplicate = identity.connected && connected > 1;
+        }
+    }
+}
+
+const QList<OutputIdentityTable::Identity> &OutputIdentityTable::identities() const
+{
+    return m_identities;
+}
+
+const OutputIdentityTable::Identity *OutputIdentityTable::identity(int outputId) const
+{
+    const auto it = m_byOutputId.constFind(outputId);
+    return it == m_byOutputId.cend() ? nullptr : &m_identities.at(*it);
+}
+
+QString OutputIdentityTable::hashMd5(const KScreen::OutputPtr &output) const
+{
+    if (const Identity *identity = this->identity(output->id())) {
+        return identity->hashMd5;
+    }
+    return output->hashMd5();
+}
+
+bool OutputIdentityTable::isDuplicate(const QString &hashMd5) const
+{
+    return m_byHashMd5.value(hashMd5).count() > 1;
+}
+
+QList<int> OutputIdentityTable::outputIds(const QString &hashMd5) const
+{
+    QList<int> ids;
+    const QList<qsizetype> indexes = m_byHashMd5.value(hashMd5);
+    ids.reserve(indexes.count());
+    for (qsizetype index : indexes) {
+        ids.append(m_identities.at(index).outputId);
+    }
+    return ids;
+}
+
+std::optional<int> OutputIdentityTable::find(const QString &hashMd5, const QString &name) const
+{
+    const auto it = m_byHashMd5.constFind(hashMd5);
+    if (it == m_byHashMd5.cend()) {
+        return std::nullopt;
+    }
+    for (qsizetype index : *it) {
+        const Identity &identity = m_identities.at(index);
+        if (identity.name == name) {
+            return identity.outputId;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,72 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include <kscreen/output.h>
+#include <kscreen/types.h>
+
+#include <optional>
+
+/**
+ * The identities of the outputs of a config, computed once.
+ *
+ * Outputs are stored under a hash of their EDID, which identical monitors share. Telling them
+ * apart means comparing every output with every other one, and Output::hash() and hashMd5()
+ * compute the hash anew on every call. With a video wall, these nested loops run for every
+ * config that is read or saved. A table is a snapshot: it doesn't follow outputs added to or
+ * removed from the config later on.
+ */
+class OutputIdentityTable
+{
+public:
+    struct Identity {
+        int outputId = 0;
+        QString hash;
+        QString hashMd5;
+        QString name;
+        bool connected = false;
+        // Another output of the config has the same hash
+        bool duplicate = false;
+        // Another connected output has the same hash, only set for connected outputs
+        bool connectedDuplicate = false;
+    };
+
+    OutputIdentityTable() = default;
+    explicit OutputIdentityTable(const KScreen::OutputList &outputs);
+
+    const QList<Identity> &identities() const;
+    /**
+     * @returns the identity of the output with @p outputId, or nullptr if it isn't in the table
+     */
+    const Identity *identity(int outputId) const;
+
+    /**
+     * @returns the hashMd5() of @p output, computed if it isn't in the table
+     */
+    QString hashMd5(const KScreen::OutputPtr &output) const;
+    /**
+     * @returns whether several outputs have @p hashMd5
+     */
+    bool isDuplicate(const QString &hashMd5) const;
+    /**
+     * @returns the ids of the outputs with @p hashMd5, lowest first
+     */
+    QList<int> outputIds(const QString &hashMd5) const;
+    /**
+     * @returns the id of the output with @p hashMd5 and @p name
+     */
+    std::optional<int> find(const QString &hashMd5, const QString &name) const;
+
+private:
+    // In the order of the output ids
+    QList<Identity> m_identities;
+    QHash<int, qsizetype> m_byOutputId;
+    QHash<QString, QList<qsizetype>> m_byHashMd5;
+};
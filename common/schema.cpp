@@ -0,0 +1,503 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "schema.h"
+
+#include <QHash>
+
+#include <algorithm>
+
+// clang-format off
+#define enabledString                   QStringLiteral("enabled")
+#define fullNameString                  QStringLiteral("fullname")
+#define globalDataNamesString           QStringLiteral("globalDataNames")
+#define heightString                    QStringLiteral("height")
+#define idString                        QStringLiteral("id")
+#define metadataString                  QStringLiteral("metadata")
+#define modeString                      QStringLiteral("mode")
+#define nameString                      QStringLiteral("name")
+#define outputsString                   QStringLiteral("outputs")
+#define overscanString                  QStringLiteral("overscan")
+#define posString                       QStringLiteral("pos")
+#define primaryString                   QStringLiteral("primary")
+#define priorityString                  QStringLiteral("priority")
+#define refreshString                   QStringLiteral("refresh")
+#define refreshMilliHzString            QStringLiteral("refreshmillihertz")
+#define replicateHashString             QStringLiteral("replicate-hash")
+#define replicateNameString             QStringLiteral("replicate-name")
+#define rgbRangeString                  QStringLiteral("rgbrange")
+#define rotationString                  QStringLiteral("rotation")
+#define scaleString                     QStringLiteral("scale")
+#define sizeString                      QStringLiteral("size")
+#define vrrPolicyString                 QStringLiteral("vrrpolicy")
+#define widthString                     QStringLiteral("width")
+#define xString                         QStringLiteral("x")
+#define yString                         QStringLiteral("y")
+// clang-format on
+
+namespace Schema
+{
+namespace
+{
+enum class Key {
+    Unknown,
+    Enabled,
+    Id,
+    Metadata,
+    Mode,
+    Overscan,
+    Pos,
+    Primary,
+    Priority,
+    ReplicateHash,
+    ReplicateName,
+    RgbRange,
+    Rotation,
+    Scale,
+    VrrPolicy,
+};
+
+// The keys of output and control output records, which share most of them
+const QHash<QString, Key> &keys()
+{
+    static const QHash<QString, Key> keys{
+        {enabledString, Key::Enabled},
+        {idString, Key::Id},
+        {metadataString, Key::Metadata},
+        {modeString, Key::Mode},
+        {overscanString, Key::Overscan},
+        {posString, Key::Pos},
+        {primaryString, Key::Primary},
+        {priorityString, Key::Priority},
+        {replicateHashString, Key::ReplicateHash},
+        {replicateNameString, Key::ReplicateName},
+        {rgbRangeString, Key::RgbRange},
+        {rotationString, Key::Rotation},
+        {scaleString, Key::Scale},
+        {vrrPolicyString, Key::VrrPolicy},
+    };
+    return keys;
+}
+
+Key keyOf(const QCborValue &key)
+{
+    return key.isString() ? keys().value(key.toString(), Key::Unknown) : Key::Unknown;
+}
+
+// Numbers may have been written as integers or doubles, QVariant converted between both
+std::optional<qint64> toInteger(const QCborValue &value)
+{
+    if (value.isInteger()) {
+        return value.toInteger();
+    }
+    if (value.isDouble()) {
+        return qRound64(value.toDouble());
+    }
+    return std::nullopt;
+}
+
+std::optional<uint32_t> toUnsigned(const QCborValue &value)
+{
+    if (const auto integer = toInteger(value)) {
+        return static_cast<uint32_t>(*integer);
+    }
+    return std::nullopt;
+}
+
+std::optional<double> toDouble(const QCborValue &value)
+{
+    if (value.isInteger() || value.isDouble()) {
+        return value.toDouble();
+    }
+    return std::nullopt;
+}
+
+std::optional<bool> toBool(const QCborValue &value)
+{
+    if (value.isBool()) {
+        return value.toBool();
+    }
+    if (const auto integer = toInteger(value)) {
+        return *integer != 0;
+    }
+    return std::nullopt;
+}
+
+std::optional<QString> toString(const QCborValue &value)
+{
+    if (value.isString()) {
+        return value.toString();
+    }
+    return std::nullopt;
+}
+
+std::optional<OutputMetadata> decodeMetadata(const QCborValue &value)
+{
+    if (!value.isMap()) {
+        return std::nullopt;
+    }
+    const QCborMap map = value.toMap();
+    return OutputMetadata{map.value(nameString).toString(), toString(map.value(fullNameString))};
+}
+
+QCborMap encodeMetadata(const OutputMetadata &metadata)
+{
+    QCborMap map;
+    if (metadata.fullName) {
+        map.insert(fullNameString, *metadata.fullName);
+    }
+    map.insert(nameString, metadata.name);
+    return map;
+}
+
+std::optional<QPoint> decodePos(const QCborValue &value)
+{
+    if (!value.isMap()) {
+        return std::nullopt;
+    }
+    const QCborMap map = value.toMap();
+    return QPoint(toInteger(map.value(xString)).value_or(0), toInteger(map.value(yString)).value_or(0));
+}
+
+std::optional<ModeRecord> decodeMode(const QCborValue &value)
+{
+    if (!value.isMap()) {
+        return std::nullopt;
+    }
+    const QCborMap map = value.toMap();
+    const QCborMap size = map.value(sizeString).toMap();
+
+    ModeRecord mode;
+    mode.size = QSize(toInteger(size.value(widthString)).value_or(0), toInteger(size.value(heightString)).value_or(0));
+    mode.refresh = toDouble(map.value(refreshString)).value_or(0);
+    if (const auto refreshMilliHz = toInteger(map.value(refreshMilliHzString))) {
+        mode.refreshMilliHz = *refreshMilliHz;
+    }
+    return mode;
+}
+
+QCborMap encodeMode(const ModeRecord &mode)
+{
+    QCborMap size;
+    size.insert(heightString, mode.size.height());
+    size.insert(widthString, mode.size.width());
+
+    QCborMap map;
+    map.insert(refreshString, double(mode.refresh));
+    if (mode.refreshMilliHz) {
+        map.insert(refreshMilliHzString, *mode.refreshMilliHz);
+    }
+    map.insert(sizeString, size);
+    return map;
+}
+
+template<typename T>
+void insertIfSet(QCborMap &map, const QString &key, const std::optional<T> &value)
+{
+    if (value) {
+        map.insert(key, *value);
+    }
+}
+
+// Puts the keys of @p extra in their place among the known ones in @p map
+QCborMap withExtra(const QCborMap &map, const QCborMap &extra)
+{
+    if (extra.isEmpty()) {
+        return map;
+    }
+    QList<std::pair<QString, QCborValue>> entries;
+    entries.reserve(map.size() + extra.size());
+    for (const QCborMap &keys : {map, extra}) {
+        for (auto it = keys.cbegin(); it != keys.cend(); ++it) {
+            entries.append({it.key().toString(), it.value()});
+        }
+    }
+    std::stable_sort(entries.begin(), entries.end(), [](const auto &left, const auto &right) {
+        return left.first < right.first;
+    });
+    QCborMap sorted;
+    for (const auto &[key, value] : std::as_const(entries)) {
+        sorted.insert(key, value);
+    }
+    return sorted;
+}
+}
+
+ModeKey ModeRecord::key() const
+{
+    ModeKey key = ModeKey::of(size, refresh);
+    if (refreshMilliHz) {
+        key.refreshMilliHz = *refreshMilliHz;
+    } // else written before the key was, the float is still exact enough to derive it from
+    return key;
+}
+
+OutputRecord OutputRecord::decode(const QCborValue &value)
+{
+    OutputRecord record;
+    const QCborMap map = value.toMap();
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+        const QCborValue entry = it.value();
+        switch (keyOf(it.key())) {
+        case Key::Enabled:
+            record.enabled = toBool(entry);
+            break;
+        case Key::Id:
+            record.id = entry.toString();
+            break;
+        case Key::Metadata:
+            record.metadata = decodeMetadata(entry);
+            break;
+        case Key::Mode:
+            record.mode = decodeMode(entry);
+            break;
+        case Key::Overscan:
+            record.overscan = toUnsigned(entry);
+            break;
+        case Key::Pos:
+            record.pos = decodePos(entry);
+            break;
+        case Key::Primary:
+            record.primary = toBool(entry);
+            break;
+        case Key::Priority:
+            record.priority = toUnsigned(entry);
+            break;
+        case Key::RgbRange:
+            record.rgbRange = toUnsigned(entry);
+            break;
+        case Key::Rotation:
+            if (const auto rotation = toInteger(entry)) {
+                record.rotation = *rotation;
+            }
+            break;
+        case Key::Scale:
+            record.scale = toDouble(entry);
+            break;
+        case Key::VrrPolicy:
+            record.vrrPolicy = toUnsigned(entry);
+            break;
+        case Key::ReplicateHash:
+        case Key::ReplicateName:
+        case Key::Unknown:
+            record.extra.insert(it.key(), entry);
+            break;
+        }
+    }
+    return record;
+}
+
+QCborMap OutputRecord::encode() const
+{
+    QCborMap map;
+    insertIfSet(map, enabledString, enabled);
+    if (!id.isEmpty()) {
+        map.insert(idString, id);
+    }
+    if (metadata) {
+        map.insert(metadataString, encodeMetadata(*metadata));
+    }
+    if (mode) {
+        map.insert(modeString, encodeMode(*mode));
+    }
+    insertIfSet(map, overscanString, overscan);
+    if (pos) {
+        QCborMap posMap;
+        posMap.insert(xString, pos->x());
+        posMap.insert(yString, pos->y());
+        map.insert(posString, posMap);
+    }
+    insertIfSet(map, primaryString, primary);
+    insertIfSet(map, priorityString, priority);
+    insertIfSet(map, rgbRangeString, rgbRange);
+    insertIfSet(map, rotationString, rotation);
+    insertIfSet(map, scaleString, scale);
+    insertIfSet(map, vrrPolicyString, vrrPolicy);
+    return withExtra(map, extra);
+}
+
+bool OutputRecord::isEmpty() const
+{
+    return *this == OutputRecord();
+}
+
+void OutputRecord::update(const OutputRecord &other)
+{
+    auto take = [](auto &member, const auto &value) {
+        if (value) {
+            member = value;
+        }
+    };
+    if (!other.id.isEmpty()) {
+        id = other.id;
+    }
+    take(metadata, other.metadata);
+    take(enabled, other.enabled);
+    take(pos, other.pos);
+    take(priority, other.priority);
+    take(primary, other.primary);
+    take(rotation, other.rotation);
+    take(scale, other.scale);
+    take(mode, other.mode);
+    take(vrrPolicy, other.vrrPolicy);
+    take(overscan, other.overscan);
+    take(rgbRange, other.rgbRange);
+    for (auto it = other.extra.cbegin(); it != other.extra.cend(); ++it) {
+        extra.insert(it.key(), it.value());
+    }
+}
+
+Layout decodeLayout(const QCborValue &value)
+{
+    const QCborArray array = value.toArray();
+    Layout layout;
+    layout.reserve(array.size());
+    for (const QCborValue &output : array) {
+        layout.append(OutputRecord::decode(output));
+    }
+    return layout;
+}
+
+QCborArray encodeLayout(const Layout &layout)
+{
+    QCborArray array;
+    for (const OutputRecord &output : layout) {
+        array.append(output.encode());
+    }
+    return array;
+}
+
+LastLayoutRecord LastLayoutRecord::decode(const QCborValue &value)
+{
+    const QCborMap map = value.toMap();
+    LastLayoutRecord record{map.value(idString).toString(), {}};
+    const QCborArray outputs = map.value(globalDataNamesString).toArray();
+    record.globalDataNames.reserve(outputs.size());
+    for (const QCborValue &output : outputs) {
+        QStringList names;
+        const QCborArray array = output.toArray();
+        for (const QCborValue &name : array) {
+            names.append(name.toString());
+        }
+        record.globalDataNames.append(names);
+    }
+    return record;
+}
+
+QCborMap LastLayoutRecord::encode() const
+{
+    QCborArray outputs;
+    for (const QStringList &names : globalDataNames) {
+        outputs.append(QCborArray::fromStringList(names));
+    }
+    QCborMap map;
+    map.insert(globalDataNamesString, outputs);
+    map.insert(idString, id);
+    return map;
+}
+
+ControlOutputRecord ControlOutputRecord::decode(const QCborValue &value)
+{
+    ControlOutputRecord record;
+    const QCborMap map = value.toMap();
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+        const QCborValue entry = it.value();
+        switch (keyOf(it.key())) {
+        case Key::Id:
+            record.id = entry.toString();
+            break;
+        case Key::Metadata:
+            record.metadata = decodeMetadata(entry);
+            break;
+        case Key::Overscan:
+            record.overscan = toUnsigned(entry);
+            break;
+        case Key::ReplicateHash:
+            record.replicateHash = toString(entry);
+            break;
+        case Key::ReplicateName:
+            record.replicateName = toString(entry);
+            break;
+        case Key::RgbRange:
+            record.rgbRange = toUnsigned(entry);
+            break;
+        case Key::VrrPolicy:
+            record.vrrPolicy = toUnsigned(entry);
+            break;
+        case Key::Enabled:
+        case Key::Mode:
+        case Key::Pos:
+        case Key::Primary:
+        case Key::Priority:
+        case Key::Rotation:
+        case Key::Scale:
+        case Key::Unknown:
+            record.extra.insert(it.key(), entry);
+            break;
+        }
+    }
+    return record;
+}
+
+QCborMap ControlOutputRecord::encode() const
+{
+    QCborMap map;
+    if (!id.isEmpty()) {
+        map.insert(idString, id);
+    }
+    if (metadata) {
+        map.insert(metadataString, encodeMetadata(*metadata));
+    }
+    insertIfSet(map, overscanString, overscan);
+    insertIfSet(map, replicateHashString, replicateHash);
+    insertIfSet(map, replicateNameString, replicateName);
+    insertIfSet(map, rgbRangeString, rgbRange);
+    insertIfSet(map, vrrPolicyString, vrrPolicy);
+    return withExtra(map, extra);
+}
+
+bool ControlOutputRecord::isEmpty() const
+{
+    return *this == ControlOutputRecord();
+}
+
+ControlRecord ControlRecord::decode(const QCborValue &value)
+{
+    ControlRecord record;
+    const QCborValue outputsKey(outputsString);
+    const QCborMap map = value.toMap();
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+        if (it.key() != outputsKey) {
+            record.extra.insert(it.key(), it.value());
+            continue;
+        }
+        const QCborArray outputs = it.value().toArray();
+        record.outputs.reserve(outputs.size());
+        for (const QCborValue &output : outputs) {
+            record.outputs.append(ControlOutputRecord::decode(output));
+        }
+    }
+    return record;
+}
+
+QCborMap ControlRecord::encode() const
+{
+    QCborMap map;
+    if (isEmpty()) {
+        return map;
+    }
+    QCborArray array;
+    for (const ControlOutputRecord &output : outputs) {
+        array.append(output.encode());
+    }
+    map.insert(outputsString, array);
+    return withExtra(map, extra);
+}
+
+bool ControlRecord::isEmpty() const
+{
+    return outputs.isEmpty() && extra.isEmpty();
+}
+}
@@ -0,0 +1,138 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include "modeindex.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QList>
+#include <QPoint>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+#include <cstdint>
+#include <optional>
+
+/**
+ * Typed records of the files below Globals::dirPath().
+ *
+ * Each record is decoded in a single pass over the entries of its map, dispatching on the key
+ * through a table built once, instead of converting the whole file to nested QVariantMaps and
+ * looking keys up again in every loop. Optional members are the keys a file may lack, which
+ * the readers treat differently from any value. Keys a record doesn't know end up in its
+ * extra map, so that files written by other versions keep them when written back.
+ *
+ * Records encode their known keys in alphabetical order, as QVariantMap did, so that files
+ * written before keep the same bytes and aren't written again for nothing.
+ */
+namespace Schema
+{
+struct ModeRecord {
+    QSize size;
+    float refresh = 0;
+    // Missing in files written before ModeKey was
+    std::optional<int> refreshMilliHz;
+
+    ModeKey key() const;
+    bool operator==(const ModeRecord &other) const = default;
+};
+
+struct OutputMetadata {
+    QString name;
+    std::optional<QString> fullName;
+
+    bool operator==(const OutputMetadata &other) const = default;
+};
+
+/**
+ * An output of a layout, or the global data of an output, which is the same record without
+ * the position, priority and enabled state.
+ */
+struct OutputRecord {
+    QString id;
+    std::optional<OutputMetadata> metadata;
+    std::optional<bool> enabled;
+    std::optional<QPoint> pos;
+    std::optional<uint32_t> priority;
+    // Deprecated in favor of priority, which overrides it when both are there
+    std::optional<bool> primary;
+    std::optional<int> rotation;
+    std::optional<qreal> scale;
+    std::optional<ModeRecord> mode;
+    std::optional<uint32_t> vrrPolicy;
+    std::optional<uint32_t> overscan;
+    std::optional<uint32_t> rgbRange;
+    QCborMap extra;
+
+    static OutputRecord decode(const QCborValue &value);
+    QCborMap encode() const;
+
+    bool isEmpty() const;
+    /**
+     * Overrides the members that are set in @p other, as writing global data over an older
+     * file does.
+     */
+    void update(const OutputRecord &other);
+
+    bool operator==(const OutputRecord &other) const = default;
+};
+
+using Layout = QList<OutputRecord>;
+Layout decodeLayout(const QCborValue &value);
+QCborArray encodeLayout(const Layout &layout);
+
+/**
+ * What Config::prefetchLastLayout() needs to know about the layout saved last.
+ */
+struct LastLayoutRecord {
+    QString id;
+    QList<QStringList> globalDataNames;
+
+    static LastLayoutRecord decode(const QCborValue &value);
+    QCborMap encode() const;
+};
+
+/**
+ * The control settings of an output, either as an entry of a ControlRecord or as the control
+ * file of the output itself.
+ */
+struct ControlOutputRecord {
+    QString id;
+    std::optional<OutputMetadata> metadata;
+    std::optional<QString> replicateHash;
+    std::optional<QString> replicateName;
+    std::optional<uint32_t> overscan;
+    std::optional<uint32_t> vrrPolicy;
+    std::optional<uint32_t> rgbRange;
+    QCborMap extra;
+
+    static ControlOutputRecord decode(const QCborValue &value);
+    QCborMap encode() const;
+
+    bool isEmpty() const;
+    bool operator==(const ControlOutputRecord &other) const = default;
+};
+
+/**
+ * The control settings of a topology.
+ */
+struct ControlRecord {
+    QList<ControlOutputRecord> outputs;
+    QCborMap extra;
+
+    static ControlRecord decode(const QCborValue &value);
+    /**
+     * @returns the encoded record, an empty map if there is nothing to write
+     */
+    QCborMap encode() const;
+
+    bool isEmpty() const;
+    bool operator==(const ControlRecord &other) const = default;
+};
+}
@@ -0,0 +1,346 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "statestore.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QLockFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStringBuilder>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/stat.h>
+
+// Bump when the record layout changes
+static const QByteArray s_magic = QByteArrayLiteral("KSCRNST2");
+// The magic is followed by the last sequence number given out when the file was written
+static const qint64 s_fileHeaderSize = s_magic.size() + sizeof(quint64);
+// A record starts with the length of the name, the length of the value and its sequence number
+static constexpr qint64 s_recordHeaderSize = 2 * sizeof(quint32) + sizeof(quint64);
+static constexpr quint32 s_removed = 0xffffffff;
+// Names are short relative paths, anything longer means we are reading garbage
+static constexpr quint32 s_maxNameLength = 4096;
+// Dead space below this isn't worth rewriting the file for
+static constexpr qint64 s_minCompactionSize = 256 * 1024;
+
+StateStore::StateStore(const QString &path)
+    : m_path(path)
+    , m_file(path)
+{
+    if (!open()) {
+        m_file.close();
+    }
+}
+
+StateStore::~StateStore()
+{
+    if (m_data) {
+        m_file.unmap(m_data);
+    }
+}
+
+QString StateStore::path() const
+{
+    return m_path;
+}
+
+bool StateStore::isValid() const
+{
+    return m_file.isOpen();
+}
+
+bool StateStore::open()
+{
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+    if (m_file.size() == 0) {
+        const QByteArray header = s_magic + QByteArray(sizeof(quint64), '\0');
+        if (m_file.write(header) != header.size() || !m_file.flush()) {
+            return false;
+        }
+    }
+    if (!map() || m_mappedSize < s_fileHeaderSize || memcmp(m_data, s_magic.constData(), s_magic.size()) != 0) {
+        // Written by a newer version, leave it alone
+        return false;
+    }
+    m_lastSequence = qFromLittleEndian<quint64>(m_data + s_magic.size());
+    m_indexedSize = s_fileHeaderSize;
+    scan();
+    return true;
+}
+
+bool StateStore::map()
+{
+    if (m_data) {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    m_mappedSize = m_file.size();
+    m_data = m_file.map(0, m_mappedSize);
+    return m_data;
+}
+
+void StateStore::scan()
+{
+    qint64 pos = m_indexedSize;
+    while (pos + s_recordHeaderSize <= m_mappedSize) {
+        const quint32 nameLength = qFromLittleEndian<quint32>(m_data + pos);
+        const quint32 valueLength = qFromLittleEndian<quint32>(m_data + pos + sizeof(quint32));
+        const quint64 sequence = qFromLittleEndian<quint64>(m_data + pos + 2 * sizeof(quint32));
+        if (nameLength > s_maxNameLength) {
+            break;
+        }
+        const qint64 valueOffset = pos + s_recordHeaderSize + nameLength;
+        const qint64 end = valueOffset + (valueLength == s_removed ? 0 : valueLength);
+        if (end > m_mappedSize) {
+            // Torn write at the end, the next append drops it
+            break;
+        }
+        const QString name = QString::fromUtf8(reinterpret_cast<const char *>(m_data + pos + s_recordHeaderSize), nameLength);
+        const auto it = m_index.constFind(name);
+        if (it != m_index.cend()) {
+            m_liveSize -= it->size();
+        }
+        m_lastSequence = std::max(m_lastSequence, sequence);
+        if (valueLength == s_removed) {
+            m_index.remove(name);
+        } else {
+            const Record record{pos, valueOffset, valueLength, sequence};
+            m_index.insert(name, record);
+            m_liveSize += record.size();
+        }
+        pos = end;
+    }
+    m_indexedSize = pos;
+}
+
+void StateStore::sync()
+{
+    if (isReplaced()) {
+        // Compacted by another process
+        reopen();
+        return;
+    }
+    if (m_file.size() == m_mappedSize) {
+        return;
+    }
+    if (map()) {
+        scan();
+    }
+}
+
+bool StateStore::isReplaced() const
+{
+    struct stat current;
+    struct stat opened;
+    if (::stat(QFile::encodeName(m_path).constData(), &current) != 0 || ::fstat(m_file.handle(), &opened) != 0) {
+        return false;
+    }
+    return current.st_dev != opened.st_dev || current.st_ino != opened.st_ino;
+}
+
+void StateStore::reopen()
+{
+    if (m_data) {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    m_file.close();
+    m_mappedSize = 0;
+    m_lastSequence = 0;
+    m_index.clear();
+    m_liveSize = 0;
+    if (!open()) {
+        m_file.close();
+    }
+}
+
+void StateStore::refresh()
+{
+    QMutexLocker locker(&m_mutex);
+    if (isValid()) {
+        sync();
+    }
+}
+
+std::optional<QByteArray> StateStore::value(const QString &name) const
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_index.constFind(name);
+    if (it == m_index.constEnd()) {
+        return std::nullopt;
+    }
+    return QByteArray(reinterpret_cast<const char *>(m_data + it->valueOffset), it->valueSize);
+}
+
+bool StateStore::contains(const QString &name) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.contains(name);
+}
+
+qint64 StateStore::revision(const QString &name) const
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_index.constFind(name);
+    return it == m_index.constEnd() ? -1 : qint64(it->sequence);
+}
+
+QStringList StateStore::names() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.keys();
+}
+
+bool StateStore::insert(const QString &name, const QByteArray &value)
+{
+    return append({{name, value}});
+}
+
+bool StateStore::remove(const QString &name)
+{
+    if (!contains(name)) {
+        return true;
+    }
+    return append({{name, std::nullopt}});
+}
+
+static void encode(QByteArray &buffer, const QString &name, const std::optional<QByteArray> &value, quint64 sequence)
+{
+    const QByteArray encodedName = name.toUtf8();
+    char header[s_recordHeaderSize];
+    qToLittleEndian<quint32>(encodedName.size(), header);
+    qToLittleEndian<quint32>(value ? value->size() : s_removed, header + sizeof(quint32));
+    qToLittleEndian<quint64>(sequence, header + 2 * sizeof(quint32));
+    buffer.append(header, s_recordHeaderSize);
+    buffer.append(encodedName);
+    if (value) {
+        buffer.append(*value);
+    }
+}
+
+qint64 StateStore::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_mappedSize;
+}
+
+qint64 StateStore::deadSize() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_indexedSize - s_fileHeaderSize - m_liveSize;
+}
+
+bool StateStore::compact()
+{
+    return append({});
+}
+
+bool StateStore::append(const Records &records)
+{
+    QLockFile lock(m_path % QStringLiteral(".lock"));
+    if (!lock.tryLock(1000)) {
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (!isValid()) {
+        return false;
+    }
+    sync();
+    const qint64 deadSize = m_indexedSize - s_fileHeaderSize - m_liveSize;
+    // Nothing to append is compact(). A torn write at the end would hide whatever is appended
+    // after it, and cutting it off could crash other processes reading the mapped file.
+    if (records.isEmpty() || m_file.size() > m_indexedSize || (deadSize > s_minCompactionSize && deadSize > m_liveSize)) {
+        return rewrite(records);
+    }
+
+    QByteArray buffer;
+    quint64 sequence = m_lastSequence;
+    for (const auto &[name, value] : records) {
+        encode(buffer, name, value, ++sequence);
+    }
+
+    if (!m_file.seek(m_indexedSize) || m_file.write(buffer) != buffer.size() || !m_file.flush()) {
+        return false;
+    }
+    if (!map()) {
+        return false;
+    }
+    scan();
+    return true;
+}
+
+bool StateStore::rewrite(const Records &records)
+{
+    // Where each name is written last, only that record counts
+    QHash<QString, qsizetype> latest;
+    for (qsizetype i = 0; i < records.count(); ++i) {
+        latest.insert(records.at(i).first, i);
+    }
+
+    QList<std::pair<qint64, QString>> live;
+    live.reserve(m_index.count());
+    for (auto it = m_index.cbegin(); it != m_index.cend(); ++it) {
+        if (!latest.contains(it.key())) {
+            live.append({it->offset, it.key()});
+        }
+    }
+    std::sort(live.begin(), live.end());
+
+    // Live records keep their sequence numbers, the header keeps those of the records dropped,
+    // so that none is given out twice
+    const quint64 lastSequence = m_lastSequence + records.count();
+    QByteArray buffer = s_magic;
+    buffer.reserve(s_fileHeaderSize + m_liveSize);
+    char header[sizeof(quint64)];
+    qToLittleEndian<quint64>(lastSequence, header);
+    buffer.append(header, sizeof(quint64));
+    for (const auto &[offset, name] : std::as_const(live)) {
+        const Record &record = *m_index.constFind(name);
+        encode(buffer, name, QByteArray::fromRawData(reinterpret_cast<const char *>(m_data + record.valueOffset), record.valueSize), record.sequence);
+    }
+    for (qsizetype i = 0; i < records.count(); ++i) {
+        const auto &[name, value] = records.at(i);
+        if (value && latest.value(name) == i) {
+            encode(buffer, name, value, m_lastSequence + i + 1);
+        }
+    }
+
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(buffer) != buffer.size() || !file.commit()) {
+        return false;
+    }
+    reopen();
+    return isValid();
+}
+
+void StateStore::import(const QString &dirPath)
+{
+    QList<std::pair<QString, std::optional<QByteArray>>> records;
+    const QDir dir(dirPath);
+    QDirIterator it(dirPath, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString filePath = it.next();
+        if (filePath.startsWith(m_path)) {
+            continue;
+        }
+        const QString name = dir.relativeFilePath(filePath);
+        QFile file(filePath);
+        if (contains(name) || !file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        records.append({name, file.readAll()});
+    }
+    if (!records.isEmpty()) {
+        append(records);
+    }
+}
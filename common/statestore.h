@@ -0,0 +1,117 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+#include <optional>
+
+/**
+ * All files below Globals::dirPath() in a single append-only file.
+ *
+ * Every write appends a record holding the name of the file relative to Globals::dirPath() and
+ * its encoded content, a removal appends a record without content. The file is memory-mapped
+ * and an index from name to the latest record is built when it is opened, so lookups are hash
+ * probes that don't touch the filesystem.
+ *
+ * The daemon and the KCM append to the same file, guarded by a lock file. Records appended by
+ * another process are picked up by refresh(), which is called before every append and should
+ * be called by whoever watches the file for changes.
+ *
+ * Overwritten and removed records stay in the file until it is compacted, which happens on
+ * append once there is more dead space than live records, or on compact(). The live records
+ * are then written to a new file that replaces the old one, which is never shrunk in place as
+ * other processes may have it mapped. They switch to the new file on their next refresh().
+ * Every record carries a sequence number that is never given out again, not even by a
+ * compaction, which keeps the live records' numbers, so revision() only changes with the record.
+ */
+class StateStore
+{
+public:
+    explicit StateStore(const QString &path);
+    ~StateStore();
+
+    QString path() const;
+    /**
+     * @returns false if the file can't be opened or was written by a newer version
+     */
+    bool isValid() const;
+
+    std::optional<QByteArray> value(const QString &name) const;
+    bool contains(const QString &name) const;
+    /**
+     * @returns a number that changes whenever @p name is written or removed, -1 if it doesn't exist
+     */
+    qint64 revision(const QString &name) const;
+    QStringList names() const;
+
+    bool insert(const QString &name, const QByteArray &value);
+    bool remove(const QString &name);
+
+    /**
+     * Reads records appended by other processes.
+     */
+    void refresh();
+
+    /**
+     * Rewrites the file with only the live records.
+     */
+    bool compact();
+    /**
+     * @returns the size of the file
+     */
+    qint64 size() const;
+    /**
+     * @returns the size of the records that have been overwritten or removed
+     */
+    qint64 deadSize() const;
+
+    /**
+     * Adds the files of the old one file per record layout in @p dirPath.
+     */
+    void import(const QString &dirPath);
+
+private:
+    struct Record {
+        qint64 offset;
+        qint64 valueOffset;
+        qint64 valueSize;
+        quint64 sequence;
+
+        qint64 size() const
+        {
+            return valueOffset - offset + valueSize;
+        }
+    };
+    using Records = QList<std::pair<QString, std::optional<QByteArray>>>;
+
+    bool open();
+    bool map();
+    void scan();
+    void sync();
+    bool isReplaced() const;
+    void reopen();
+    bool append(const Records &records);
+    bool rewrite(const Records &records);
+
+    QString m_path;
+    QFile m_file;
+    uchar *m_data = nullptr;
+    qint64 m_mappedSize = 0;
+    // Everything up to here is indexed
+    qint64 m_indexedSize = 0;
+    QHash<QString, Record> m_index;
+    // The highest sequence number given out so far
+    quint64 m_lastSequence = 0;
+    // Of the records in m_index
+    qint64 m_liveSize = 0;
+    mutable QMutex m_mutex;
+};
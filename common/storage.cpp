@@ -0,0 +1,302 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "storage.h"
+#include "config-storage.h"
+#include "globals.h"
+#include "statestore.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringBuilder>
+
+#include <atomic>
+#include <memory>
+
+namespace Storage
+{
+
+// Bump when the layout of the CBOR envelope changes
+static constexpr qint64 s_cborVersion = 1;
+
+Format format()
+{
+    static const Format format = [] {
+        const QByteArray env = qgetenv("KSCREEN_STORAGE_FORMAT").toLower();
+        if (env == "cbor") {
+            return Format::Cbor;
+        }
+        if (env == "json") {
+            return Format::Json;
+        }
+        return KSCREEN_BINARY_STORAGE ? Format::Cbor : Format::Json;
+    }();
+    return format;
+}
+
+static QByteArray toCbor(const QCborValue &data)
+{
+    const QCborArray envelope{s_cborVersion, data};
+    return QCborValue(QCborKnownTags::Signature, envelope).toCbor();
+}
+
+QByteArray encodeValue(const QCborValue &data, Format format)
+{
+    if (format == Format::Json) {
+        const QJsonValue json = data.toJsonValue();
+        return (json.isArray() ? QJsonDocument(json.toArray()) : QJsonDocument(json.toObject())).toJson();
+    }
+    return toCbor(data);
+}
+
+QCborValue decodeValue(const QByteArray &data)
+{
+    if (data.startsWith("\xd9\xd9\xf7")) {
+        const QCborValue value = QCborValue::fromCbor(data);
+        const QCborArray envelope = value.taggedValue().toArray();
+        if (envelope.at(0).toInteger() != s_cborVersion) {
+            return QCborValue();
+        }
+        return envelope.at(1);
+    }
+    // Legacy files, written before the format could be chosen. The conversion shares the
+    // container of the document rather than copying it.
+    const QJsonDocument document = QJsonDocument::fromJson(data);
+    if (document.isArray()) {
+        return QCborArray::fromJsonArray(document.array());
+    }
+    if (document.isObject()) {
+        return QCborMap::fromJsonObject(document.object());
+    }
+    return QCborValue();
+}
+
+QByteArray encode(const QVariant &data, Format format)
+{
+    if (format == Format::Json) {
+        return QJsonDocument::fromVariant(data).toJson();
+    }
+    return toCbor(QCborValue::fromVariant(data));
+}
+
+QVariant decode(const QByteArray &data)
+{
+    const QCborValue value = decodeValue(data);
+    if (value.isUndefined()) {
+        return QVariant();
+    }
+    return value.toVariant();
+}
+
+StateStore *stateStore()
+{
+    static const std::unique_ptr<StateStore> store = []() -> std::unique_ptr<StateStore> {
+        bool ok = false;
+        const int env = qEnvironmentVariableIntValue("KSCREEN_STATE_STORE", &ok);
+        if (!(ok ? env : KSCREEN_STATE_STORE) || !QDir().mkpath(Globals::dirPath())) {
+            return nullptr;
+        }
+        const QString path = Globals::dirPath() % QStringLiteral("state");
+        const bool created = !QFile::exists(path);
+        auto store = std::make_unique<StateStore>(path);
+        if (!store->isValid()) {
+            // Fall back to separate files rather than losing the settings
+            return nullptr;
+        }
+        if (created) {
+            store->import(Globals::dirPath());
+        }
+        return store;
+    }();
+    return store.get();
+}
+
+// The name of @p path in the store, empty if it is not kept there
+static QString storeName(const QString &path)
+{
+    if (!stateStore() || !path.startsWith(Globals::dirPath())) {
+        return QString();
+    }
+    return path.mid(Globals::dirPath().length());
+}
+
+// What we last read from or wrote to a file, to tell whether writing it again would change anything
+struct KnownContent {
+    QByteArray hash;
+    Stamp stamp;
+};
+static QMutex s_knownContentMutex;
+static QHash<QString, KnownContent> s_knownContent;
+static std::atomic<quint64> s_performedWrites = 0;
+static std::atomic<quint64> s_skippedWrites = 0;
+
+static QByteArray contentHash(const QByteArray &content)
+{
+    return QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+}
+
+static void remember(const QString &path, const QByteArray &hash)
+{
+    const Stamp current = stamp(path);
+    QMutexLocker locker(&s_knownContentMutex);
+    s_knownContent.insert(path, KnownContent{hash, current});
+}
+
+static void forget(const QString &path)
+{
+    QMutexLocker locker(&s_knownContentMutex);
+    s_knownContent.remove(path);
+}
+
+static bool isKnownContent(const QString &path, const QByteArray &hash)
+{
+    KnownContent known;
+    {
+        QMutexLocker locker(&s_knownContentMutex);
+        known = s_knownContent.value(path);
+    }
+    // Somebody else may have written the file since, which the stamp tells
+    return known.hash == hash && known.stamp.exists && known.stamp == stamp(path);
+}
+
+std::optional<QCborValue> readValue(const QString &path)
+{
+    QByteArray content;
+    if (const QString name = storeName(path); !name.isEmpty()) {
+        const auto value = stateStore()->value(name);
+        if (!value) {
+            return std::nullopt;
+        }
+        content = *value;
+    } else {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return std::nullopt;
+        }
+        content = file.readAll();
+    }
+    remember(path, contentHash(content));
+    return decodeValue(content);
+}
+
+static bool writeContent(const QString &path, const QByteArray &content)
+{
+    const QByteArray hash = contentHash(content);
+    if (isKnownContent(path, hash)) {
+        ++s_skippedWrites;
+        return true;
+    }
+
+    if (const QString name = storeName(path); !name.isEmpty()) {
+        if (!stateStore()->insert(name, content)) {
+            return false;
+        }
+    } else {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(content) != content.size()) {
+            return false;
+        }
+        Globals::forgetPath(path);
+    }
+    ++s_performedWrites;
+    remember(path, hash);
+    return true;
+}
+
+bool writeValue(const QString &path, const QCborValue &data)
+{
+    return writeContent(path, encodeValue(data, format()));
+}
+
+std::optional<QVariant> readFile(const QString &path)
+{
+    const auto value = readValue(path);
+    if (!value) {
+        return std::nullopt;
+    }
+    return value->isUndefined() ? QVariant() : value->toVariant();
+}
+
+bool writeFile(const QString &path, const QVariant &data)
+{
+    return writeContent(path, encode(data, format()));
+}
+
+WriteStatistics writeStatistics()
+{
+    return WriteStatistics{s_performedWrites, s_skippedWrites};
+}
+
+void resetWriteStatistics()
+{
+    s_performedWrites = 0;
+    s_skippedWrites = 0;
+}
+
+bool exists(const QString &path)
+{
+    if (const QString name = storeName(path); !name.isEmpty()) {
+        return stateStore()->contains(name);
+    }
+    return QFile::exists(path);
+}
+
+bool remove(const QString &path)
+{
+    forget(path);
+    if (const QString name = storeName(path); !name.isEmpty()) {
+        return stateStore()->remove(name);
+    }
+    Globals::forgetPath(path);
+    return QFile::remove(path);
+}
+
+bool move(const QString &from, const QString &to)
+{
+    forget(from);
+    forget(to);
+    const QString fromName = storeName(from);
+    if (!fromName.isEmpty()) {
+        const auto value = stateStore()->value(fromName);
+        if (!value || !stateStore()->insert(storeName(to), *value)) {
+            return false;
+        }
+        return stateStore()->remove(fromName);
+    }
+
+    Globals::forgetPath(from);
+    Globals::forgetPath(to);
+    QFile::remove(to);
+    if (!QFile::copy(from, to)) {
+        return false;
+    }
+    QFile::remove(from);
+    return true;
+}
+
+Stamp stamp(const QString &path)
+{
+    if (const QString name = storeName(path); !name.isEmpty()) {
+        const qint64 revision = stateStore()->revision(name);
+        return Stamp{revision >= 0, QDateTime(), revision};
+    }
+    const QFileInfo info(path);
+    if (!info.exists()) {
+        return Stamp();
+    }
+    return Stamp{true, info.lastModified(), info.size()};
+}
+}
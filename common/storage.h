@@ -0,0 +1,112 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QByteArray>
+#include <QCborValue>
+#include <QDateTime>
+#include <QString>
+#include <QVariant>
+
+#include <optional>
+
+/**
+ * Encoding of the files below Globals::dirPath().
+ *
+ * Files used to be written as indented JSON only. They can now also be written as CBOR, which
+ * is smaller and cheaper to parse. CBOR files start with the self-describe tag followed by an
+ * array holding the format version and the data, JSON files are recognized by their first
+ * character. Reading always accepts both, so existing JSON files keep working and are
+ * converted the next time they are written.
+ *
+ * The format written defaults to the KSCREEN_BINARY_STORAGE build option and can be
+ * overridden with the KSCREEN_STORAGE_FORMAT environment variable set to "json" or "cbor".
+ *
+ * Paths below Globals::dirPath() may also be kept in a single StateStore file instead of one
+ * file each. This defaults to the KSCREEN_STATE_STORE build option and can be overridden with
+ * the KSCREEN_STATE_STORE environment variable set to 0 or 1. When the store is created, the
+ * existing files are imported into it. They are left in place, but no longer looked at.
+ */
+class StateStore;
+
+namespace Storage
+{
+enum class Format {
+    Json,
+    Cbor,
+};
+
+Format format();
+
+/**
+ * The daemon and the KCM read and write their files as QCborValues, which the records of
+ * Schema decode without going through QVariant. The QVariant variants are for tools that
+ * only look at the content, like kscreen-console.
+ */
+QByteArray encodeValue(const QCborValue &data, Format format);
+/**
+ * @returns the decoded data, or an undefined QCborValue if @p data is neither JSON nor CBOR of
+ * a version we understand
+ */
+QCborValue decodeValue(const QByteArray &data);
+
+QByteArray encode(const QVariant &data, Format format);
+/**
+ * @returns the decoded data, or an invalid QVariant if @p data is neither JSON nor CBOR of a
+ * version we understand
+ */
+QVariant decode(const QByteArray &data);
+
+/**
+ * @returns the decoded content of the file at @p path, which is undefined if the file is
+ * corrupt, or std::nullopt if it can't be opened
+ */
+std::optional<QCborValue> readValue(const QString &path);
+/**
+ * Writes @p data to @p path, unless the file is known to hold the same bytes already because
+ * we read or wrote them before and nobody touched it since.
+ */
+bool writeValue(const QString &path, const QCborValue &data);
+
+/**
+ * @returns the decoded content of the file at @p path, which is an invalid QVariant if the
+ * file is corrupt, or std::nullopt if it can't be opened
+ */
+std::optional<QVariant> readFile(const QString &path);
+bool writeFile(const QString &path, const QVariant &data);
+
+struct WriteStatistics {
+    quint64 performed = 0;
+    quint64 skipped = 0;
+};
+WriteStatistics writeStatistics();
+void resetWriteStatistics();
+
+bool exists(const QString &path);
+bool remove(const QString &path);
+/**
+ * Replaces @p to with @p from.
+ */
+bool move(const QString &from, const QString &to);
+
+/**
+ * Identifies the content of a file, it changes whenever the file is written.
+ */
+struct Stamp {
+    bool exists = false;
+    QDateTime lastModified;
+    qint64 size = -1;
+
+    bool operator==(const Stamp &other) const = default;
+};
+Stamp stamp(const QString &path);
+
+/**
+ * @returns the store holding the files below Globals::dirPath(), or nullptr if they are kept
+ * as separate files
+ */
+StateStore *stateStore();
+}
@@ -0,0 +1,4 @@
+/* Define if the files in ~/.local/share/kscreen/ are written as CBOR by default */
+#cmakedefine01 KSCREEN_BINARY_STORAGE
+/* Define if the files in ~/.local/share/kscreen/ are kept in a single indexed file by default */
+#cmakedefine01 KSCREEN_STATE_STORE
@@ -5,6 +5,8 @@
 */
 
 #include "console.h"
+#include "../common/statestore.h"
+#include "../common/storage.h"
 
 #include <KWindowSystem>
 #include <QDebug>
@@ -137,24 +139,30 @@ void Console::printSerializations()
         qDebug().noquote() << file.readAll();
     } else {
         QString path = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/kscreen/");
+        if (StateStore *store = Storage::stateStore()) {
+            qDebug() << "Configs in: " << store->path();
+            const QStringList names = store->names();
+            qDebug() << "Number of records: " << names.count() << Qt::endl;
+            for (const QString &name : names) {
+                qDebug() << name;
+                qDebug().noquote() << QJsonDocument::fromVariant(Storage::decode(store->value(name).value_or(QByteArray()))).toJson(QJsonDocument::Indented);
+            }
+            return;
+        }
         qDebug() << "Configs in: " << path;
 
         QDir dir(path);
         const QStringList files = dir.entryList(QDir::Files);
         qDebug() << "Number of files: " << files.count() << Qt::endl;
 
-        QJsonDocument parser;
         for (const QString &fileName : files) {
-            QJsonParseError error;
             qDebug() << fileName;
-            QFile file(path + QLatin1Char('/') + fileName);
-            file.open(QFile::ReadOnly);
-            QJsonDocument parser = QJsonDocument::fromJson(file.readAll(), &error);
-            if (error.error != QJsonParseError::NoError) {
-                qDebug() << "    can't parse file:";
-                qDebug() << "    " << error.errorString();
+            // Files may be stored as JSON or CBOR, print both as JSON
+            const QVariant data = Storage::readFile(path + QLatin1Char('/') + fileName).value_or(QVariant());
+            if (!data.isValid()) {
+                qDebug() << "    can't parse file";
             } else {
-                qDebug().noquote() << parser.toJson(QJsonDocument::Indented);
+                qDebug().noquote() << QJsonDocument::fromVariant(data).toJson(QJsonDocument::Indented);
             }
         }
     }
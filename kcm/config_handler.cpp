@@ -112,13 +112,15 @@ bool ConfigHandler::checkPrioritiesNeedSave()
     QMap<QString, std::pair<std::optional<uint32_t>, std::optional<uint32_t>>> map;
 
     // exploiting the fact that operator[] on a map is what's called get_or_insert_default in other languages
+    const OutputIdentityTable &initialIdentities = m_initialControl->identities();
     const auto &initialList = m_initialConfig->outputs();
     for (const OutputPtr &output : initialList) {
-        map[output->hashMd5()].first = std::optional(output->priority());
+        map[initialIdentities.hashMd5(output)].first = std::optional(output->priority());
     }
+    const OutputIdentityTable &identities = m_control->identities();
     const auto &currentList = m_config->outputs();
     for (const OutputPtr &output : currentList) {
-        map[output->hashMd5()].second = std::optional(output->priority());
+        map[identities.hashMd5(output)].second = std::optional(output->priority());
     }
     // so if we end up with items that are not both initialized to the same priority
     for (const auto &[left, right] : std::as_const(map)) {
@@ -132,14 +134,13 @@ bool ConfigHandler::checkPrioritiesNeedSave()
 
 bool ConfigHandler::checkSaveandTestCommon(bool isSaveCheck)
 {
+    const OutputIdentityTable &identities = m_control->identities();
+    const OutputIdentityTable &initialIdentities = m_initialControl->identities();
     const auto outputs = m_config->connectedOutputs();
     for (const auto &output : outputs) {
-        const QString hash = output->hashMd5();
-        const auto configs = m_initialConfig->outputs();
-        for (const auto &config : configs) {
-            if (hash != config->hashMd5()) {
-                continue;
-            }
+        const QList<int> initialIds = initialIdentities.outputIds(identities.hashMd5(output));
+        for (int initialId : initialIds) {
+            const auto config = m_initialConfig->output(initialId);
 
             if (output->isEnabled() != config->isEnabled()) {
                 return true;
@@ -10,6 +10,7 @@
 #include <kscreen/edid.h>
 #include <kscreen/mode.h>
 
+#include "../common/modeindex.h"
 #include "../common/utils.h"
 #include "config_handler.h"
 
@@ -484,9 +485,12 @@ bool OutputModel::setEnabled(int outputIndex, bool enable)
     return true;
 }
 
+// Refresh rates closer than this are shown and treated as one
+static constexpr float s_refreshRateTolerance = 0.5;
+
 inline bool refreshRateCompare(float rate1, float rate2)
 {
-    return qAbs(rate1 - rate2) < 0.5;
+    return qAbs(rate1 - rate2) < s_refreshRateTolerance;
 }
 
 bool OutputModel::setResolution(int outputIndex, int resIndex)
@@ -499,30 +503,19 @@ bool OutputModel::setResolution(int outputIndex, int resIndex)
     const QSize size = resolutionList[resIndex];
 
     const float oldRate = output.ptr->currentMode() ? output.ptr->currentMode()->refreshRate() : -1;
-    const auto modes = output.ptr->modes();
-
-    auto modeIt = std::find_if(modes.begin(), modes.end(), [size, oldRate](const KScreen::ModePtr &mode) {
-        // TODO: we don't want to compare against old refresh rate if
-        //       refresh rate selection is auto.
-        return mode->size() == size && refreshRateCompare(mode->refreshRate(), oldRate);
-    });
+    const auto modes = ModeIndex::of(output.ptr);
 
-    if (modeIt == modes.end()) {
+    // TODO: we don't want to compare against old refresh rate if
+    //       refresh rate selection is auto.
+    KScreen::ModePtr mode = modes->findClosest(size, oldRate, s_refreshRateTolerance);
+    if (!mode) {
         // New resolution does not support previous refresh rate.
         // Get the highest one instead.
-        float bestRefreshRate = 0;
-        auto it = modes.begin();
-        while (it != modes.end()) {
-            if ((*it)->size() == size && (*it)->refreshRate() > bestRefreshRate) {
-                bestRefreshRate = (*it)->refreshRate();
-                modeIt = it;
-            }
-            it++;
-        }
+        mode = modes->bestForSize(size);
     }
-    Q_ASSERT(modeIt != modes.end());
+    Q_ASSERT(mode);
 
-    const auto id = (*modeIt)->id();
+    const auto id = mode->id();
     if (output.ptr->currentModeId() == id) {
         return false;
     }
@@ -552,21 +545,18 @@ bool OutputModel::setRefreshRate(int outputIndex, int refIndex)
     }
     const float refreshRate = rates[refIndex];
 
-    const auto modes = output.ptr->modes();
     const auto oldMode = output.ptr->currentMode();
 
-    auto modeIt = std::find_if(modes.begin(), modes.end(), [oldMode, refreshRate](const KScreen::ModePtr &mode) {
-        // TODO: we don't want to compare against old refresh rate if
-        //       refresh rate selection is auto.
-        return mode->size() == oldMode->size() && refreshRateCompare(mode->refreshRate(), refreshRate);
-    });
-    Q_ASSERT(modeIt != modes.end());
+    // TODO: we don't want to compare against old refresh rate if
+    //       refresh rate selection is auto.
+    const KScreen::ModePtr mode = ModeIndex::of(output.ptr)->findClosest(oldMode->size(), refreshRate, s_refreshRateTolerance);
+    Q_ASSERT(mode);
 
-    if (refreshRateCompare(oldMode->refreshRate(), (*modeIt)->refreshRate())) {
+    if (ModeKey::of(oldMode) == ModeKey::of(mode)) {
         // no change
         return false;
     }
-    output.ptr->setCurrentModeId((*modeIt)->id());
+    output.ptr->setCurrentModeId(mode->id());
     QModelIndex index = createIndex(outputIndex, 0);
     Q_EMIT dataChanged(index, index, {RefreshRateIndexRole});
     return true;
@@ -692,15 +682,7 @@ QVariantList OutputModel::resolutionsStrings(const KScreen::OutputPtr &output) c
 
 QList<QSize> OutputModel::resolutions(const KScreen::OutputPtr &output) const
 {
-    QList<QSize> hits;
-
-    const auto modes = output->modes();
-    for (const auto &mode : modes) {
-        const QSize size = mode->size();
-        if (!hits.contains(size)) {
-            hits << size;
-        }
-    }
+    QList<QSize> hits = ModeIndex::of(output)->sizes();
     std::sort(hits.begin(), hits.end(), [](const QSize &a, const QSize &b) {
         if (a.width() > b.width()) {
             return true;
@@ -727,23 +709,13 @@ QList<float> OutputModel::refreshRates(const KScreen::OutputPtr &output) const
         return hits;
     }
 
-    const auto modes = output->modes();
-    for (const auto &mode : modes) {
-        if (mode->size() != baseSize) {
-            continue;
-        }
-        const float rate = mode->refreshRate();
-        if (std::find_if(hits.begin(),
-                         hits.end(),
-                         [rate](float r) {
-                             return refreshRateCompare(r, rate);
-                         })
-            != hits.end()) {
-            continue;
+    // Highest first, so only neighbours can be too close to tell apart
+    const auto rates = ModeIndex::of(output)->refreshRates(baseSize);
+    for (const float rate : rates) {
+        if (hits.isEmpty() || !refreshRateCompare(hits.last(), rate)) {
+            hits << rate;
         }
-        hits << rate;
     }
-    std::stable_sort(hits.begin(), hits.end(), std::greater<>());
     return hits;
 }
 
@@ -779,9 +751,9 @@ QStringList OutputModel::replicationSourceModel(const KScreen::OutputPtr &output
 
 static KScreen::ModePtr getBestMode(const KScreen::OutputPtr &output, const KScreen::OutputPtr &source)
 {
-    auto calculateAspectRatio = [](const auto &output, const auto &mode) {
-        const qreal ratio = mode->size().width() / qreal(mode->size().height());
-        const qreal ratioTransposed = mode->size().height() / qreal(mode->size().width());
+    auto calculateAspectRatio = [](const auto &output, const QSize &size) {
+        const qreal ratio = size.width() / qreal(size.height());
+        const qreal ratioTransposed = size.height() / qreal(size.width());
         switch (output->rotation()) {
         case KScreen::Output::Left:
         case KScreen::Output::Right:
@@ -790,35 +762,27 @@ static KScreen::ModePtr getBestMode(const KScreen::OutputPtr &output, const KScr
             return ratio;
         }
     };
-    const qreal sourceRatio = calculateAspectRatio(source, source->currentMode());
-    // 1.1: Find modes with the same aspect ratio as the source output; if none, don't change the mode
-    std::vector<KScreen::ModePtr> availableModes(output->modes().cbegin(), output->modes().cend());
-    std::erase_if(availableModes, [&calculateAspectRatio, &output, sourceRatio](const auto &mode) {
-        return !qFuzzyCompare(calculateAspectRatio(output, mode), sourceRatio);
+    const qreal sourceRatio = calculateAspectRatio(source, source->currentMode()->size());
+    // 1.1: Find sizes with the same aspect ratio as the source output; if none, don't change the mode
+    // Ordered by area, which for a single aspect ratio is also the order of the widths
+    const auto modes = ModeIndex::of(output);
+    QList<QSize> availableSizes = modes->sizes();
+    availableSizes.removeIf([&calculateAspectRatio, &output, sourceRatio](const QSize &size) {
+        return !qFuzzyCompare(calculateAspectRatio(output, size), sourceRatio);
     });
-    if (availableModes.empty()) {
+    if (availableSizes.empty()) {
         return output->currentMode();
     }
 
     // 1.2: Use the smallest mode at least as large as the source output; if none, use the largest mode
-    std::sort(availableModes.begin(), availableModes.end(), [&output](const auto &a, const auto &b) {
-        return a->size().width() < b->size().width();
-    });
-    auto getRotatedSize = [](const auto &output, const auto &mode) {
-        if (output->rotation() == KScreen::Output::Left || output->rotation() == KScreen::Output::Right) {
-            return mode->size().transposed();
-        }
-        return mode->size();
-    };
-    const auto sourceSize = getRotatedSize(source, source->currentMode());
-    const auto it = std::find_if(availableModes.begin(), availableModes.end(), [sourceSize](const auto &mode) {
-        return mode->size().width() >= sourceSize.width();
-    });
-    if (it != availableModes.end()) {
-        return *it;
-    } else {
-        return availableModes.back();
+    QSize sourceSize = source->currentMode()->size();
+    if (source->rotation() == KScreen::Output::Left || source->rotation() == KScreen::Output::Right) {
+        sourceSize.transpose();
     }
+    const auto it = std::find_if(availableSizes.cbegin(), availableSizes.cend(), [sourceSize](const QSize &size) {
+        return size.width() >= sourceSize.width();
+    });
+    return modes->bestForSize(it != availableSizes.cend() ? *it : availableSizes.last());
 }
 
 bool OutputModel::setReplicationSourceIndex(int outputIndex, int sourceIndex)
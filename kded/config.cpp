@@ -6,23 +6,31 @@
 */
 #include "config.h"
 #include "../common/control.h"
+#include "../common/modeindex.h"
+#include "../common/outputidentity.h"
+#include "../common/storage.h"
 #include "device.h"
+#include "ioworker.h"
 #include "kscreen_daemon_debug.h"
+#include "layoutcache.h"
+#include "layoutindex.h"
 #include "output.h"
+#include "storecompactor.h"
+#include "tracer.h"
 
-#include <QDir>
-#include <QFile>
-#include <QJsonDocument>
+#include <QPointer>
 #include <QRect>
 #include <QStandardPaths>
 #include <QStringBuilder>
 
+#include <algorithm>
 #include <cstdint>
 
 #include <kscreen/output.h>
 #include <kscreen/screen.h>
 
 QString Config::s_fixedConfigFileName = QStringLiteral("fixed-config");
+static const QString s_lastLayoutFileName = QStringLiteral("last-layout");
 QString Config::s_configsDirName = QString();
 /*QStringLiteral("configs");*/ // TODO: KDE6 - Replace QString w/ QStringLiteral move these files into the subfolder
 
@@ -31,6 +39,11 @@ QString Config::configsDirPath()
     return Globals::dirPath() % s_configsDirName;
 }
 
+QString Config::lastLayoutFilePath()
+{
+    return Globals::dirPath() % s_lastLayoutFileName;
+}
+
 Config::Config(KScreen::ConfigPtr config, QObject *parent)
     : QObject(parent)
     , m_data(config)
@@ -40,7 +53,7 @@ Config::Config(KScreen::ConfigPtr config, QObject *parent)
 
 QString Config::filePath() const
 {
-    if (!QDir().mkpath(configsDirPath())) {
+    if (!Globals::mkpath(configsDirPath())) {
         return QString();
     }
     return configsDirPath() % id();
@@ -62,58 +75,229 @@ void Config::activateControlWatching()
 
 bool Config::fileExists() const
 {
-    return (QFile::exists(configsDirPath() % id()) || QFile::exists(configsDirPath() % s_fixedConfigFileName));
+    return (Storage::exists(configsDirPath() % id()) || Storage::exists(configsDirPath() % s_fixedConfigFileName));
 }
 
 std::unique_ptr<Config> Config::readFile()
 {
-    if (Device::self()->isLaptop() && !Device::self()->isLidClosed()) {
+    // Writes still queued would otherwise be missed
+    IoWorker::self()->waitForDone();
+    if (isLidOpen()) {
         // We may look for a config that has been set when the lid was closed, Bug: 353029
-        const QString lidOpenedFilePath(filePath() % QStringLiteral("_lidOpened"));
-        const QFile srcFile(lidOpenedFilePath);
-
-        if (srcFile.exists()) {
-            QFile::remove(filePath());
-            if (QFile::copy(lidOpenedFilePath, filePath())) {
-                QFile::remove(lidOpenedFilePath);
-                qCDebug(KSCREEN_KDED) << "Restored lid opened config to" << id();
-            }
-        }
+        restoreLidOpenedFile(id());
     }
     return readFile(id());
 }
 
 std::unique_ptr<Config> Config::readOpenLidFile()
 {
+    IoWorker::self()->waitForDone();
     const QString openLidFile = id() % QStringLiteral("_lidOpened");
     auto config = readFile(openLidFile);
-    QFile::remove(configsDirPath() % openLidFile);
+    Storage::remove(configsDirPath() % openLidFile);
+    LayoutCache::self()->remove(openLidFile);
     return config;
 }
 
-std::unique_ptr<Config> Config::readFile(const QString &fileName)
+std::unique_ptr<Config> Config::readNearestFile()
 {
     if (!m_data) {
         return nullptr;
     }
-    auto config = std::unique_ptr<Config>(new Config(m_data->clone()));
-    config->setValidityFlags(m_validityFlags);
+    IoWorker::self()->waitForDone();
+    const auto outputs = loadNearestLayout(LayoutIndex::keys(m_data), isLidOpen(), globalDataNames());
+    if (!outputs) {
+        return nullptr;
+    }
+    return applyLayout(*outputs, true);
+}
+
+void Config::readFileAsync(QObject *context, const ReadCallback &done)
+{
+    const QString fileName = id();
+    const bool restoreLidOpened = isLidOpen();
+    const QList<QStringList> names = globalDataNames();
+    readAsync(
+        context,
+        [fileName, restoreLidOpened, names]() {
+            if (restoreLidOpened) {
+                restoreLidOpenedFile(fileName);
+            }
+            return loadLayout(fileName, names);
+        },
+        done);
+}
+
+void Config::readOpenLidFileAsync(QObject *context, const ReadCallback &done)
+{
+    const QString openLidFile = id() % QStringLiteral("_lidOpened");
+    const QList<QStringList> names = globalDataNames();
+    readAsync(
+        context,
+        [openLidFile, names]() {
+            const auto outputs = loadLayout(openLidFile, names);
+            Storage::remove(configsDirPath() % openLidFile);
+            LayoutCache::self()->remove(openLidFile);
+            return outputs;
+        },
+        done);
+}
+
+void Config::removeOpenLidFileAsync()
+{
+    const QString openLidFile = id() % QStringLiteral("_lidOpened");
+    IoWorker::self()->post([openLidFile]() {
+        Storage::remove(configsDirPath() % openLidFile);
+        LayoutCache::self()->remove(openLidFile);
+    });
+}
+
+void Config::readNearestFileAsync(QObject *context, const ReadCallback &done)
+{
+    if (!m_data) {
+        done(nullptr);
+        return;
+    }
+    const QList<LayoutIndex::OutputKey> outputs = LayoutIndex::keys(m_data);
+    const bool lidOpen = isLidOpen();
+    const QList<QStringList> names = globalDataNames();
+    readAsync(
+        context,
+        [outputs, lidOpen, names]() {
+            return loadNearestLayout(outputs, lidOpen, names);
+        },
+        done,
+        true);
+}
+
+void Config::readAsync(QObject *context, const std::function<std::optional<Schema::Layout>()> &job, const ReadCallback &done, bool nearest)
+{
+    if (!m_data) {
+        done(nullptr);
+        return;
+    }
+    QPointer<const Config> self(this);
+    IoWorker::self()->run(context, job, [self, done, nearest](const std::optional<Schema::Layout> &outputs) {
+        if (!self) {
+            // The config has been replaced in the meantime, nobody is interested anymore
+            return;
+        }
+        done(outputs ? self->applyLayout(*outputs, nearest) : nullptr);
+    });
+}
+
+QString Config::prefetchLastLayout()
+{
+    const auto data = Storage::readValue(lastLayoutFilePath());
+    if (!data) {
+        return QString();
+    }
+    const Schema::LastLayoutRecord lastLayout = Schema::LastLayoutRecord::decode(*data);
+    const QString id = lastLayout.id;
+    if (id.isEmpty() || Storage::exists(configsDirPath() % id % QStringLiteral("_lidOpened"))) {
+        // Which layout to use depends on the lid, wait for the device to be known
+        return QString();
+    }
+
+    if (!loadLayout(id, lastLayout.globalDataNames)) {
+        return QString();
+    }
+    qCDebug(KSCREEN_KDED) << "Prefetched the last layout" << id;
+    return id;
+}
+
+bool Config::isLidOpen()
+{
+    return Device::self()->isLaptop() && !Device::self()->isLidClosed();
+}
+
+void Config::restoreLidOpenedFile(const QString &id)
+{
+    const QString filePath = configsDirPath() % id;
+    const QString lidOpenedFilePath(filePath % QStringLiteral("_lidOpened"));
+    if (!Storage::exists(lidOpenedFilePath)) {
+        return;
+    }
+    if (Storage::move(lidOpenedFilePath, filePath)) {
+        qCDebug(KSCREEN_KDED) << "Restored lid opened config to" << id;
+    }
+    LayoutCache::self()->remove(id);
+    LayoutCache::self()->remove(id % QStringLiteral("_lidOpened"));
+}
+
+QList<QStringList> Config::globalDataNames() const
+{
+    QList<QStringList> names;
+    if (!m_data) {
+        return names;
+    }
+    const auto outputs = m_data->connectedOutputs();
+    for (const KScreen::OutputPtr &output : outputs) {
+        names.append(Output::globalDataNames(output));
+    }
+    return names;
+}
+
+std::optional<Schema::Layout> Config::loadLayout(const QString &fileName, const QList<QStringList> &globalDataNames)
+{
+    HotplugTracer::Span span(HotplugTracer::Stage::ReadConfig);
+
+    // Output::readInOutputs() looks at the global data of every output, have it in the cache by then
+    for (const QStringList &names : globalDataNames) {
+        Output::readGlobalData(names);
+    }
+
+    QString layoutName = fileName;
+    if (Storage::exists(configsDirPath() % s_fixedConfigFileName)) {
+        layoutName = s_fixedConfigFileName;
+        qCDebug(KSCREEN_KDED) << "found a fixed config, will use " << configsDirPath() % layoutName;
+    }
+
+    if (auto outputs = LayoutCache::self()->layout(layoutName)) {
+        StoreCompactor::self()->markUsed(s_configsDirName % layoutName);
+        return outputs;
+    }
+    const auto data = Storage::readValue(configsDirPath() % layoutName);
+    if (!data) {
+        qCDebug(KSCREEN_KDED) << "failed to open file" << configsDirPath() % layoutName;
+        return std::nullopt;
+    }
+    StoreCompactor::self()->markUsed(s_configsDirName % layoutName);
+    const Schema::Layout outputs = Schema::decodeLayout(*data);
+    LayoutCache::self()->insert(layoutName, outputs);
+    return outputs;
+}
+
+std::optional<Schema::Layout> Config::loadNearestLayout(const QList<LayoutIndex::OutputKey> &outputs, bool lidOpen, const QList<QStringList> &globalDataNames)
+{
+    const auto fileName = LayoutIndex::self()->nearest(outputs, lidOpen);
+    if (!fileName) {
+        return std::nullopt;
+    }
+    qCDebug(KSCREEN_KDED) << "Using the layout of a similar topology" << *fileName;
+    return loadLayout(*fileName, globalDataNames);
+}
 
-    QFile file;
-    if (QFile::exists(configsDirPath() % s_fixedConfigFileName)) {
-        file.setFileName(configsDirPath() % s_fixedConfigFileName);
-        qCDebug(KSCREEN_KDED) << "found a fixed config, will use " << file.fileName();
-    } else {
-        file.setFileName(configsDirPath() % fileName);
+std::unique_ptr<Config> Config::readFile(const QString &fileName)
+{
+    if (!m_data) {
+        return nullptr;
     }
-    if (!file.open(QIODevice::ReadOnly)) {
-        qCDebug(KSCREEN_KDED) << "failed to open file" << file.fileName();
+    const auto outputs = loadLayout(fileName, globalDataNames());
+    if (!outputs) {
         return nullptr;
     }
+    return applyLayout(*outputs);
+}
 
-    QJsonDocument parser;
-    QVariantList outputs = parser.fromJson(file.readAll()).toVariant().toList();
+std::unique_ptr<Config> Config::applyLayout(const Schema::Layout &outputs, bool nearest) const
+{
+    auto config = std::unique_ptr<Config>(new Config(m_data->clone()));
+    config->setValidityFlags(m_validityFlags);
     Output::readInOutputs(config->data(), outputs);
+    if (nearest) {
+        Output::placeUnknownOutputs(config->data(), outputs);
+    }
 
     QSize screenSize;
     const auto configOutputs = config->data()->outputs();
@@ -155,9 +339,40 @@ bool Config::canBeApplied(KScreen::ConfigPtr config) const
 #endif
 }
 
+struct Config::SaveJob {
+    QString filePath;
+    Schema::LastLayoutRecord layout;
+    bool restoreLidOpened = false;
+    Schema::Layout outputs;
+    // Disabled outputs keep the mode and position they had in the layout written before
+    struct Fallback {
+        qsizetype index;
+        // Identical outputs share the id, only the connector tells them apart
+        QString name;
+        bool duplicate = false;
+        QStringList globalDataNames;
+        // Copied, the modes of the output belong to the main thread
+        QList<Schema::ModeRecord> modes;
+        std::optional<ModeKey> preferredMode;
+        // For when the layout doesn't know the output
+        QPoint pos;
+        // What comes with a mode
+        Schema::OutputRecord settings;
+    };
+    QList<Fallback> fallbacks;
+    QList<Output::GlobalWrite> globals;
+    // Set for the layout of the current topology, which is then the one prefetched at the next start
+    std::optional<Schema::LastLayoutRecord> lastLayout;
+};
+
 bool Config::writeFile()
 {
-    return writeFile(filePath());
+    SaveJob job;
+    if (!prepareWrite(filePath(), job)) {
+        return false;
+    }
+    job.lastLayout = lastLayout();
+    return persist(job);
 }
 
 bool Config::writeOpenLidFile()
@@ -167,67 +382,181 @@ bool Config::writeOpenLidFile()
 
 bool Config::writeFile(const QString &filePath)
 {
-    if (id().isEmpty()) {
+    SaveJob job;
+    if (!prepareWrite(filePath, job)) {
         return false;
     }
-    const KScreen::OutputList outputs = m_data->outputs();
+    return persist(job);
+}
 
-    const auto oldConfig = readFile();
-    KScreen::OutputList oldOutputs;
-    if (oldConfig) {
-        oldOutputs = oldConfig->data()->outputs();
+void Config::writeFileAsync()
+{
+    SaveJob job;
+    if (!prepareWrite(filePath(), job)) {
+        return;
     }
+    job.lastLayout = lastLayout();
+    IoWorker::self()->post([job]() {
+        persist(job);
+    });
+}
 
-    const auto hasDuplicate = [&outputs](const auto output) {
-        return std::any_of(outputs.begin(), outputs.end(), [output](const auto &o) {
-            return o != output && o->hashMd5() == output->hashMd5();
-        });
-    };
+void Config::writeOpenLidFileAsync()
+{
+    SaveJob job;
+    if (!prepareWrite(filePath() % QStringLiteral("_lidOpened"), job)) {
+        return;
+    }
+    IoWorker::self()->post([job]() {
+        persist(job);
+    });
+}
 
-    QVariantList outputList;
-    for (const KScreen::OutputPtr &output : outputs) {
-        QVariantMap info;
+Schema::LastLayoutRecord Config::lastLayout() const
+{
+    return Schema::LastLayoutRecord{id(), globalDataNames()};
+}
 
-        const auto oldOutputIt = std::find_if(oldOutputs.constBegin(), oldOutputs.constEnd(), [output](const KScreen::OutputPtr &out) {
-            return out->hashMd5() == output->hashMd5();
-        });
-        const KScreen::OutputPtr oldOutput = oldOutputIt != oldOutputs.constEnd() ? *oldOutputIt : nullptr;
+bool Config::prepareWrite(const QString &filePath, SaveJob &job)
+{
+    if (id().isEmpty()) {
+        return false;
+    }
+    const KScreen::OutputList outputs = m_data->outputs();
+    const OutputIdentityTable identities(outputs);
+
+    job.filePath = filePath;
+    // The layout written before is only looked at on the IoWorker thread, see resolveFallbacks()
+    job.layout = lastLayout();
+    job.restoreLidOpened = isLidOpen();
+    job.outputs.reserve(outputs.count());
+    for (const KScreen::OutputPtr &output : outputs) {
+        Schema::OutputRecord info;
 
         if (!output->isConnected()) {
             continue;
         }
+        const OutputIdentityTable::Identity *identity = identities.identity(output->id());
 
-        Output::writeGlobalPart(output, info, oldOutput);
-        info[QStringLiteral("priority")] = output->priority();
-        info[QStringLiteral("enabled")] = output->isEnabled();
+        const bool hasMode = Output::writeGlobalPart(output, info, nullptr);
+        info.priority = output->priority();
+        info.enabled = output->isEnabled();
 
-        auto setOutputConfigInfo = [&info](const KScreen::OutputPtr &out) {
-            if (!out) {
-                return;
+        if (output->isEnabled()) {
+            info.pos = output->pos();
+            // try to update global output data
+            if (const auto global = Output::prepareGlobal(output, identity->duplicate)) {
+                job.globals.append(*global);
+            }
+        } else {
+            SaveJob::Fallback fallback{job.outputs.count(), output->name(), identity->connectedDuplicate};
+            fallback.globalDataNames = Output::globalDataNames(output);
+            if (!hasMode) {
+                const KScreen::ModeList modes = output->modes();
+                fallback.modes.reserve(modes.count());
+                for (const KScreen::ModePtr &mode : modes) {
+                    fallback.modes.append(Schema::ModeRecord{mode->size(), mode->refreshRate(), ModeKey::of(mode).refreshMilliHz});
+                }
+                if (const KScreen::ModePtr preferred = output->preferredMode()) {
+                    fallback.preferredMode = ModeKey::of(preferred);
+                }
+                fallback.settings.vrrPolicy = static_cast<uint32_t>(output->vrrPolicy());
+                fallback.settings.overscan = output->overscan();
+                fallback.settings.rgbRange = static_cast<uint32_t>(output->rgbRange());
             }
+            fallback.pos = output->pos();
+            job.fallbacks.append(fallback);
+        }
 
-            QVariantMap pos;
-            pos[QStringLiteral("x")] = out->pos().x();
-            pos[QStringLiteral("y")] = out->pos().y();
-            info[QStringLiteral("pos")] = pos;
-        };
-        setOutputConfigInfo(output->isEnabled() ? output : oldOutput);
+        job.outputs.append(info);
+    }
+    return true;
+}
 
-        if (output->isEnabled()) {
-            // try to update global output data
-            Output::writeGlobal(output, hasDuplicate(output));
+void Config::resolveFallbacks(SaveJob &job)
+{
+    if (job.restoreLidOpened) {
+        restoreLidOpenedFile(job.layout.id);
+    }
+    if (job.fallbacks.isEmpty()) {
+        return;
+    }
+    const auto oldOutputs = loadLayout(job.layout.id, job.layout.globalDataNames);
+    if (!oldOutputs) {
+        return;
+    }
+
+    for (const SaveJob::Fallback &fallback : std::as_const(job.fallbacks)) {
+        Schema::OutputRecord &info = job.outputs[fallback.index];
+        const auto old = std::find_if(oldOutputs->cbegin(), oldOutputs->cend(), [&info, &fallback](const Schema::OutputRecord &oldInfo) {
+            return oldInfo.id == info.id && (!fallback.duplicate || (oldInfo.metadata && oldInfo.metadata->name == fallback.name));
+        });
+        const bool known = old != oldOutputs->cend();
+        info.pos = known ? old->pos.value_or(QPoint()) : fallback.pos;
+
+        if (fallback.modes.isEmpty()) {
+            continue;
+        }
+        // The mode Output::readIn() would pick when reading the old layout
+        Schema::OutputRecord oldInfo = Output::readGlobalData(fallback.globalDataNames);
+        if (oldInfo.isEmpty() && known) {
+            oldInfo = *old;
+        }
+        const auto find = [&fallback](const ModeKey &key) -> const Schema::ModeRecord * {
+            const auto it = std::find_if(fallback.modes.cbegin(), fallback.modes.cend(), [&key](const Schema::ModeRecord &mode) {
+                return mode.key() == key;
+            });
+            return it == fallback.modes.cend() ? nullptr : &*it;
+        };
+        const Schema::ModeRecord *mode = nullptr;
+        if (oldInfo.mode) {
+            mode = find(oldInfo.mode->key());
+        }
+        if (!mode && fallback.preferredMode) {
+            mode = find(*fallback.preferredMode);
+        }
+        if (!mode) {
+            // Like ModeIndex::biggest(), the last of equal modes wins
+            for (const Schema::ModeRecord &candidate : fallback.modes) {
+                const qint64 area = qint64(candidate.size.width()) * candidate.size.height();
+                const qint64 biggestArea = mode ? qint64(mode->size.width()) * mode->size.height() : -1;
+                if (area > biggestArea || (area == biggestArea && candidate.refresh >= mode->refresh)) {
+                    mode = &candidate;
+                }
+            }
         }
+        Schema::OutputRecord settings = fallback.settings;
+        settings.mode = *mode;
+        info.update(settings);
+    }
+}
+
+bool Config::persist(SaveJob job)
+{
+    HotplugTracer::Span span(HotplugTracer::Stage::WriteConfig);
 
-        outputList.append(info);
+    resolveFallbacks(job);
+
+    for (const Output::GlobalWrite &global : job.globals) {
+        Output::writeGlobal(global);
     }
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly)) {
-        qCWarning(KSCREEN_KDED) << "Failed to open config file for writing! " << file.errorString();
+    if (!Storage::writeValue(job.filePath, Schema::encodeLayout(job.outputs))) {
+        qCWarning(KSCREEN_KDED) << "Failed to write config file" << job.filePath;
         return false;
     }
-    file.write(QJsonDocument::fromVariant(outputList).toJson());
-    qCDebug(KSCREEN_KDED) << "Config saved on: " << file.fileName();
+    qCDebug(KSCREEN_KDED) << "Config saved on: " << job.filePath;
+
+    if (job.filePath.startsWith(configsDirPath())) {
+        const QString fileName = job.filePath.mid(configsDirPath().length());
+        LayoutCache::self()->insert(fileName, job.outputs);
+        LayoutIndex::self()->insert(fileName, job.outputs);
+        StoreCompactor::self()->markUsed(s_configsDirName % fileName);
+    }
+    if (job.lastLayout) {
+        // Usually the same as before, which the write deduplication takes care of
+        Storage::writeValue(lastLayoutFilePath(), job.lastLayout->encode());
+    }
 
     return true;
 }
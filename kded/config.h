@@ -5,11 +5,16 @@
 */
 #pragma once
 
+#include "../common/schema.h"
+#include "layoutindex.h"
+
 #include <kscreen/config.h>
 
 #include <QOrientationReading>
 
+#include <functional>
 #include <memory>
+#include <optional>
 
 class ControlConfig;
 
@@ -25,9 +30,37 @@ public:
     bool fileExists() const;
     std::unique_ptr<Config> readFile();
     std::unique_ptr<Config> readOpenLidFile();
+    /**
+     * Reads the layout of the known topology closest to this one, for when it has no layout of
+     * its own, see LayoutIndex.
+     */
+    std::unique_ptr<Config> readNearestFile();
     bool writeFile();
     bool writeOpenLidFile();
     static QString configsDirPath();
+    static QString lastLayoutFilePath();
+
+    using ReadCallback = std::function<void(std::unique_ptr<Config>)>;
+    /**
+     * Asynchronous variants of the functions above. The files are read, parsed and written
+     * on the IoWorker thread, only building the resulting KScreen::Config happens in the
+     * thread of @p context, which is also where @p done is invoked.
+     */
+    void readFileAsync(QObject *context, const ReadCallback &done);
+    void readOpenLidFileAsync(QObject *context, const ReadCallback &done);
+    void readNearestFileAsync(QObject *context, const ReadCallback &done);
+    void writeFileAsync();
+    void writeOpenLidFileAsync();
+    // Drops the open-lid layout when it is restored without reading it
+    void removeOpenLidFileAsync();
+
+    /**
+     * Loads the layout that was saved last, and the global data of its outputs, into the
+     * LayoutCache, so that it can be applied right away if the topology is still the same at
+     * the next start. Meant to be run on the IoWorker thread.
+     * @returns the id of the prefetched layout, empty if there is none or it can't be used as is
+     */
+    static QString prefetchLastLayout();
 
     KScreen::ConfigPtr data() const
     {
@@ -50,9 +83,27 @@ Q_SIGNALS:
 private:
     friend class TestConfig;
 
+    struct SaveJob;
+
     QString filePath() const;
     std::unique_ptr<Config> readFile(const QString &fileName);
     bool writeFile(const QString &filePath);
+    Schema::LastLayoutRecord lastLayout() const;
+
+    QList<QStringList> globalDataNames() const;
+    // Whether the laptop panel is to be used
+    static bool isLidOpen();
+    // @p nearest tells that the layout is one of another topology
+    void readAsync(QObject *context, const std::function<std::optional<Schema::Layout>()> &job, const ReadCallback &done, bool nearest = false);
+    std::unique_ptr<Config> applyLayout(const Schema::Layout &outputs, bool nearest = false) const;
+    bool prepareWrite(const QString &filePath, SaveJob &job);
+
+    // These run on the IoWorker thread and must not touch any QObject.
+    static void restoreLidOpenedFile(const QString &id);
+    static std::optional<Schema::Layout> loadLayout(const QString &fileName, const QList<QStringList> &globalDataNames);
+    static std::optional<Schema::Layout> loadNearestLayout(const QList<LayoutIndex::OutputKey> &outputs, bool lidOpen, const QList<QStringList> &globalDataNames);
+    static void resolveFallbacks(SaveJob &job);
+    static bool persist(SaveJob job);
 
     bool canBeApplied(KScreen::ConfigPtr config) const;
 
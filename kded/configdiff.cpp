@@ -0,0 +1,116 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "configdiff.h"
+
+#include <QStringList>
+
+ConfigDiff::ConfigDiff(const KScreen::ConfigPtr &current, const KScreen::ConfigPtr &target)
+{
+    if (!current || !target) {
+        return;
+    }
+    const KScreen::OutputList currentOutputs = current->outputs();
+    const KScreen::OutputList targetOutputs = target->outputs();
+
+    for (auto it = targetOutputs.cbegin(); it != targetOutputs.cend(); ++it) {
+        const Properties properties = compare(currentOutputs.value(it.key()), it.value());
+        if (properties) {
+            m_changes.insert(it.key(), properties);
+        }
+    }
+    for (auto it = currentOutputs.cbegin(); it != currentOutputs.cend(); ++it) {
+        if (!targetOutputs.contains(it.key())) {
+            m_changes.insert(it.key(), Presence);
+        }
+    }
+}
+
+ConfigDiff::Properties ConfigDiff::compare(const KScreen::OutputPtr &current, const KScreen::OutputPtr &target)
+{
+    if (!current || !target) {
+        return current == target ? Properties() : Properties(Presence);
+    }
+
+    Properties properties;
+    if (current->isEnabled() != target->isEnabled()) {
+        properties |= Enabled;
+    }
+    if (!target->isEnabled()) {
+        // Nothing else of a disabled output reaches the screen
+        return properties;
+    }
+
+    if (current->currentModeId() != target->currentModeId()) {
+        properties |= Mode;
+    }
+    if (current->pos() != target->pos()) {
+        properties |= Position;
+    }
+    if (!qFuzzyCompare(current->scale(), target->scale())) {
+        properties |= Scale;
+    }
+    if (current->rotation() != target->rotation()) {
+        properties |= Rotation;
+    }
+    if (current->priority() != target->priority()) {
+        properties |= Priority;
+    }
+    if (current->vrrPolicy() != target->vrrPolicy()) {
+        properties |= VrrPolicy;
+    }
+    if (current->overscan() != target->overscan()) {
+        properties |= Overscan;
+    }
+    if (current->rgbRange() != target->rgbRange()) {
+        properties |= RgbRange;
+    }
+    if (current->replicationSource() != target->replicationSource()) {
+        properties |= Replication;
+    }
+    return properties;
+}
+
+bool ConfigDiff::isEmpty() const
+{
+    return m_changes.isEmpty();
+}
+
+QMap<int, ConfigDiff::Properties> ConfigDiff::changes() const
+{
+    return m_changes;
+}
+
+QDebug operator<<(QDebug dbg, const ConfigDiff &diff)
+{
+    static const QList<std::pair<ConfigDiff::Property, const char *>> names = {
+        {ConfigDiff::Enabled, "enabled"},
+        {ConfigDiff::Mode, "mode"},
+        {ConfigDiff::Position, "position"},
+        {ConfigDiff::Scale, "scale"},
+        {ConfigDiff::Rotation, "rotation"},
+        {ConfigDiff::Priority, "priority"},
+        {ConfigDiff::VrrPolicy, "vrr"},
+        {ConfigDiff::Overscan, "overscan"},
+        {ConfigDiff::RgbRange, "rgbrange"},
+        {ConfigDiff::Replication, "replication"},
+        {ConfigDiff::Presence, "presence"},
+    };
+
+    QDebugStateSaver saver(dbg);
+    dbg.nospace() << "ConfigDiff(";
+    const auto changes = diff.changes();
+    for (auto it = changes.cbegin(); it != changes.cend(); ++it) {
+        QStringList changed;
+        for (const auto &[property, name] : names) {
+            if (it.value() & property) {
+                changed << QString::fromLatin1(name);
+            }
+        }
+        dbg << it.key() << ": " << changed.join(QLatin1Char(',')) << "; ";
+    }
+    dbg << ")";
+    return dbg;
+}
@@ -0,0 +1,56 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <kscreen/config.h>
+#include <kscreen/output.h>
+
+#include <QDebug>
+#include <QFlags>
+#include <QMap>
+
+/**
+ * The output properties the daemon sets that differ between two configs of the same outputs.
+ *
+ * Used to avoid sending a config the backend already has, every SetConfigOperation may cause
+ * a modeset and with it a visible blank.
+ */
+class ConfigDiff
+{
+public:
+    enum Property {
+        Enabled = 1 << 0,
+        Mode = 1 << 1,
+        Position = 1 << 2,
+        Scale = 1 << 3,
+        Rotation = 1 << 4,
+        Priority = 1 << 5,
+        VrrPolicy = 1 << 6,
+        Overscan = 1 << 7,
+        RgbRange = 1 << 8,
+        Replication = 1 << 9,
+        // The output only exists in one of the configs
+        Presence = 1 << 10,
+    };
+    Q_DECLARE_FLAGS(Properties, Property)
+
+    ConfigDiff(const KScreen::ConfigPtr &current, const KScreen::ConfigPtr &target);
+
+    static Properties compare(const KScreen::OutputPtr &current, const KScreen::OutputPtr &target);
+
+    bool isEmpty() const;
+    /**
+     * @returns the changed properties by output id, outputs without changes are left out
+     */
+    QMap<int, Properties> changes() const;
+
+private:
+    QMap<int, Properties> m_changes;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(ConfigDiff::Properties)
+
+QDebug operator<<(QDebug dbg, const ConfigDiff &diff);
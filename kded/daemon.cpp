@@ -9,11 +9,23 @@
 */
 #include "daemon.h"
 
+#include "../common/globals.h"
 #include "config.h"
+#include "configdiff.h"
 #include "device.h"
+#include "diagnosticsadaptor.h"
+#include "eventrecorder.h"
+#include "flapdetector.h"
 #include "generator.h"
+#include "ioworker.h"
 #include "kscreen_daemon_debug.h"
+#include "layoutcache.h"
+#include "layoutindex.h"
+#include "output.h"
 #include "osdservice_interface.h"
+#include "settledetector.h"
+#include "storecompactor.h"
+#include "tracer.h"
 
 #include <kscreen/configmonitor.h>
 #include <kscreen/getconfigoperation.h>
@@ -29,6 +41,8 @@
 #include <QTimer>
 #include <QTransform>
 
+#include <utility>
+
 #if WITH_X11
 #include <QtGui/private/qtx11extras_p.h>
 #include <X11/Xatom.h>
@@ -37,7 +51,9 @@
 #include <X11/extensions/XInput2.h>
 #endif
 
+#ifndef KDED_UNIT_TEST
 K_PLUGIN_CLASS_WITH_JSON(KScreenDaemon, "kscreen.json")
+#endif
 
 #if WITH_X11
 struct DeviceListDeleter {
@@ -62,12 +78,25 @@ struct XDeleter {
 KScreenDaemon::KScreenDaemon(QObject *parent, const QList<QVariant> &)
     : KDEDModule(parent)
     , m_monitoring(false)
-    , m_changeCompressor(new QTimer(this))
+    , m_settleDetector(new SettleDetector(this))
+    , m_flapDetector(new FlapDetector(this))
     , m_saveTimer(nullptr)
     , m_lidClosedTimer(new QTimer(this))
+    , m_compactionTimer(new QTimer(this))
 {
     KScreen::Log::instance();
     qMetaTypeId<KScreen::OsdAction>();
+    new DiagnosticsAdaptor(this);
+
+    Globals::watchPaths({Config::configsDirPath(), Output::dirPath()});
+    // Decode the last layout while the backend and UPower are being asked, see applyPrefetchedLayout()
+    LayoutCache::self();
+    StoreCompactor::self();
+    IoWorker::self()->run(this, &Config::prefetchLastLayout, [this](const QString &id) {
+        m_prefetchedLayoutId = id;
+        applyPrefetchedLayout();
+    });
+
     QMetaObject::invokeMethod(this, "getInitialConfig", Qt::QueuedConnection);
 }
 
@@ -85,33 +114,84 @@ void KScreenDaemon::getInitialConfig()
         KScreen::ConfigMonitor::instance()->addConfig(m_monitoredConfig->data());
 
         init();
+        applyPrefetchedLayout();
+    });
+}
+
+void KScreenDaemon::applyPrefetchedLayout()
+{
+    // Both the prefetch and the initial config have to be there, and the regular startup must
+    // not have taken over yet
+    if (!m_monitoredConfig || m_prefetchedLayoutId.isEmpty() || !m_startingUp || m_generatorReady) {
+        return;
+    }
+    const QString id = std::exchange(m_prefetchedLayoutId, QString());
+    if (id != m_monitoredConfig->id()) {
+        qCDebug(KSCREEN_KDED) << "Outputs changed since the last layout was saved, not applying it early";
+        return;
+    }
+
+    // The Generator, and with it finishStartup(), waits for the Device. Once it is there, the
+    // layout is read again and only applied if it differs, e.g. because the lid is closed.
+    qCDebug(KSCREEN_KDED) << "Applying the last layout before the device is known";
+    const quint64 generation = m_applyGeneration;
+    m_monitoredConfig->readFileAsync(this, [this, generation](std::unique_ptr<Config> readInConfig) {
+        if (readInConfig && generation == m_applyGeneration && !m_generatorReady) {
+            ++m_prefetchedLayoutApplies;
+            doApplyConfig(std::move(readInConfig));
+        }
     });
 }
 
 KScreenDaemon::~KScreenDaemon()
 {
+    // Queues the last trace write
+    EventRecorder::destroy();
+    IoWorker::self()->post([] {
+        StoreCompactor::self()->saveUsage();
+    });
+    // Finishes pending writes, must go before anything the jobs use
+    IoWorker::destroy();
+    StoreCompactor::destroy();
     Generator::destroy();
     Device::destroy();
+    LayoutIndex::destroy();
+    LayoutCache::destroy();
+    Globals::stopWatchingPaths();
+    HotplugTracer::destroy();
 }
 
 void KScreenDaemon::init()
 {
+    // Create the cache on this thread, the IoWorker only uses it
+    LayoutCache::self();
+
     const QString osdService = QStringLiteral("org.kde.kscreen.osdService");
     const QString osdPath = QStringLiteral("/org/kde/kscreen/osdService");
     m_osdServiceInterface = new OrgKdeKscreenOsdServiceInterface(osdService, osdPath, QDBusConnection::sessionBus(), this);
     // Set a longer timeout to not assume timeout while the osd is still shown
     m_osdServiceInterface->setTimeout(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::seconds(60)).count());
 
-    m_changeCompressor->setInterval(10);
-    m_changeCompressor->setSingleShot(true);
-    connect(m_changeCompressor, &QTimer::timeout, this, &KScreenDaemon::applyConfig);
+    connect(m_settleDetector, &SettleDetector::settled, this, &KScreenDaemon::applyConfig);
+    connect(m_flapDetector, &FlapDetector::released, this, &KScreenDaemon::outputReleased);
 
-    m_lidClosedTimer->setInterval(1000);
+    m_lidClosedTimer->setInterval(LidClosedDelay);
     m_lidClosedTimer->setSingleShot(true);
     connect(m_lidClosedTimer, &QTimer::timeout, this, &KScreenDaemon::disableLidOutput);
 
+    m_compactionTimer->setInterval(StoreCompactor::StartDelay);
+    connect(m_compactionTimer, &QTimer::timeout, this, [this]() {
+        m_compactionTimer->setInterval(StoreCompactor::Interval);
+        IoWorker::self()->post([] {
+            StoreCompactor::self()->compact();
+        });
+    });
+    m_compactionTimer->start();
+
     connect(Device::self(), &Device::lidClosedChanged, this, &KScreenDaemon::lidClosedChanged);
+    connect(Device::self(), &Device::lidCloseActionFetched, this, &KScreenDaemon::lidCloseActionFetched);
     connect(Device::self(), &Device::resumingFromSuspend, this, [this]() {
+        EventRecorder::self()->record(EventRecorder::Event::ResumingFromSuspend);
         KScreen::Log::instance()->setContext(QStringLiteral("resuming"));
         qCDebug(KSCREEN_KDED) << "Resumed from suspend, checking for screen changes";
         // We don't care about the result, we just want to force the backend
@@ -120,20 +200,26 @@ void KScreenDaemon::init()
         new KScreen::GetConfigOperation(KScreen::GetConfigOperation::NoEDID, this);
     });
     connect(Device::self(), &Device::aboutToSuspend, this, [this]() {
+        EventRecorder::self()->record(EventRecorder::Event::AboutToSuspend);
         qCDebug(KSCREEN_KDED) << "System is going to suspend, won't be changing config (waited for "
                               << (m_lidClosedTimer->interval() - m_lidClosedTimer->remainingTime()) << "ms)";
         m_lidClosedTimer->stop();
     });
 
     connect(Generator::self(), &Generator::ready, this, [this] {
+        // The rest of the startup happens in finishStartup() once the config is known
+        m_generatorReady = true;
         applyConfig();
+    });
 
-        if (Device::self()->isLaptop() && Device::self()->isLidClosed()) {
-            disableLidOutput();
-        }
-
-        m_startingUp = false;
+    // Unlike configChanged() this also sees the changes the daemon causes itself
+    connect(KScreen::ConfigMonitor::instance(), &KScreen::ConfigMonitor::configurationChanged, this, [this]() {
+        EventRecorder::self()->record(EventRecorder::Event::ConfigurationChanged, m_monitoredConfig->data());
     });
+    const QString tracePath = qEnvironmentVariable("KSCREEN_RECORD_TRACE");
+    if (!tracePath.isEmpty()) {
+        EventRecorder::self()->start(tracePath, m_monitoredConfig->data());
+    }
 
     Generator::self()->setCurrentConfig(m_monitoredConfig->data());
     monitorConnectedChange();
@@ -149,12 +235,37 @@ void KScreenDaemon::doApplyConfig(const KScreen::ConfigPtr &config)
 }
 
 void KScreenDaemon::doApplyConfig(std::unique_ptr<Config> config)
+{
+    if (m_monitoredConfig && config->data() != m_monitoredConfig->data()) {
+        // While a config is being set, the monitored config already is the one being set
+        const ConfigDiff diff(m_monitoredConfig->data(), config->data());
+        if (diff.isEmpty()) {
+            // Only the backend is spared, the config is taken over as if it had been set
+            qCDebug(KSCREEN_KDED) << "Config is already applied, not setting it again";
+            adoptConfig(std::move(config));
+            KScreen::ConfigMonitor::instance()->addConfig(m_monitoredConfig->data());
+            if (!m_setConfigPending) {
+                setMonitorForChanges(true);
+                updateLidTargets();
+                HotplugTracer::self()->end();
+            }
+            return;
+        }
+        qCDebug(KSCREEN_KDED) << "Applying" << diff;
+    }
+
+    adoptConfig(std::move(config));
+    refreshConfig();
+}
+
+void KScreenDaemon::adoptConfig(std::unique_ptr<Config> config)
 {
     m_monitoredConfig = std::move(config);
 
     m_monitoredConfig->activateControlWatching();
-
-    refreshConfig();
+    connect(m_monitoredConfig.get(), &Config::controlChanged, this, [this]() {
+        EventRecorder::self()->record(EventRecorder::Event::ControlChanged, m_monitoredConfig->data());
+    });
 }
 
 void KScreenDaemon::refreshConfig()
@@ -163,13 +274,19 @@ void KScreenDaemon::refreshConfig()
     m_configDirty = false;
     KScreen::ConfigMonitor::instance()->addConfig(m_monitoredConfig->data());
 
+    HotplugTracer::self()->startStage(HotplugTracer::Stage::Backend);
+    m_setConfigPending = true;
+    ++m_setConfigOperations;
     connect(new KScreen::SetConfigOperation(m_monitoredConfig->data()), &KScreen::SetConfigOperation::finished, this, [this]() {
         qCDebug(KSCREEN_KDED) << "Config applied";
+        m_setConfigPending = false;
+        HotplugTracer::self()->finishStage(HotplugTracer::Stage::Backend);
         if (m_configDirty) {
             // Config changed in the meantime again, apply.
             doApplyConfig(m_monitoredConfig->data());
         } else {
             setMonitorForChanges(true);
+            HotplugTracer::self()->end();
         }
     });
 }
@@ -177,24 +294,63 @@ void KScreenDaemon::refreshConfig()
 void KScreenDaemon::applyConfig()
 {
     qCDebug(KSCREEN_KDED) << "Applying config";
+    HotplugTracer::self()->finishStage(HotplugTracer::Stage::Settle);
+    ++m_applyGeneration;
     if (m_monitoredConfig->fileExists()) {
         applyKnownConfig();
         return;
     }
-    applyIdealConfig();
+    applyNearestConfig();
 }
 
 void KScreenDaemon::applyKnownConfig()
 {
     qCDebug(KSCREEN_KDED) << "Applying known config";
 
-    std::unique_ptr<Config> readInConfig = m_monitoredConfig->readFile();
-    if (readInConfig) {
-        doApplyConfig(std::move(readInConfig));
-    } else {
-        qCDebug(KSCREEN_KDED) << "Loading failed, falling back to the ideal config" << m_monitoredConfig->id();
-        applyIdealConfig();
+    const quint64 generation = m_applyGeneration;
+    m_monitoredConfig->readFileAsync(this, [this, generation](std::unique_ptr<Config> readInConfig) {
+        if (generation != m_applyGeneration) {
+            qCDebug(KSCREEN_KDED) << "Outputs changed while reading the config, dropping it";
+        } else if (readInConfig) {
+            doApplyConfig(std::move(readInConfig));
+        } else {
+            qCDebug(KSCREEN_KDED) << "Loading failed, falling back to the ideal config" << m_monitoredConfig->id();
+            applyIdealConfig();
+        }
+        finishStartup();
+    });
+}
+
+void KScreenDaemon::applyNearestConfig()
+{
+    // A known set of monitors on other ports, or with one more or less, keeps its arrangement
+    // rather than getting the ideal config and the OSD
+    const quint64 generation = m_applyGeneration;
+    m_monitoredConfig->readNearestFileAsync(this, [this, generation](std::unique_ptr<Config> readInConfig) {
+        if (generation != m_applyGeneration) {
+            qCDebug(KSCREEN_KDED) << "Outputs changed while looking for a similar layout, dropping it";
+        } else if (readInConfig) {
+            qCDebug(KSCREEN_KDED) << "Applying the layout of a similar topology";
+            doApplyConfig(std::move(readInConfig));
+            m_osdServiceInterface->hideOsd();
+        } else {
+            applyIdealConfig();
+        }
+        finishStartup();
+    });
+}
+
+void KScreenDaemon::finishStartup()
+{
+    if (!m_startingUp || !m_generatorReady) {
+        return;
+    }
+
+    if (Device::self()->isLaptop() && Device::self()->isLidClosed()) {
+        disableLidOutput();
     }
+
+    m_startingUp = false;
 }
 
 void KScreenDaemon::showOSD()
@@ -413,16 +569,54 @@ void KScreenDaemon::saveCurrentConfig()
     // in the "at least one enabled screen" check
 
     if (m_monitoredConfig->canBeApplied()) {
-        m_monitoredConfig->writeFile();
+        m_monitoredConfig->writeFileAsync();
         m_monitoredConfig->log();
+        updateLidTargets();
     } else {
         qCWarning(KSCREEN_KDED) << "Config does not have at least one screen enabled, WILL NOT save this config, this is not what user wants.";
         m_monitoredConfig->log();
     }
 }
 
+void KScreenDaemon::updateLidTargets()
+{
+    if (!Device::self()->isLaptop() || Device::self()->isLidClosed()) {
+        // The current layout is no open-lid layout, keep the one from before the lid was closed
+        return;
+    }
+
+    const KScreen::ConfigPtr current = m_monitoredConfig->data();
+    KScreen::ConfigPtr closed;
+    if (current->connectedOutputs().count() > 1) {
+        const KScreen::OutputList outputs = current->outputs();
+        for (const KScreen::OutputPtr &output : outputs) {
+            if (output->type() == KScreen::Output::Panel && output->isConnected() && output->isEnabled()) {
+                closed = current->clone();
+                disableOutput(closed, closed->output(output->id()));
+                break;
+            }
+        }
+    }
+    if (closed && !KScreen::Config::canBeApplied(closed, KScreen::Config::ValidityFlag::RequireAtLeastOneEnabledScreen)) {
+        qCDebug(KSCREEN_KDED) << "Turning off the panel would leave an invalid config";
+        closed.reset();
+    }
+
+    // Only kept in memory, the open-lid layout is written when the lid actually closes
+    m_lidOpenedTarget = current->clone();
+    m_lidClosedTarget = closed;
+    m_lidTargetsId = m_monitoredConfig->id();
+}
+
+bool KScreenDaemon::lidTargetsApply(const KScreen::ConfigPtr &from) const
+{
+    return from && m_lidClosedTarget && m_lidTargetsId == m_monitoredConfig->id() && ConfigDiff(from, m_monitoredConfig->data()).isEmpty();
+}
+
 void KScreenDaemon::lidClosedChanged(bool lidIsClosed)
 {
+    EventRecorder::self()->record(lidIsClosed ? EventRecorder::Event::LidClosed : EventRecorder::Event::LidOpened);
+
     // Ignore this when we don't have any external monitors, we can't turn off our
     // only screen
     if (m_monitoredConfig->data()->connectedOutputs().count() == 1) {
@@ -430,20 +624,53 @@ void KScreenDaemon::lidClosedChanged(bool lidIsClosed)
     }
 
     if (lidIsClosed) {
-        // Lid is closed, now we wait for couple seconds to find out whether it
-        // will trigger a suspend (see Device::aboutToSuspend), or whether we should
-        // turn off the screen
+        // Lid is closed, ask what it is going to do. If nobody tells us, we wait
+        // for a second to find out whether it will trigger a suspend (see
+        // Device::aboutToSuspend), or whether we should turn off the screen
         qCDebug(KSCREEN_KDED) << "Lid closed, waiting to see if the computer goes to sleep...";
-        m_lidClosedTimer->start();
+        m_lidClosedTimer->start(LidClosedDelay);
+        Device::self()->fetchLidCloseAction();
         return;
     } else {
         qCDebug(KSCREEN_KDED) << "Lid opened!";
+        if (lidTargetsApply(m_lidClosedTarget)) {
+            // Nothing changed while the lid was closed
+            qCDebug(KSCREEN_KDED) << "Restoring the layout from before the lid was closed";
+            m_monitoredConfig->removeOpenLidFileAsync();
+            doApplyConfig(m_lidOpenedTarget->clone());
+            return;
+        }
         // We should have a config with "_lidOpened" suffix lying around. If not,
         // then the configuration has changed while the lid was closed and we just
         // use applyConfig() and see what we can do ...
-        if (auto openCfg = m_monitoredConfig->readOpenLidFile()) {
-            doApplyConfig(std::move(openCfg));
-        }
+        const quint64 generation = m_applyGeneration;
+        m_monitoredConfig->readOpenLidFileAsync(this, [this, generation](std::unique_ptr<Config> openCfg) {
+            if (openCfg && generation == m_applyGeneration) {
+                doApplyConfig(std::move(openCfg));
+            }
+        });
+    }
+}
+
+void KScreenDaemon::lidCloseActionFetched(Device::LidCloseAction action)
+{
+    if (!m_lidClosedTimer->isActive()) {
+        // Too late, or the lid was opened again
+        return;
+    }
+
+    switch (action) {
+    case Device::LidCloseAction::Suspend:
+        // Device::aboutToSuspend stops the timer. Something may still inhibit the suspend, in
+        // which case the panel is turned off once the timer runs out after all.
+        qCDebug(KSCREEN_KDED) << "Lid closed, the computer is going to sleep";
+        break;
+    case Device::LidCloseAction::KeepRunning:
+        m_lidClosedTimer->stop();
+        disableLidOutput();
+        break;
+    case Device::LidCloseAction::Unknown:
+        break;
     }
 }
 
@@ -454,12 +681,16 @@ void KScreenDaemon::disableLidOutput()
         return;
     }
 
-    // If we are here, it means that closing the lid did not result in suspend
-    // action.
-    // FIXME: This could be because the suspend took longer than m_lidClosedTimer
-    // timeout. Ideally we need to be able to look into PowerDevil config to see
-    // what's the configured action for lid events, but there's no API to do that
-    // and I'm not parsing PowerDevil's configs...
+    // If we are here, closing the lid does not suspend, or neither PowerDevil
+    // nor logind could tell us and no suspend came within m_lidClosedTimer.
+
+    if (lidTargetsApply(m_lidOpenedTarget)) {
+        qCDebug(KSCREEN_KDED) << "Lid closed, applying the precomputed layout";
+        // Just like below, so that the layout can be restored after a restart with the lid closed
+        m_monitoredConfig->writeOpenLidFileAsync();
+        doApplyConfig(m_lidClosedTarget->clone());
+        return;
+    }
 
     qCDebug(KSCREEN_KDED) << "Lid closed, finding lid to disable";
     for (KScreen::OutputPtr &output : m_monitoredConfig->data()->outputs()) {
@@ -467,8 +698,8 @@ void KScreenDaemon::disableLidOutput()
             if (output->isConnected() && output->isEnabled()) {
                 // Save the current config with opened lid, just so that we know
                 // how to restore it later
-                m_monitoredConfig->writeOpenLidFile();
-                disableOutput(output);
+                m_monitoredConfig->writeOpenLidFileAsync();
+                disableOutput(m_monitoredConfig->data(), output);
                 refreshConfig();
                 return;
             }
@@ -478,18 +709,36 @@ void KScreenDaemon::disableLidOutput()
 
 void KScreenDaemon::outputConnectedChanged()
 {
-    if (!m_changeCompressor->isActive()) {
-        m_changeCompressor->start();
-    }
-
     KScreen::Output *output = qobject_cast<KScreen::Output *>(sender());
     qCDebug(KSCREEN_KDED) << "outputConnectedChanged():" << output->name();
+    EventRecorder::self()->record(output->isConnected() ? EventRecorder::Event::OutputConnected : EventRecorder::Event::OutputDisconnected, output->id());
+    if (!m_flapDetector->addToggle(output->name())) {
+        return;
+    }
+
+    HotplugTracer::self()->begin();
+    m_settleDetector->addChange(output->hashMd5());
+}
+
+void KScreenDaemon::outputReleased(const QString &connector)
+{
+    // Apply whatever state the output ended up in while it was ignored
+    const KScreen::OutputList outputs = m_monitoredConfig->data()->outputs();
+    for (const KScreen::OutputPtr &output : outputs) {
+        if (output->name() == connector) {
+            HotplugTracer::self()->begin();
+            m_settleDetector->addChange(output->hashMd5());
+            return;
+        }
+    }
 }
 
 void KScreenDaemon::outputAddedSlot(const KScreen::OutputPtr &output)
 {
-    if (output->isConnected()) {
-        m_changeCompressor->start();
+    EventRecorder::self()->record(EventRecorder::Event::OutputAdded, output->id());
+    if (output->isConnected() && m_flapDetector->addToggle(output->name())) {
+        HotplugTracer::self()->begin();
+        m_settleDetector->addChange(output->hashMd5());
     }
     connect(output.data(), &KScreen::Output::isConnectedChanged, this, &KScreenDaemon::outputConnectedChanged, Qt::UniqueConnection);
 }
@@ -523,13 +772,13 @@ void KScreenDaemon::setMonitorForChanges(bool enabled)
     }
 }
 
-void KScreenDaemon::disableOutput(const KScreen::OutputPtr &output)
+void KScreenDaemon::disableOutput(const KScreen::ConfigPtr &config, const KScreen::OutputPtr &output)
 {
     const QRect geom = output->geometry();
     qCDebug(KSCREEN_KDED) << "Laptop geometry:" << geom << output->pos() << (output->currentMode() ? output->currentMode()->size() : QSize());
 
     // Move all outputs right from the @p output to left
-    for (KScreen::OutputPtr &otherOutput : m_monitoredConfig->data()->outputs()) {
+    for (KScreen::OutputPtr &otherOutput : config->outputs()) {
         if (otherOutput == output || !otherOutput->isConnected() || !otherOutput->isEnabled()) {
             continue;
         }
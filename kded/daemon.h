@@ -8,6 +8,7 @@
 
 #include "../common/globals.h"
 #include "../common/osdaction.h"
+#include "device.h"
 #include "config-X11.h"
 
 #include <kscreen/config.h>
@@ -19,7 +20,9 @@
 #include <memory>
 
 class Config;
+class FlapDetector;
 class OrgKdeKscreenOsdServiceInterface;
+class SettleDetector;
 
 namespace KScreen
 {
@@ -40,39 +43,72 @@ public:
 private:
     Q_INVOKABLE void getInitialConfig();
     void init();
+    void applyPrefetchedLayout();
 
     void applyConfig();
     void applyKnownConfig();
+    void applyNearestConfig();
     void applyIdealConfig();
+    void finishStartup();
     void configChanged();
     void saveCurrentConfig();
 #if WITH_X11
     void alignX11TouchScreen();
 #endif
     void lidClosedChanged(bool lidIsClosed);
+    void updateLidTargets();
+    // Whether the lid targets belong to the current config, which still has to look like @p from
+    bool lidTargetsApply(const KScreen::ConfigPtr &from) const;
+    void lidCloseActionFetched(Device::LidCloseAction action);
     void disableLidOutput();
     void setMonitorForChanges(bool enabled);
 
     void outputConnectedChanged();
+    void outputReleased(const QString &connector);
     void showOSD();
 
     void doApplyConfig(const KScreen::ConfigPtr &config);
     void doApplyConfig(std::unique_ptr<Config> config);
+    // Makes @p config the monitored one, without setting it
+    void adoptConfig(std::unique_ptr<Config> config);
     void refreshConfig();
 
     void monitorConnectedChange();
-    void disableOutput(const KScreen::OutputPtr &output);
+    void disableOutput(const KScreen::ConfigPtr &config, const KScreen::OutputPtr &output);
 
     std::unique_ptr<Config> m_monitoredConfig;
     bool m_monitoring;
     bool m_configDirty = true;
-    QTimer *const m_changeCompressor;
+    bool m_setConfigPending = false;
+    // How often the backend was asked to set a config
+    quint64 m_setConfigOperations = 0;
+    SettleDetector *const m_settleDetector;
+    FlapDetector *const m_flapDetector;
     QTimer *m_saveTimer = nullptr;
+    // How long to wait for a suspend after the lid was closed
+    static constexpr int LidClosedDelay = 1000;
     QTimer *const m_lidClosedTimer;
+    // Runs the StoreCompactor in the background
+    QTimer *const m_compactionTimer;
     OrgKdeKscreenOsdServiceInterface *m_osdServiceInterface = nullptr;
 
+    // What to switch to when the lid is closed or opened, computed whenever the layout settles
+    KScreen::ConfigPtr m_lidClosedTarget;
+    KScreen::ConfigPtr m_lidOpenedTarget;
+    QString m_lidTargetsId;
+
     bool m_startingUp = true;
+    bool m_generatorReady = false;
+    // The layout Config::prefetchLastLayout() put into the LayoutCache, until it is applied
+    QString m_prefetchedLayoutId;
+    quint64 m_prefetchedLayoutApplies = 0;
+    // Bumped whenever a new config is about to be applied, so that reads finishing late are dropped
+    quint64 m_applyGeneration = 0;
 
 private Q_SLOTS:
     void outputAddedSlot(const KScreen::OutputPtr &output);
+
+    friend class DiagnosticsAdaptor;
+    friend class TestDaemon;
+    friend class TraceReplay;
 };
@@ -9,6 +9,70 @@
 #include "freedesktop_interface.h"
 #include "kscreen_daemon_debug.h"
 
+#include <memory>
+#include <optional>
+
+// PowerDevil's PowerButtonAction values that end the session
+static constexpr int s_suspendToRam = 1;
+static constexpr int s_suspendToDisk = 2;
+static constexpr int s_suspendHybrid = 4;
+static constexpr int s_shutdown = 8;
+
+// Don't keep the lid close waiting for long, the daemon falls back to waiting for a suspend
+static constexpr int s_lidPolicyTimeout = 500;
+
+namespace
+{
+struct LidPolicy {
+    int pending = 3;
+    std::optional<int> lidAction;
+    std::optional<bool> triggersLidAction;
+    std::optional<QVariantMap> logind;
+};
+}
+
+static Device::LidCloseAction lidCloseAction(const LidPolicy &policy)
+{
+    const QStringList blocked = policy.logind ? policy.logind->value(QStringLiteral("BlockInhibited")).toString().split(QLatin1Char(':')) : QStringList();
+
+    if (policy.lidAction && policy.triggersLidAction) {
+        // PowerDevil inhibits logind's lid handling and does it itself
+        if (!*policy.triggersLidAction) {
+            // E.g. because an external screen is connected
+            return Device::LidCloseAction::KeepRunning;
+        }
+        switch (*policy.lidAction) {
+        case s_suspendToRam:
+        case s_suspendToDisk:
+        case s_suspendHybrid:
+            return blocked.contains(QLatin1String("sleep")) ? Device::LidCloseAction::KeepRunning : Device::LidCloseAction::Suspend;
+        case s_shutdown:
+            return blocked.contains(QLatin1String("shutdown")) ? Device::LidCloseAction::KeepRunning : Device::LidCloseAction::Suspend;
+        default:
+            return Device::LidCloseAction::KeepRunning;
+        }
+    }
+
+    if (!policy.logind || blocked.contains(QLatin1String("handle-lid-switch"))) {
+        // Somebody we don't know handles the lid
+        return Device::LidCloseAction::Unknown;
+    }
+    QString handle = policy.logind->value(QStringLiteral("HandleLidSwitch")).toString();
+    if (policy.logind->value(QStringLiteral("Docked")).toBool()) {
+        handle = policy.logind->value(QStringLiteral("HandleLidSwitchDocked")).toString();
+    } else if (policy.logind->value(QStringLiteral("OnExternalPower")).toBool() && policy.logind->contains(QStringLiteral("HandleLidSwitchExternalPower"))) {
+        handle = policy.logind->value(QStringLiteral("HandleLidSwitchExternalPower")).toString();
+    }
+    if (handle == QLatin1String("poweroff") || handle == QLatin1String("halt")) {
+        return blocked.contains(QLatin1String("shutdown")) ? Device::LidCloseAction::KeepRunning : Device::LidCloseAction::Suspend;
+    }
+    if (handle == QLatin1String("suspend") || handle == QLatin1String("hibernate") || handle == QLatin1String("hybrid-sleep")
+        || handle == QLatin1String("suspend-then-hibernate")) {
+        return blocked.contains(QLatin1String("sleep")) ? Device::LidCloseAction::KeepRunning : Device::LidCloseAction::Suspend;
+    }
+    return Device::LidCloseAction::KeepRunning;
+}
+
 Device *Device::m_instance = nullptr;
 
 Device *Device::self()
@@ -29,8 +93,6 @@ void Device::destroy()
 Device::Device(QObject *parent)
     : QObject(parent)
     , m_isReady(false)
-    , m_isLaptop(false)
-    , m_isLidClosed(false)
 {
     m_freedesktop = new OrgFreedesktopDBusPropertiesInterface(QStringLiteral("org.freedesktop.UPower"),
                                                               QStringLiteral("/org/freedesktop/UPower"),
@@ -44,9 +106,11 @@ Device::Device(QObject *parent)
                                              QStringLiteral("/org/freedesktop/UPower"),
                                              QStringLiteral("org.freedesktop.DBus.Properties"),
                                              QStringLiteral("PropertiesChanged"),
+                                             // Let the bus drop the changes of other interfaces
+                                             {QStringLiteral("org.freedesktop.UPower")},
+                                             QString(),
                                              this,
-                                             SLOT(changed()));
-        fetchIsLaptop();
+                                             SLOT(changed(QString, QVariantMap, QStringList)));
     }
 
     m_suspendSession = new QDBusInterface(QStringLiteral("org.kde.Solid.PowerManagement"),
@@ -62,20 +126,34 @@ Device::Device(QObject *parent)
         qCDebug(KSCREEN_KDED) << m_suspendSession->lastError().message();
     }
 
-    fetchIsLaptop();
+    fetchProperties();
+
+    m_login1 = new OrgFreedesktopDBusPropertiesInterface(QStringLiteral("org.freedesktop.login1"),
+                                                         QStringLiteral("/org/freedesktop/login1"),
+                                                         QDBusConnection::systemBus(),
+                                                         this);
+    m_login1->setTimeout(s_lidPolicyTimeout);
 }
 
 Device::~Device()
 {
 }
 
-void Device::changed()
+void Device::changed(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidatedProperties)
 {
-    fetchLidIsClosed();
+    if (interface != QLatin1String("org.freedesktop.UPower")) {
+        return;
+    }
+    if (!invalidatedProperties.isEmpty()) {
+        // The values didn't come along, UPower doesn't do this but it's allowed to
+        fetchProperties();
+    }
+    updateProperties(changedProperties);
 }
 
 void Device::setReady()
 {
+    // Properties are fetched again when invalidated, only the first fetch makes the device ready
     if (m_isReady) {
         return;
     }
@@ -91,65 +169,120 @@ bool Device::isReady() const
 
 bool Device::isLaptop() const
 {
-    return m_isLaptop;
+    return m_upower.lidIsPresent;
 }
 
 bool Device::isLidClosed() const
 {
-    return m_isLidClosed;
+    return m_upower.lidIsClosed;
+}
+
+bool Device::isOnBattery() const
+{
+    return m_upower.onBattery;
 }
 
-void Device::fetchIsLaptop()
+void Device::fetchProperties()
 {
-    QDBusPendingReply<QVariant> res = m_freedesktop->Get(QStringLiteral("org.freedesktop.UPower"), QStringLiteral("LidIsPresent"));
+    QDBusPendingReply<QVariantMap> res = m_freedesktop->GetAll(QStringLiteral("org.freedesktop.UPower"));
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(res);
-    connect(watcher, &QDBusPendingCallWatcher::finished, this, &Device::isLaptopFetched);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, &Device::propertiesFetched);
 }
 
-void Device::isLaptopFetched(QDBusPendingCallWatcher *watcher)
+void Device::propertiesFetched(QDBusPendingCallWatcher *watcher)
 {
-    const QDBusPendingReply<QVariant> reply = *watcher;
+    const QDBusPendingReply<QVariantMap> reply = *watcher;
+    watcher->deleteLater();
     if (reply.isError()) {
-        qCDebug(KSCREEN_KDED) << "Couldn't get if the device is a laptop: " << reply.error().message();
+        qCDebug(KSCREEN_KDED) << "Couldn't get the UPower properties: " << reply.error().message();
         setReady();
         return;
     }
 
-    m_isLaptop = reply.value().toBool();
-    watcher->deleteLater();
+    updateProperties(reply.value());
+    setReady();
+}
 
-    if (!m_isLaptop) {
-        setReady();
-        return;
+void Device::updateProperties(const QVariantMap &properties)
+{
+    // Most of the changes are about the battery, which is none of our business
+    UPowerProperties upower = m_upower;
+    for (auto it = properties.cbegin(); it != properties.cend(); ++it) {
+        if (it.key() == QLatin1String("LidIsPresent")) {
+            upower.lidIsPresent = it->toBool();
+        } else if (it.key() == QLatin1String("LidIsClosed")) {
+            upower.lidIsClosed = it->toBool();
+        } else if (it.key() == QLatin1String("OnBattery")) {
+            upower.onBattery = it->toBool();
+        }
+    }
+    if (!upower.lidIsPresent) {
+        upower.lidIsClosed = false;
     }
 
-    fetchLidIsClosed();
+    const UPowerProperties old = m_upower;
+    m_upower = upower;
+    if (!m_isReady) {
+        return;
+    }
+    if (old.lidIsClosed != upower.lidIsClosed) {
+        Q_EMIT lidClosedChanged(upower.lidIsClosed);
+    }
+    if (old.onBattery != upower.onBattery) {
+        Q_EMIT onBatteryChanged(upower.onBattery);
+    }
 }
 
-void Device::fetchLidIsClosed()
+void Device::fetchLidCloseAction()
 {
-    QDBusPendingReply<QVariant> res = m_freedesktop->Get(QStringLiteral("org.freedesktop.UPower"), QStringLiteral("LidIsClosed"));
-    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(res);
-    connect(watcher, &QDBusPendingCallWatcher::finished, this, &Device::isLidClosedFetched);
-}
+    auto policy = std::make_shared<LidPolicy>();
+    const auto finished = [this, policy]() {
+        if (--policy->pending == 0) {
+            const LidCloseAction action = lidCloseAction(*policy);
+            qCDebug(KSCREEN_KDED) << "Closing the lid results in" << action;
+            Q_EMIT lidCloseActionFetched(action);
+        }
+    };
 
-void Device::isLidClosedFetched(QDBusPendingCallWatcher *watcher)
-{
-    const QDBusPendingReply<QVariant> reply = *watcher;
-    if (reply.isError()) {
-        qCDebug(KSCREEN_KDED) << "Couldn't get if the laptop has the lid closed: " << reply.error().message();
-        return;
-    }
+    const auto callHandleButtonEvents = [this](const QString &method) {
+        const QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.kde.Solid.PowerManagement"),
+                                                                    QStringLiteral("/org/kde/Solid/PowerManagement/Actions/HandleButtonEvents"),
+                                                                    QStringLiteral("org.kde.Solid.PowerManagement.Actions.HandleButtonEvents"),
+                                                                    method);
+        return new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message, s_lidPolicyTimeout), this);
+    };
 
-    if (reply.argumentAt<0>() != m_isLidClosed) {
-        m_isLidClosed = reply.value().toBool();
-        if (m_isReady) {
-            Q_EMIT lidClosedChanged(m_isLidClosed);
+    connect(callHandleButtonEvents(QStringLiteral("lidAction")), &QDBusPendingCallWatcher::finished, this, [policy, finished](QDBusPendingCallWatcher *watcher) {
+        const QDBusPendingReply<int> reply = *watcher;
+        if (!reply.isError()) {
+            policy->lidAction = reply.value();
         }
-    }
-    watcher->deleteLater();
+        watcher->deleteLater();
+        finished();
+    });
+    connect(callHandleButtonEvents(QStringLiteral("triggersLidAction")),
+            &QDBusPendingCallWatcher::finished,
+            this,
+            [policy, finished](QDBusPendingCallWatcher *watcher) {
+                const QDBusPendingReply<bool> reply = *watcher;
+                if (!reply.isError()) {
+                    policy->triggersLidAction = reply.value();
+                }
+                watcher->deleteLater();
+                finished();
+            });
 
-    setReady();
+    auto *logind = new QDBusPendingCallWatcher(m_login1->GetAll(QStringLiteral("org.freedesktop.login1.Manager")), this);
+    connect(logind, &QDBusPendingCallWatcher::finished, this, [policy, finished](QDBusPendingCallWatcher *watcher) {
+        const QDBusPendingReply<QVariantMap> reply = *watcher;
+        if (!reply.isError()) {
+            policy->logind = reply.value();
+        } else {
+            qCDebug(KSCREEN_KDED) << "Couldn't get the logind lid policy:" << reply.error().message();
+        }
+        watcher->deleteLater();
+        finished();
+    });
 }
 
 #include "moc_device.cpp"
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <QObject>
+#include <QVariantMap>
 
 class QDBusPendingCallWatcher;
 class QDBusInterface;
@@ -16,38 +17,65 @@ class Device : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * What closing the lid does to the session.
+     */
+    enum class LidCloseAction {
+        Unknown,
+        Suspend, ///< Suspends, hibernates or shuts down
+        KeepRunning,
+    };
+    Q_ENUM(LidCloseAction)
+
     static Device *self();
     static void destroy();
 
     bool isReady() const;
     bool isLaptop() const;
     bool isLidClosed() const;
+    bool isOnBattery() const;
+
+    /**
+     * Asks PowerDevil, or logind if PowerDevil isn't running, what closing the lid is going to
+     * do, taking inhibitors into account. The answer is emitted as lidCloseActionFetched().
+     */
+    void fetchLidCloseAction();
 
 private Q_SLOTS:
-    void changed();
-    void isLaptopFetched(QDBusPendingCallWatcher *watcher);
-    void isLidClosedFetched(QDBusPendingCallWatcher *watcher);
+    void changed(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidatedProperties);
+    void propertiesFetched(QDBusPendingCallWatcher *watcher);
 
 Q_SIGNALS:
     void ready();
     void lidClosedChanged(bool closed);
+    void onBatteryChanged(bool onBattery);
     void resumingFromSuspend();
     void aboutToSuspend();
+    void lidCloseActionFetched(Device::LidCloseAction action);
 
 private:
     explicit Device(QObject *parent = nullptr);
     ~Device() override;
 
+    /**
+     * The UPower properties we care about, as last reported.
+     */
+    struct UPowerProperties {
+        bool lidIsPresent = false;
+        bool lidIsClosed = false;
+        bool onBattery = false;
+    };
+
     void setReady();
-    void fetchIsLaptop();
-    void fetchLidIsClosed();
+    void fetchProperties();
+    void updateProperties(const QVariantMap &properties);
 
     bool m_isReady;
-    bool m_isLaptop;
-    bool m_isLidClosed;
+    UPowerProperties m_upower;
 
     static Device *m_instance;
 
     OrgFreedesktopDBusPropertiesInterface *m_freedesktop = nullptr;
+    OrgFreedesktopDBusPropertiesInterface *m_login1 = nullptr;
     QDBusInterface *m_suspendSession = nullptr;
 };
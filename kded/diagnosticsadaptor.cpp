@@ -0,0 +1,131 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "diagnosticsadaptor.h"
+
+#include "../common/globals.h"
+#include "../common/storage.h"
+#include "config.h"
+#include "daemon.h"
+#include "eventrecorder.h"
+#include "flapdetector.h"
+#include "ioworker.h"
+#include "kscreen_daemon_debug.h"
+#include "settledetector.h"
+#include "storecompactor.h"
+#include "tracer.h"
+
+#include <QStringBuilder>
+
+DiagnosticsAdaptor::DiagnosticsAdaptor(KScreenDaemon *daemon)
+    : QDBusAbstractAdaptor(daemon)
+    , m_daemon(daemon)
+{
+}
+
+QVariantMap DiagnosticsAdaptor::stageHistograms() const
+{
+    QVariantMap histograms;
+    for (int i = 0; i < HotplugTracer::StageCount; ++i) {
+        const auto stage = static_cast<HotplugTracer::Stage>(i);
+        const HotplugTracer::Histogram histogram = HotplugTracer::self()->histogram(stage);
+
+        QVariantMap entry;
+        entry[QStringLiteral("count")] = histogram.count;
+        entry[QStringLiteral("totalUs")] = histogram.totalUs;
+        entry[QStringLiteral("maxUs")] = histogram.maxUs;
+        entry[QStringLiteral("buckets")] = QVariant::fromValue(QList<uint>(histogram.buckets.cbegin(), histogram.buckets.cend()));
+        histograms[HotplugTracer::stageName(stage)] = entry;
+    }
+    return histograms;
+}
+
+qulonglong DiagnosticsAdaptor::lastTransactionId() const
+{
+    return HotplugTracer::self()->lastTransactionId();
+}
+
+QVariantMap DiagnosticsAdaptor::writeStatistics() const
+{
+    const Storage::WriteStatistics statistics = Storage::writeStatistics();
+    return {
+        {QStringLiteral("performed"), statistics.performed},
+        {QStringLiteral("skipped"), statistics.skipped},
+    };
+}
+
+QVariantMap DiagnosticsAdaptor::settleStatistics() const
+{
+    return {
+        {QStringLiteral("settled"), m_daemon->m_settleDetector->settledCount()},
+        {QStringLiteral("avoided"), m_daemon->m_settleDetector->avoidedApplies()},
+        {QStringLiteral("docks"), m_daemon->m_settleDetector->dockCount()},
+    };
+}
+
+QVariantMap DiagnosticsAdaptor::flapStatistics() const
+{
+    return {
+        {QStringLiteral("toggles"), m_daemon->m_flapDetector->toggleCount()},
+        {QStringLiteral("suppressed"), m_daemon->m_flapDetector->suppressedCount()},
+        {QStringLiteral("quarantine"), m_daemon->m_flapDetector->quarantineCount()},
+        {QStringLiteral("quarantined"), m_daemon->m_flapDetector->quarantined()},
+    };
+}
+
+QVariantMap DiagnosticsAdaptor::storeStatistics() const
+{
+    const StoreCompactor::Statistics statistics = StoreCompactor::self()->statistics();
+    return {
+        {QStringLiteral("layouts"), statistics.layouts},
+        {QStringLiteral("outputs"), statistics.outputs},
+        {QStringLiteral("bytes"), statistics.bytes},
+        {QStringLiteral("evicted"), statistics.evicted},
+        {QStringLiteral("merged"), statistics.merged},
+        {QStringLiteral("reclaimed"), statistics.reclaimed},
+        {QStringLiteral("lastRun"), statistics.lastRun},
+    };
+}
+
+void DiagnosticsAdaptor::compactStore()
+{
+    IoWorker::self()->post([] {
+        StoreCompactor::self()->compact();
+    });
+}
+
+void DiagnosticsAdaptor::resetStatistics()
+{
+    HotplugTracer::self()->reset();
+    Storage::resetWriteStatistics();
+    m_daemon->m_settleDetector->resetStatistics();
+    m_daemon->m_flapDetector->resetStatistics();
+}
+
+bool DiagnosticsAdaptor::startRecording(const QString &fileName)
+{
+    if (!m_daemon->m_monitoredConfig) {
+        // Not initialized yet
+        return false;
+    }
+    // Anybody on the session bus may ask, which must not get the daemon to write anywhere else
+    if (fileName.isEmpty() || fileName.startsWith(QLatin1Char('.')) || fileName.contains(QLatin1Char('/')) || fileName.contains(QChar())) {
+        qCWarning(KSCREEN_KDED) << "Not recording to" << fileName << "which is not a plain file name";
+        return false;
+    }
+    const QString dirPath = EventRecorder::tracesDirPath();
+    if (!Globals::mkpath(dirPath)) {
+        qCWarning(KSCREEN_KDED) << "Could not create" << dirPath;
+        return false;
+    }
+    return EventRecorder::self()->start(dirPath % fileName, m_daemon->m_monitoredConfig->data());
+}
+
+void DiagnosticsAdaptor::stopRecording()
+{
+    EventRecorder::self()->stop();
+}
+
+#include "moc_diagnosticsadaptor.cpp"
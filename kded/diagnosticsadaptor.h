@@ -0,0 +1,70 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QDBusAbstractAdaptor>
+#include <QVariantMap>
+
+class KScreenDaemon;
+
+/**
+ * Exposes the daemon's runtime statistics on the kded module object, next to org.kde.KScreen.
+ */
+class DiagnosticsAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.KScreen.Diagnostics")
+
+public:
+    explicit DiagnosticsAdaptor(KScreenDaemon *daemon);
+
+public Q_SLOTS:
+    /**
+     * @returns for every hotplug stage a map with the keys "count", "totalUs", "maxUs"
+     * and "buckets", the latter holding the number of samples below 2^i milliseconds
+     */
+    QVariantMap stageHistograms() const;
+    qulonglong lastTransactionId() const;
+    /**
+     * @returns the number of file writes "performed" and of writes "skipped" because the
+     * file already had the content to be written
+     */
+    QVariantMap writeStatistics() const;
+    /**
+     * @returns how often outputs "settled" and the config was applied, how many applies
+     * waiting for the rest of a dock "avoided", and the number of "docks" learned
+     */
+    QVariantMap settleStatistics() const;
+    /**
+     * @returns the number of connection "toggles" seen, how many of them were "suppressed"
+     * because the output was flapping, how often outputs were put into "quarantine" and the
+     * names of the outputs "quarantined" right now
+     */
+    QVariantMap flapStatistics() const;
+    /**
+     * @returns the number of "layouts" and of monitors with global data ("outputs") kept and
+     * the "bytes" they take as of the last compaction, the layouts and monitors "evicted",
+     * the connector-specific files "merged" and the bytes "reclaimed" by all compactions, and
+     * when the last one ran as "lastRun"
+     */
+    QVariantMap storeStatistics() const;
+    /**
+     * Compacts the stored layouts now rather than waiting for the daily run, see StoreCompactor
+     */
+    void compactStore();
+    void resetStatistics();
+
+    /**
+     * Records the events the daemon sees into the trace file @p fileName in
+     * EventRecorder::tracesDirPath(), see EventRecorder.
+     * @returns false if @p fileName is not a plain file name, e.g. a path or one starting with a dot
+     */
+    bool startRecording(const QString &fileName);
+    void stopRecording();
+
+private:
+    KScreenDaemon *const m_daemon;
+};
@@ -0,0 +1,167 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "eventrecorder.h"
+#include "../common/globals.h"
+#include "ioworker.h"
+#include "kscreen_daemon_debug.h"
+
+#include <kscreen/config.h>
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QStringBuilder>
+
+#include <array>
+#include <utility>
+
+namespace KScreen
+{
+namespace ConfigSerializer
+{
+// Exported private symbols in configserializer_p.h in KScreen
+extern QJsonObject serializeConfig(const KScreen::ConfigPtr &config);
+extern KScreen::ConfigPtr deserializeConfig(const QVariantMap &map);
+}
+}
+
+static const std::array<std::pair<EventRecorder::Event, const char *>, 10> s_eventNames = {{
+    {EventRecorder::Event::Start, "start"},
+    {EventRecorder::Event::ConfigurationChanged, "configurationChanged"},
+    {EventRecorder::Event::OutputAdded, "outputAdded"},
+    {EventRecorder::Event::OutputConnected, "outputConnected"},
+    {EventRecorder::Event::OutputDisconnected, "outputDisconnected"},
+    {EventRecorder::Event::LidClosed, "lidClosed"},
+    {EventRecorder::Event::LidOpened, "lidOpened"},
+    {EventRecorder::Event::AboutToSuspend, "aboutToSuspend"},
+    {EventRecorder::Event::ResumingFromSuspend, "resumingFromSuspend"},
+    {EventRecorder::Event::ControlChanged, "controlChanged"},
+}};
+
+EventRecorder *EventRecorder::s_instance = nullptr;
+
+EventRecorder *EventRecorder::self()
+{
+    if (!s_instance) {
+        s_instance = new EventRecorder();
+    }
+    return s_instance;
+}
+
+void EventRecorder::destroy()
+{
+    delete s_instance;
+    s_instance = nullptr;
+}
+
+EventRecorder::EventRecorder()
+{
+}
+
+EventRecorder::~EventRecorder()
+{
+    stop();
+}
+
+QString EventRecorder::eventName(Event event)
+{
+    for (const auto &[value, name] : s_eventNames) {
+        if (value == event) {
+            return QString::fromLatin1(name);
+        }
+    }
+    Q_UNREACHABLE();
+}
+
+std::optional<EventRecorder::Event> EventRecorder::eventFromName(const QString &name)
+{
+    for (const auto &[value, eventName] : s_eventNames) {
+        if (name == QLatin1String(eventName)) {
+            return value;
+        }
+    }
+    return std::nullopt;
+}
+
+QJsonObject EventRecorder::serializeConfig(const KScreen::ConfigPtr &config)
+{
+    return KScreen::ConfigSerializer::serializeConfig(config);
+}
+
+KScreen::ConfigPtr EventRecorder::deserializeConfig(const QJsonObject &object)
+{
+    return KScreen::ConfigSerializer::deserializeConfig(object.toVariantMap());
+}
+
+QString EventRecorder::tracesDirPath()
+{
+    return Globals::dirPath() % QStringLiteral("traces/");
+}
+
+bool EventRecorder::start(const QString &path, const KScreen::ConfigPtr &config)
+{
+    stop();
+
+    auto file = std::make_shared<QFile>(path);
+    // Opened here to report failures right away, writes happen on the worker
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(KSCREEN_KDED) << "Could not open trace file" << path << file->errorString();
+        return false;
+    }
+    qCDebug(KSCREEN_KDED) << "Recording events to" << path;
+    m_file = file;
+    m_clock.start();
+    write({{QStringLiteral("version"), Version}, {QStringLiteral("config"), serializeConfig(config)}}, Event::Start);
+    return true;
+}
+
+void EventRecorder::stop()
+{
+    if (!m_file) {
+        return;
+    }
+    IoWorker::self()->post([file = std::move(m_file)]() {
+        file->close();
+    });
+    m_file.reset();
+}
+
+bool EventRecorder::isRecording() const
+{
+    return m_file != nullptr;
+}
+
+void EventRecorder::record(Event event, const KScreen::ConfigPtr &config)
+{
+    if (!isRecording()) {
+        return;
+    }
+    QJsonObject object;
+    if (config) {
+        object[QStringLiteral("config")] = serializeConfig(config);
+    }
+    write(object, event);
+}
+
+void EventRecorder::record(Event event, int outputId)
+{
+    if (!isRecording()) {
+        return;
+    }
+    write({{QStringLiteral("outputId"), outputId}}, event);
+}
+
+void EventRecorder::write(QJsonObject object, Event event)
+{
+    object[QStringLiteral("event")] = eventName(event);
+    object[QStringLiteral("timeUs")] = m_clock.nsecsElapsed() / 1000;
+
+    const QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+    IoWorker::self()->post([file = m_file, line]() {
+        if (file->write(line) != line.size() || !file->flush()) {
+            qCWarning(KSCREEN_KDED) << "Could not write to trace file" << file->fileName() << file->errorString();
+        }
+    });
+}
@@ -0,0 +1,81 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <kscreen/types.h>
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QString>
+
+#include <memory>
+#include <optional>
+
+class QFile;
+
+/**
+ * Writes the events the daemon reacts to into a trace file, to be fed back into the daemon later.
+ *
+ * The trace has one JSON object per line. Each has the "event" name and the "timeUs" since the
+ * recording started, events caused by the backend carry a "config" snapshot as serialized by
+ * KScreen::ConfigSerializer, connection changes the "outputId". The first line is a "start" event
+ * with the "version" of the format and the config at that time.
+ *
+ * Lines are written on the IoWorker thread, so events cost the daemon a serialization only.
+ */
+class EventRecorder
+{
+public:
+    enum class Event {
+        Start,
+        ConfigurationChanged,
+        OutputAdded,
+        OutputConnected,
+        OutputDisconnected,
+        LidClosed,
+        LidOpened,
+        AboutToSuspend,
+        ResumingFromSuspend,
+        ControlChanged,
+    };
+
+    static constexpr int Version = 1;
+
+    static EventRecorder *self();
+    static void destroy();
+
+    static QString eventName(Event event);
+    static std::optional<Event> eventFromName(const QString &name);
+
+    static QJsonObject serializeConfig(const KScreen::ConfigPtr &config);
+    static KScreen::ConfigPtr deserializeConfig(const QJsonObject &object);
+
+    /**
+     * @returns the directory recordings started over D-Bus are written to
+     */
+    static QString tracesDirPath();
+
+    /**
+     * Starts writing to @p path, replacing an earlier recording in that file.
+     */
+    bool start(const QString &path, const KScreen::ConfigPtr &config);
+    void stop();
+    bool isRecording() const;
+
+    void record(Event event, const KScreen::ConfigPtr &config = {});
+    void record(Event event, int outputId);
+
+private:
+    EventRecorder();
+    ~EventRecorder();
+
+    void write(QJsonObject object, Event event);
+
+    std::shared_ptr<QFile> m_file;
+    QElapsedTimer m_clock;
+
+    static EventRecorder *s_instance;
+};
@@ -0,0 +1,128 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "flapdetector.h"
+#include "kscreen_daemon_debug.h"
+
+#include <QTimer>
+
+FlapDetector::FlapDetector(QObject *parent)
+    : QObject(parent)
+{
+    m_clock.start();
+}
+
+FlapDetector::~FlapDetector()
+{
+}
+
+bool FlapDetector::addToggle(const QString &connector)
+{
+    ++m_toggleCount;
+    const qint64 now = m_clock.elapsed();
+    Connector &state = m_connectors[connector];
+
+    if (state.lastToggle >= 0 && now - state.lastToggle > StableTime) {
+        state.backoffLevel = 0;
+    }
+    state.lastToggle = now;
+
+    if (state.quarantine && state.quarantine->isActive()) {
+        ++m_suppressedCount;
+        return false;
+    }
+
+    state.toggles.append(now);
+    while (state.toggles.first() < now - FlapWindow) {
+        state.toggles.removeFirst();
+    }
+    if (state.toggles.size() < FlapThreshold) {
+        return true;
+    }
+
+    qCWarning(KSCREEN_KDED) << "Output" << connector << "changed its connection" << state.toggles.size() << "times in" << FlapWindow
+                            << "ms, ignoring it for a while";
+    startQuarantine(connector, state);
+    ++m_suppressedCount;
+    return false;
+}
+
+void FlapDetector::startQuarantine(const QString &connector, Connector &state)
+{
+    if (!state.quarantine) {
+        state.quarantine = new QTimer(this);
+        state.quarantine->setSingleShot(true);
+        connect(state.quarantine, &QTimer::timeout, this, [this, connector]() {
+            quarantineEnded(connector);
+        });
+    }
+    const int interval = qMin<qint64>(qint64(BaseBackoff) << qMin(state.backoffLevel, 16), MaxBackoff);
+    ++state.backoffLevel;
+    state.toggles.clear();
+    state.quarantine->start(interval);
+    ++m_quarantineCount;
+    qCDebug(KSCREEN_KDED) << "Quarantined" << connector << "for" << interval << "ms";
+}
+
+void FlapDetector::quarantineEnded(const QString &connector)
+{
+    Connector &state = m_connectors[connector];
+    if (m_clock.elapsed() - state.lastToggle < FlapWindow) {
+        // Still flapping
+        startQuarantine(connector, state);
+        return;
+    }
+    qCDebug(KSCREEN_KDED) << "Releasing" << connector << "from quarantine";
+    Q_EMIT released(connector);
+}
+
+bool FlapDetector::isQuarantined(const QString &connector) const
+{
+    return remainingQuarantine(connector) > 0;
+}
+
+QStringList FlapDetector::quarantined() const
+{
+    QStringList connectors;
+    for (auto it = m_connectors.cbegin(); it != m_connectors.cend(); ++it) {
+        if (it->quarantine && it->quarantine->isActive()) {
+            connectors.append(it.key());
+        }
+    }
+    return connectors;
+}
+
+int FlapDetector::remainingQuarantine(const QString &connector) const
+{
+    const auto it = m_connectors.constFind(connector);
+    if (it == m_connectors.cend() || !it->quarantine || !it->quarantine->isActive()) {
+        return 0;
+    }
+    return qMax(it->quarantine->remainingTime(), 1);
+}
+
+quint64 FlapDetector::toggleCount() const
+{
+    return m_toggleCount;
+}
+
+quint64 FlapDetector::suppressedCount() const
+{
+    return m_suppressedCount;
+}
+
+quint64 FlapDetector::quarantineCount() const
+{
+    return m_quarantineCount;
+}
+
+void FlapDetector::resetStatistics()
+{
+    m_toggleCount = 0;
+    m_suppressedCount = 0;
+    m_quarantineCount = 0;
+}
+
+#include "moc_flapdetector.cpp"
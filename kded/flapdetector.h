@@ -0,0 +1,77 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+class QTimer;
+
+/**
+ * Keeps connectors whose connection state keeps toggling from driving the daemon.
+ *
+ * A bad cable or a monitor going in and out of power saving can report hundreds of connection
+ * changes, each of which would end in a new config being applied. A connector toggling
+ * FlapThreshold times within FlapWindow is put into quarantine, during which its changes are
+ * ignored. The quarantine starts at BaseBackoff and doubles every time the connector is still or
+ * again flapping afterwards, until it stayed quiet for StableTime. When it ends, released() is
+ * emitted so that the current state of the connector gets applied once.
+ */
+class FlapDetector : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int FlapThreshold = 6;
+    static constexpr int FlapWindow = 5000;
+    static constexpr int BaseBackoff = 2000;
+    static constexpr int MaxBackoff = 5 * 60 * 1000;
+    static constexpr int StableTime = 60 * 1000;
+
+    explicit FlapDetector(QObject *parent = nullptr);
+    ~FlapDetector() override;
+
+    /**
+     * Called for every connection change of @p connector.
+     * @returns false if the change is to be ignored
+     */
+    bool addToggle(const QString &connector);
+    bool isQuarantined(const QString &connector) const;
+    QStringList quarantined() const;
+    /**
+     * @returns the time until @p connector leaves the quarantine in ms, 0 if it is not in one
+     */
+    int remainingQuarantine(const QString &connector) const;
+
+    quint64 toggleCount() const;
+    quint64 suppressedCount() const;
+    quint64 quarantineCount() const;
+    void resetStatistics();
+
+Q_SIGNALS:
+    void released(const QString &connector);
+
+private:
+    struct Connector {
+        QList<qint64> toggles;
+        qint64 lastToggle = -1;
+        int backoffLevel = 0;
+        QTimer *quarantine = nullptr;
+    };
+
+    void startQuarantine(const QString &connector, Connector &state);
+    void quarantineEnded(const QString &connector);
+
+    QElapsedTimer m_clock;
+    QHash<QString, Connector> m_connectors;
+
+    quint64 m_toggleCount = 0;
+    quint64 m_suppressedCount = 0;
+    quint64 m_quarantineCount = 0;
+};
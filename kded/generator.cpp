@@ -9,10 +9,18 @@
 #include <cmath>
 
 #include "generator.h"
+#include "../common/modeindex.h"
 #include "device.h"
 #include "kscreen_daemon_debug.h"
+#include "layoutcache.h"
 #include "output.h"
+#include "tracer.h"
 #include <QRect>
+#include <QSemaphore>
+#include <QStringBuilder>
+
+#include <algorithm>
+#include <vector>
 
 #include <kscreen/screen.h>
 
@@ -42,12 +50,13 @@ static const int targetDpiMobile = 136;
 // Round calculated ideal scale factor to the nearest quarter
 static const int scaleRoundingness = 4;
 
-Generator *Generator::instance = nullptr;
+// Enough for the monitors of a few docks and desks, dropped as a whole when exceeded
+static const int maxInitialStates = 32;
 
-bool operator<(const QSize &s1, const QSize &s2)
-{
-    return s1.width() * s1.height() < s2.width() * s2.height();
-}
+// Enough threads to check all fallback candidates at once
+static const int maxFallbackCandidates = 4;
+
+Generator *Generator::instance = nullptr;
 
 Generator *Generator::self()
 {
@@ -64,6 +73,7 @@ Generator::Generator()
     , m_forceNotLaptop(false)
     , m_forceDocked(false)
 {
+    m_validationPool.setMaxThreadCount(maxFallbackCandidates);
     connect(Device::self(), &Device::ready, this, &Generator::ready);
 }
 
@@ -85,6 +95,7 @@ void Generator::setCurrentConfig(const KScreen::ConfigPtr &currentConfig)
 KScreen::ConfigPtr Generator::idealConfig(const KScreen::ConfigPtr &currentConfig)
 {
     Q_ASSERT(currentConfig);
+    HotplugTracer::Span span(HotplugTracer::Stage::GenerateConfig);
 
     KScreen::ConfigPtr config = currentConfig->clone();
 
@@ -121,33 +132,100 @@ KScreen::ConfigPtr Generator::fallbackIfNeeded(const KScreen::ConfigPtr &config)
 {
     qCDebug(KSCREEN_KDED) << "fallbackIfNeeded()";
 
-    KScreen::ConfigPtr newConfig;
-
-    // If the ideal config can't be applied, try clonning
-    if (!KScreen::Config::canBeApplied(config)) {
-        if (isLaptop()) {
-            newConfig = displaySwitch(Generator::Clone); // Try to clone at our best
-        } else {
-            newConfig = config;
-            KScreen::OutputList connectedOutputs = config->connectedOutputs();
-            if (connectedOutputs.isEmpty()) {
-                return config;
-            } else {
-                config->setPrimaryOutput(connectedOutputs.first());
-                cloneScreens(config);
-            }
-        }
-    } else {
-        newConfig = config;
+    if (KScreen::Config::canBeApplied(config)) {
+        return config;
     }
 
-    // If after trying to clone at our best, we fail... return current
-    if (!KScreen::Config::canBeApplied(newConfig)) {
+    const QList<Candidate> candidates = fallbackCandidates(config);
+    const int best = firstValidCandidate(candidates);
+    if (best < 0) {
+        // Nothing we tried can be applied... return current
         qCDebug(KSCREEN_KDED) << "Config cannot be applied";
-        newConfig = config;
+        return config;
     }
+    qCDebug(KSCREEN_KDED) << "Falling back to" << candidates.at(best).name;
+    return candidates.at(best).config;
+}
 
-    return config;
+QList<Generator::Candidate> Generator::fallbackCandidates(const KScreen::ConfigPtr &config)
+{
+    QList<Candidate> candidates;
+    const KScreen::OutputList connectedOutputs = config->connectedOutputs();
+    if (connectedOutputs.isEmpty()) {
+        return candidates;
+    }
+    const KScreen::OutputPtr embedded = isLaptop() ? embeddedOutput(connectedOutputs) : KScreen::OutputPtr();
+    const int primaryId = embedded ? embedded->id() : connectedOutputs.first()->id();
+
+    // Clone at our best
+    KScreen::ConfigPtr clone = config->clone();
+    clone->setPrimaryOutput(clone->output(primaryId));
+    cloneScreens(clone);
+    candidates.append({"clone", clone});
+
+    // Without a laptop, that is what the ideal layout is already
+    if (isLaptop()) {
+        KScreen::ConfigPtr extended = config->clone();
+        extendToRight(extended, extended->connectedOutputs());
+        candidates.append({"extend to right", extended});
+    }
+
+    if (embedded && connectedOutputs.count() > 1) {
+        KScreen::ConfigPtr external = config->clone();
+        KScreen::OutputList externalOutputs = external->connectedOutputs();
+        externalOutputs.remove(embedded->id());
+        external->output(embedded->id())->setEnabled(false);
+        extendToRight(external, externalOutputs);
+        candidates.append({"disable embedded", external});
+    }
+
+    // Everything at the lowest size all outputs support, the least demanding layout there is
+    KScreen::ConfigPtr lowest = config->clone();
+    const QList<KScreen::OutputPtr> outputs = lowest->connectedOutputs().values();
+    QList<std::shared_ptr<const ModeIndex>> indexes;
+    for (const KScreen::OutputPtr &output : outputs) {
+        indexes.append(ModeIndex::of(output));
+    }
+    const QSize lowestSize = ModeIndex::smallestCommonSize(indexes);
+    for (int i = 0; i < outputs.count(); ++i) {
+        const auto &index = indexes.at(i);
+        if (index->isEmpty()) {
+            continue;
+        }
+        const KScreen::OutputPtr &output = outputs.at(i);
+        output->setEnabled(true);
+        output->setPos(QPoint(0, 0));
+        output->setCurrentModeId(index->bestForSize(lowestSize.isValid() ? lowestSize : index->sizes().first())->id());
+    }
+    lowest->setPrimaryOutput(lowest->output(primaryId));
+    candidates.append({"lowest common mode", lowest});
+
+    Q_ASSERT(candidates.count() <= maxFallbackCandidates);
+    return candidates;
+}
+
+int Generator::firstValidCandidate(const QList<Candidate> &candidates)
+{
+    if (candidates.isEmpty()) {
+        return -1;
+    }
+
+    // Every candidate is a clone() of its own, with its own screen, outputs and modes, that
+    // nothing but its task touches until all of them are done. canBeApplied() only reads it,
+    // so one round of validation takes as long as the slowest candidate.
+    std::vector<char> valid(candidates.count(), false);
+    QSemaphore done;
+    for (int i = 1; i < candidates.count(); ++i) {
+        m_validationPool.start([config = candidates.at(i).config, &valid, &done, i]() {
+            valid[i] = KScreen::Config::canBeApplied(config);
+            done.release();
+        });
+    }
+    valid[0] = KScreen::Config::canBeApplied(candidates.first().config);
+    done.acquire(candidates.count() - 1);
+
+    const auto it = std::find(valid.cbegin(), valid.cend(), char(true));
+    return it == valid.cend() ? -1 : int(it - valid.cbegin());
 }
 
 KScreen::ConfigPtr Generator::displaySwitch(DisplaySwitchAction action)
@@ -282,62 +360,37 @@ void Generator::cloneScreens(const KScreen::ConfigPtr &config)
         return;
     }
 
-    QSet<QSize> commonSizes;
-    const QSize maxScreenSize = config->screen()->maxSize();
-
-    Q_FOREACH (const KScreen::OutputPtr &output, connectedOutputs) {
-        QSet<QSize> modeSizes;
-        Q_FOREACH (const KScreen::ModePtr &mode, output->modes()) {
-            const QSize size = mode->size();
-            if (size.width() > maxScreenSize.width() || size.height() > maxScreenSize.height()) {
-                continue;
-            }
-            modeSizes.insert(mode->size());
-        }
-
-        // If we have nothing to compare against
-        if (commonSizes.isEmpty()) {
-            commonSizes = modeSizes;
-        } else {
-            commonSizes.intersect(modeSizes);
-        }
-
-        // If there's already nothing in common, bail
-        if (commonSizes.isEmpty()) {
-            break;
-        }
+    const QList<KScreen::OutputPtr> outputs = connectedOutputs.values();
+    QList<std::shared_ptr<const ModeIndex>> indexes;
+    for (const KScreen::OutputPtr &output : outputs) {
+        indexes.append(ModeIndex::of(output));
     }
+    const QSize biggestSize = ModeIndex::largestCommonSize(indexes, config->screen()->maxSize());
 
-    qCDebug(KSCREEN_KDED) << "Common sizes: " << commonSizes;
     // fallback to biggestMode if no commonSizes have been found
-    if (commonSizes.isEmpty()) {
-        for (KScreen::OutputPtr &output : connectedOutputs) {
-            if (output->modes().isEmpty()) {
+    if (!biggestSize.isValid()) {
+        qCDebug(KSCREEN_KDED) << "No common sizes";
+        for (int i = 0; i < outputs.count(); ++i) {
+            if (indexes.at(i)->isEmpty()) {
                 continue;
             }
+            const KScreen::OutputPtr &output = outputs.at(i);
             output->setEnabled(true);
             output->setPos(QPoint(0, 0));
-            const KScreen::ModePtr mode = biggestMode(output->modes());
-            Q_ASSERT(mode);
-            output->setCurrentModeId(mode->id());
+            output->setCurrentModeId(indexes.at(i)->biggest()->id());
         }
         return;
     }
 
-    // At this point, we know we have common sizes, let's get the biggest on
-    QList<QSize> commonSizeList = commonSizes.values();
-    std::sort(commonSizeList.begin(), commonSizeList.end());
-    const QSize biggestSize = commonSizeList.last();
-
     // Finally, look for the mode with biggestSize and biggest refreshRate and set it
     qCDebug(KSCREEN_KDED) << "Biggest Size: " << biggestSize;
-    KScreen::ModePtr bestMode;
-    for (KScreen::OutputPtr &output : connectedOutputs) {
-        if (output->modes().isEmpty()) {
+    for (int i = 0; i < outputs.count(); ++i) {
+        if (indexes.at(i)->isEmpty()) {
             continue;
         }
-        bestMode = bestModeForSize(output->modes(), biggestSize);
+        const KScreen::ModePtr bestMode = indexes.at(i)->bestForSize(biggestSize);
         Q_ASSERT(bestMode); // we resolved this mode previously, so it better works
+        const KScreen::OutputPtr &output = outputs.at(i);
         output->setEnabled(true);
         output->setPos(QPoint(0, 0));
         output->setCurrentModeId(bestMode->id());
@@ -472,59 +525,39 @@ void Generator::initializeOutput(const KScreen::OutputPtr &output, KScreen::Conf
         output->setEnabled(false);
         return;
     }
-    Output::GlobalConfig config = Output::readGlobal(output);
-    output->setCurrentModeId(config.modeId.value_or(bestModeForOutput(output)->id()));
-    output->setRotation(config.rotation.value_or(output->rotation()));
-    if (features & KScreen::Config::Feature::PerOutputScaling) {
-        output->setScale(config.scale.value_or(bestScaleForOutput(output)));
-    }
-}
-
-KScreen::ModePtr Generator::biggestMode(const KScreen::ModeList &modes)
-{
-    Q_ASSERT(!modes.isEmpty());
 
-    int modeArea, biggestArea = 0;
-    KScreen::ModePtr biggestMode;
-    for (const KScreen::ModePtr &mode : modes) {
-        modeArea = mode->size().width() * mode->size().height();
-        if (modeArea < biggestArea) {
-            continue;
-        }
-        if (modeArea == biggestArea && mode->refreshRate() < biggestMode->refreshRate()) {
-            continue;
-        }
-        if (modeArea == biggestArea && mode->refreshRate() > biggestMode->refreshRate()) {
-            biggestMode = mode;
-            continue;
-        }
-
-        biggestArea = modeArea;
-        biggestMode = mode;
+    const QString key = output->hashMd5() % output->name();
+    const size_t inputs = initialStateInputs(output);
+    const quint64 generation = LayoutCache::self()->globalDataGeneration();
+    if (m_initialStatesGeneration != generation || m_initialStates.count() >= maxInitialStates) {
+        // Decided by global data that changed since, or by monitors that are long gone
+        m_initialStates.clear();
+        m_initialStatesGeneration = generation;
+    }
+    auto it = m_initialStates.find(key);
+    if (it == m_initialStates.end() || it->inputs != inputs) {
+        Output::GlobalConfig config = Output::readGlobal(output);
+        const QString modeId = config.modeId.value_or(bestModeForOutput(output)->id());
+        // bestScaleForOutput() goes by the current mode
+        output->setCurrentModeId(modeId);
+        it = m_initialStates.insert(key, InitialState{inputs, modeId, config.rotation, config.scale.value_or(bestScaleForOutput(output))});
     }
 
-    return biggestMode;
+    output->setCurrentModeId(it->modeId);
+    output->setRotation(it->rotation.value_or(output->rotation()));
+    if (features & KScreen::Config::Feature::PerOutputScaling) {
+        output->setScale(it->scale);
+    }
 }
 
-KScreen::ModePtr Generator::bestModeForSize(const KScreen::ModeList &modes, const QSize &size)
+size_t Generator::initialStateInputs(const KScreen::OutputPtr &output) const
 {
-    KScreen::ModePtr bestMode;
-    for (const KScreen::ModePtr &mode : modes) {
-        if (mode->size() != size) {
-            continue;
-        }
-
-        if (!bestMode) {
-            bestMode = mode;
-            continue;
-        }
-
-        if (mode->refreshRate() > bestMode->refreshRate()) {
-            bestMode = mode;
-        }
-    }
-
-    return bestMode;
+    return qHashMulti(ModeIndex::fingerprint(output->modes()),
+                      output->preferredModes(),
+                      output->type(),
+                      output->sizeMm().width(),
+                      output->sizeMm().height(),
+                      isLaptop());
 }
 
 qreal Generator::bestScaleForOutput(const KScreen::OutputPtr &output)
@@ -579,7 +612,7 @@ KScreen::ModePtr Generator::bestModeForOutput(const KScreen::OutputPtr &output)
         return outputMode;
     }
 
-    return biggestMode(output->modes());
+    return ModeIndex::of(output)->biggest();
 }
 
 KScreen::OutputPtr Generator::biggestOutput(const KScreen::OutputList &outputs)
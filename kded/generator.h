@@ -6,12 +6,17 @@
 
 #pragma once
 
+#include <QHash>
+#include <QList>
 #include <QObject>
+#include <QThreadPool>
 
 #include <kscreen/config.h>
 #include <kscreen/mode.h>
 #include <kscreen/output.h>
 
+#include <optional>
+
 namespace KScreen
 {
 class Config;
@@ -42,7 +47,6 @@ public:
     void setForceDocked(bool force);
     void setForceNotLaptop(bool force);
 
-    static KScreen::ModePtr biggestMode(const KScreen::ModeList &modes);
     qreal bestScaleForOutput(const KScreen::OutputPtr &output);
 
 Q_SIGNALS:
@@ -54,13 +58,29 @@ private:
 
     KScreen::ConfigPtr fallbackIfNeeded(const KScreen::ConfigPtr &config);
 
+    // A layout to fall back to when the ideal one can't be applied
+    struct Candidate {
+        const char *name;
+        KScreen::ConfigPtr config;
+    };
+    /**
+     * @returns the layouts derived from @p config, in the order they are preferred in
+     */
+    QList<Candidate> fallbackCandidates(const KScreen::ConfigPtr &config);
+    /**
+     * Checks all @p candidates at once on m_validationPool, each being a clone of its own.
+     * @returns the index of the first one that can be applied, -1 if there is none
+     */
+    int firstValidCandidate(const QList<Candidate> &candidates);
+
     void cloneScreens(const KScreen::ConfigPtr &config);
     void laptop(KScreen::ConfigPtr &config);
     void singleOutput(KScreen::ConfigPtr &config);
     void extendToRight(KScreen::ConfigPtr &config, KScreen::OutputList usableOutputs);
 
     void initializeOutput(const KScreen::OutputPtr &output, KScreen::Config::Features features);
-    KScreen::ModePtr bestModeForSize(const KScreen::ModeList &modes, const QSize &size);
+    // Everything but the global output data that initializeOutput() goes by
+    size_t initialStateInputs(const KScreen::OutputPtr &output) const;
     KScreen::ModePtr bestModeForOutput(const KScreen::OutputPtr &output);
 
     KScreen::OutputPtr biggestOutput(const KScreen::OutputList &connectedOutputs);
@@ -77,6 +97,21 @@ private:
     bool m_forceDocked;
 
     KScreen::ConfigPtr m_currentConfig;
+    QThreadPool m_validationPool;
+
+    // What initializeOutput() decided for a monitor on a connector, kept for when it is
+    // connected again as long as neither its modes nor the global output data changed
+    struct InitialState {
+        size_t inputs;
+        QString modeId;
+        std::optional<KScreen::Output::Rotation> rotation;
+        qreal scale;
+    };
+    QHash<QString, InitialState> m_initialStates;
+    // The LayoutCache::globalDataGeneration() m_initialStates were decided with
+    quint64 m_initialStatesGeneration = 0;
 
     static Generator *instance;
+
+    friend class BenchGenerator;
 };
@@ -0,0 +1,45 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "ioworker.h"
+
+IoWorker *IoWorker::s_instance = nullptr;
+
+IoWorker *IoWorker::self()
+{
+    if (!s_instance) {
+        s_instance = new IoWorker();
+    }
+    return s_instance;
+}
+
+void IoWorker::destroy()
+{
+    delete s_instance;
+    s_instance = nullptr;
+}
+
+IoWorker::IoWorker()
+{
+    // A single thread keeps the jobs ordered.
+    m_pool.setMaxThreadCount(1);
+    m_pool.setObjectName(QStringLiteral("KScreenIoWorker"));
+}
+
+IoWorker::~IoWorker()
+{
+    // Pending writes must reach the disk before the daemon goes away.
+    m_pool.waitForDone();
+}
+
+void IoWorker::post(const std::function<void()> &job)
+{
+    m_pool.start(job);
+}
+
+void IoWorker::waitForDone()
+{
+    m_pool.waitForDone();
+}
@@ -0,0 +1,57 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QMetaObject>
+#include <QObject>
+#include <QThreadPool>
+
+#include <functional>
+#include <utility>
+
+/**
+ * Runs the daemon's file I/O off the main thread.
+ *
+ * kded is shared by many modules, so reading, parsing and writing our files must not block
+ * its event loop. Jobs are executed one after another in the order they were queued, which
+ * guarantees that a read queued after a write sees the written data.
+ */
+class IoWorker
+{
+public:
+    static IoWorker *self();
+    static void destroy();
+
+    /**
+     * Runs @p job on the worker thread and passes its result to @p done, which is invoked
+     * in the thread of @p context. The job and its result must not reference QObjects, and
+     * @p context has to outlive the IoWorker.
+     */
+    template<typename Job, typename Done>
+    void run(QObject *context, Job job, Done done)
+    {
+        m_pool.start([context, job = std::move(job), done = std::move(done)]() {
+            auto result = job();
+            QMetaObject::invokeMethod(
+                context,
+                [done, result]() {
+                    done(result);
+                },
+                Qt::QueuedConnection);
+        });
+    }
+
+    void post(const std::function<void()> &job);
+    void waitForDone();
+
+private:
+    IoWorker();
+    ~IoWorker();
+
+    QThreadPool m_pool;
+
+    static IoWorker *s_instance;
+};
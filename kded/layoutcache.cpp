@@ -0,0 +1,223 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "layoutcache.h"
+#include "../common/globals.h"
+#include "../common/statestore.h"
+#include "config.h"
+#include "kscreen_daemon_debug.h"
+#include "layoutindex.h"
+#include "output.h"
+
+#include <KDirWatch>
+
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QStringBuilder>
+
+LayoutCache *LayoutCache::s_instance = nullptr;
+
+LayoutCache *LayoutCache::self()
+{
+    if (!s_instance) {
+        s_instance = new LayoutCache();
+    }
+    return s_instance;
+}
+
+void LayoutCache::destroy()
+{
+    delete s_instance;
+    s_instance = nullptr;
+}
+
+LayoutCache::LayoutCache()
+    : QObject()
+{
+    KDirWatch *watch = Globals::pathWatch();
+    if (!watch) {
+        qCDebug(KSCREEN_KDED) << "Paths aren't watched, files changed by somebody else won't be noticed";
+        return;
+    }
+    connect(watch, &KDirWatch::dirty, this, &LayoutCache::pathChanged);
+    connect(watch, &KDirWatch::created, this, &LayoutCache::pathChanged);
+    connect(watch, &KDirWatch::deleted, this, &LayoutCache::pathChanged);
+}
+
+LayoutCache::~LayoutCache()
+{
+}
+
+std::optional<Schema::Layout> LayoutCache::layout(const QString &fileName) const
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_layouts.constFind(fileName);
+    if (it == m_layouts.constEnd()) {
+        return std::nullopt;
+    }
+    return it->outputs;
+}
+
+void LayoutCache::insert(const QString &fileName, const Schema::Layout &outputs)
+{
+    const Storage::Stamp stamp = Storage::stamp(Config::configsDirPath() % fileName);
+
+    QMutexLocker locker(&m_mutex);
+    if (!stamp.exists) {
+        m_layouts.remove(fileName);
+        return;
+    }
+    m_layouts.insert(fileName, Entry{outputs, stamp});
+}
+
+void LayoutCache::remove(const QString &fileName)
+{
+    QMutexLocker locker(&m_mutex);
+    m_layouts.remove(fileName);
+}
+
+std::optional<Schema::OutputRecord> LayoutCache::globalData(const QString &name) const
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_globals.constFind(name);
+    if (it == m_globals.constEnd()) {
+        return std::nullopt;
+    }
+    return it->data;
+}
+
+void LayoutCache::insertGlobalData(const QString &name, const QString &path, const Schema::OutputRecord &data)
+{
+    GlobalEntry entry{data, path, Storage::Stamp()};
+    if (!path.isEmpty()) {
+        entry.stamp = Storage::stamp(path);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_globals.constFind(name);
+    if (it != m_globals.cend() && (it->path != path || it->data != data)) {
+        ++m_globalDataGeneration;
+    }
+    m_globals.insert(name, entry);
+}
+
+quint64 LayoutCache::globalDataGeneration() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_globalDataGeneration;
+}
+
+void LayoutCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_layouts.clear();
+    m_globals.clear();
+    ++m_globalDataGeneration;
+}
+
+void LayoutCache::pathChanged(const QString &path)
+{
+    StateStore *store = Storage::stateStore();
+    if (store && path == store->path()) {
+        // Somebody else appended to the store, which may touch any entry
+        store->refresh();
+        revalidateAll();
+        LayoutIndex::self()->changed();
+        return;
+    }
+
+    const bool isGlobalData = path.startsWith(Output::dirPath().chopped(1));
+    if (store || (!isGlobalData && !path.startsWith(Config::configsDirPath().chopped(1)))) {
+        // A preset, none of them is cached here
+        return;
+    }
+    const QFileInfo info(path);
+
+    if (info.isDir()) {
+        if (!isGlobalData) {
+            LayoutIndex::self()->changed();
+        }
+        // Only the directory is known to have changed, check every entry of it.
+        QStringList names;
+        {
+            QMutexLocker locker(&m_mutex);
+            names = isGlobalData ? m_globals.keys() : m_layouts.keys();
+        }
+        for (const QString &name : std::as_const(names)) {
+            if (isGlobalData) {
+                revalidateGlobalData(name);
+            } else {
+                revalidate(name);
+            }
+        }
+        return;
+    }
+
+    if (isGlobalData) {
+        revalidateGlobalData(path.mid(Globals::dirPath().length()));
+    } else {
+        revalidate(info.fileName());
+        LayoutIndex::self()->changed(info.fileName());
+    }
+}
+
+void LayoutCache::revalidateAll()
+{
+    QStringList layouts;
+    QStringList globals;
+    {
+        QMutexLocker locker(&m_mutex);
+        layouts = m_layouts.keys();
+        globals = m_globals.keys();
+    }
+    for (const QString &name : std::as_const(layouts)) {
+        revalidate(name);
+    }
+    for (const QString &name : std::as_const(globals)) {
+        revalidateGlobalData(name);
+    }
+}
+
+void LayoutCache::revalidate(const QString &fileName)
+{
+    // Our own writes update the entry before the watcher fires, so they still match here.
+    const Storage::Stamp stamp = Storage::stamp(Config::configsDirPath() % fileName);
+
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_layouts.find(fileName);
+    if (it == m_layouts.end()) {
+        return;
+    }
+    if (stamp.exists && stamp == it->stamp) {
+        return;
+    }
+    qCDebug(KSCREEN_KDED) << "Layout" << fileName << "changed on disk, dropping it from the cache";
+    m_layouts.erase(it);
+}
+
+void LayoutCache::revalidateGlobalData(const QString &name)
+{
+    const QString writablePath = Globals::dirPath() % name;
+    const Storage::Stamp stamp = Storage::stamp(writablePath);
+
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_globals.find(name);
+    if (it == m_globals.end()) {
+        return;
+    }
+    if (it->path == writablePath) {
+        if (stamp.exists && stamp == it->stamp) {
+            return;
+        }
+    } else if (!stamp.exists) {
+        // Still resolved to a preset or to nothing at all.
+        return;
+    }
+    qCDebug(KSCREEN_KDED) << "Global output data" << name << "changed on disk, dropping it from the cache";
+    m_globals.erase(it);
+    ++m_globalDataGeneration;
+}
+
+#include "moc_layoutcache.cpp"
@@ -0,0 +1,79 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include "../common/schema.h"
+#include "../common/storage.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+
+#include <optional>
+
+/**
+ * Keeps the decoded content of the daemon's files in memory.
+ *
+ * Layouts from Config::configsDirPath() are keyed by file name, which for regular layouts is
+ * the connectedOutputsHash() of the topology. Global output data is keyed by its path relative
+ * to Globals::dirPath(), as passed to Globals::findFile(), and also remembers lookups that
+ * found no file. Globals::pathWatch() tells about changes to both directories, or to the
+ * StateStore if there is one, and entries whose file was changed by somebody else are dropped.
+ * Writes done by the daemon itself update the entry in place.
+ *
+ * The cache may be queried from the IoWorker thread, but has to be created on the main thread,
+ * after Globals::watchPaths().
+ */
+class LayoutCache : public QObject
+{
+    Q_OBJECT
+public:
+    static LayoutCache *self();
+    static void destroy();
+
+    std::optional<Schema::Layout> layout(const QString &fileName) const;
+    void insert(const QString &fileName, const Schema::Layout &outputs);
+    void remove(const QString &fileName);
+
+    std::optional<Schema::OutputRecord> globalData(const QString &name) const;
+    /**
+     * @param path the file @p name was resolved to, empty if there is none
+     */
+    void insertGlobalData(const QString &name, const QString &path, const Schema::OutputRecord &data);
+    /**
+     * @returns a number that changes whenever global output data handed out before may have
+     * changed, for those who keep decisions made from it
+     */
+    quint64 globalDataGeneration() const;
+
+    void clear();
+
+private:
+    explicit LayoutCache();
+    ~LayoutCache() override;
+
+    void pathChanged(const QString &path);
+    void revalidateAll();
+    void revalidate(const QString &fileName);
+    void revalidateGlobalData(const QString &name);
+
+    struct Entry {
+        Schema::Layout outputs;
+        Storage::Stamp stamp;
+    };
+    struct GlobalEntry {
+        Schema::OutputRecord data;
+        QString path;
+        Storage::Stamp stamp;
+    };
+
+    mutable QMutex m_mutex;
+    QHash<QString, Entry> m_layouts;
+    QHash<QString, GlobalEntry> m_globals;
+    quint64 m_globalDataGeneration = 0;
+
+    static LayoutCache *s_instance;
+};
@@ -0,0 +1,258 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "layoutindex.h"
+#include "../common/globals.h"
+#include "../common/statestore.h"
+#include "config.h"
+#include "kscreen_daemon_debug.h"
+#include "layoutcache.h"
+
+#include <QDir>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QStringBuilder>
+
+#include <kscreen/config.h>
+
+#include <tuple>
+
+LayoutIndex *LayoutIndex::s_instance = nullptr;
+
+LayoutIndex *LayoutIndex::self()
+{
+    if (!s_instance) {
+        s_instance = new LayoutIndex();
+    }
+    return s_instance;
+}
+
+void LayoutIndex::destroy()
+{
+    delete s_instance;
+    s_instance = nullptr;
+}
+
+QList<LayoutIndex::OutputKey> LayoutIndex::keys(const KScreen::ConfigPtr &config)
+{
+    QList<OutputKey> keys;
+    const auto outputs = config->connectedOutputs();
+    for (const KScreen::OutputPtr &output : outputs) {
+        keys.append(OutputKey{output->hash(), output->name(), output->type()});
+    }
+    return keys;
+}
+
+bool LayoutIndex::isLayoutName(QStringView fileName)
+{
+    // The connectedOutputsHash() of the topology
+    static const QRegularExpression hash(QStringLiteral("^[0-9a-f]{32}$"));
+    return hash.match(fileName).hasMatch();
+}
+
+int LayoutIndex::count() const
+{
+    QMutexLocker locker(&m_mutex);
+    return int(m_entries.count());
+}
+
+void LayoutIndex::insert(const QString &fileName, const Schema::Layout &layout)
+{
+    if (!isLayoutName(fileName)) {
+        return;
+    }
+    const Storage::Stamp stamp = Storage::stamp(Config::configsDirPath() % fileName);
+    QMutexLocker locker(&m_mutex);
+    insertEntry(fileName, layout, stamp);
+}
+
+void LayoutIndex::remove(const QString &fileName)
+{
+    QMutexLocker locker(&m_mutex);
+    removeEntry(fileName);
+}
+
+void LayoutIndex::changed(const QString &fileName)
+{
+    QMutexLocker locker(&m_mutex);
+    if (fileName.isEmpty()) {
+        m_built = false;
+        m_changed.clear();
+    } else if (m_built && isLayoutName(fileName)) {
+        m_changed.insert(fileName);
+    }
+}
+
+void LayoutIndex::insertEntry(const QString &fileName, const Schema::Layout &layout, const Storage::Stamp &stamp)
+{
+    removeEntry(fileName);
+    Entry entry{{}, stamp};
+    entry.outputs.reserve(layout.count());
+    for (const Schema::OutputRecord &info : layout) {
+        entry.outputs.append(StoredOutput{info.id, info.metadata ? info.metadata->name : QString(), info.enabled.value_or(false)});
+        m_byHash[info.id].insert(fileName);
+    }
+    m_entries.insert(fileName, entry);
+}
+
+void LayoutIndex::removeEntry(const QString &fileName)
+{
+    const auto it = m_entries.constFind(fileName);
+    if (it == m_entries.cend()) {
+        return;
+    }
+    for (const StoredOutput &output : it->outputs) {
+        auto layouts = m_byHash.find(output.hash);
+        if (layouts != m_byHash.end()) {
+            layouts->remove(fileName);
+            if (layouts->isEmpty()) {
+                m_byHash.erase(layouts);
+            }
+        }
+    }
+    m_entries.erase(it);
+}
+
+void LayoutIndex::build()
+{
+    QStringList fileNames;
+    if (StateStore *store = Storage::stateStore()) {
+        const QString dirName = Config::configsDirPath().mid(Globals::dirPath().length());
+        const QStringList names = store->names();
+        for (const QString &name : names) {
+            if (name.startsWith(dirName)) {
+                fileNames.append(name.mid(dirName.length()));
+            }
+        }
+    } else {
+        fileNames = QDir(Config::configsDirPath()).entryList(QDir::Files);
+    }
+    // Leaves out the layouts with the lid opened, the last layout, the fixed config, the state store and its lock, the usage and anything else
+    fileNames.removeIf([](const QString &fileName) {
+        return !isLayoutName(fileName);
+    });
+
+    const QSet<QString> present(fileNames.cbegin(), fileNames.cend());
+    const QStringList indexed = m_entries.keys();
+    for (const QString &fileName : indexed) {
+        if (!present.contains(fileName)) {
+            removeEntry(fileName);
+        }
+    }
+    for (const QString &fileName : std::as_const(fileNames)) {
+        update(fileName);
+    }
+    m_built = true;
+    m_changed.clear();
+}
+
+void LayoutIndex::update(const QString &fileName)
+{
+    const Storage::Stamp stamp = Storage::stamp(Config::configsDirPath() % fileName);
+    if (!stamp.exists) {
+        removeEntry(fileName);
+        return;
+    }
+    const auto it = m_entries.constFind(fileName);
+    if (it != m_entries.cend() && it->stamp == stamp) {
+        return;
+    }
+    if (auto layout = LayoutCache::self()->layout(fileName)) {
+        insertEntry(fileName, *layout, stamp);
+        return;
+    }
+    const auto data = Storage::readValue(Config::configsDirPath() % fileName);
+    if (!data) {
+        removeEntry(fileName);
+        return;
+    }
+    insertEntry(fileName, Schema::decodeLayout(*data), stamp);
+}
+
+std::optional<QString> LayoutIndex::nearest(const QList<OutputKey> &outputs, bool lidOpen)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_built) {
+        build();
+    } else {
+        for (const QString &fileName : std::as_const(m_changed)) {
+            update(fileName);
+        }
+        m_changed.clear();
+    }
+
+    QHash<QString, QStringList> connectors;
+    QSet<QString> candidates;
+    // Which have to stay on
+    QSet<QString> openPanels;
+    for (const OutputKey &output : outputs) {
+        connectors[output.hash].append(output.connector);
+        if (output.type != KScreen::Output::Panel) {
+            candidates.unite(m_byHash.value(output.hash));
+        } else if (lidOpen) {
+            openPanels.insert(output.hash);
+        }
+    }
+
+    struct Match {
+        QString fileName;
+        int matched = 0;
+        // Outputs only one of the topologies has
+        int unmatched = 0;
+        int sameConnector = 0;
+
+        auto rank() const
+        {
+            return std::tuple(-matched, unmatched, -sameConnector, fileName);
+        }
+    };
+    std::optional<Match> best;
+    for (const QString &fileName : std::as_const(candidates)) {
+        const Entry &entry = *m_entries.constFind(fileName);
+        QHash<QString, QStringList> remaining = connectors;
+        QList<const StoredOutput *> movedOutputs;
+        Match match{fileName};
+        bool enabled = false;
+        bool panelOff = false;
+
+        // Identical monitors share a hash, match those on the same connector first
+        for (const StoredOutput &output : entry.outputs) {
+            auto it = remaining.find(output.hash);
+            if (it != remaining.end() && it->removeOne(output.connector)) {
+                ++match.matched;
+                ++match.sameConnector;
+                enabled |= output.enabled;
+                panelOff |= !output.enabled && openPanels.contains(output.hash);
+            } else {
+                movedOutputs.append(&output);
+            }
+        }
+        for (const StoredOutput *output : std::as_const(movedOutputs)) {
+            auto it = remaining.find(output->hash);
+            if (it != remaining.end() && !it->isEmpty()) {
+                it->removeLast();
+                ++match.matched;
+                enabled |= output->enabled;
+                panelOff |= !output->enabled && openPanels.contains(output->hash);
+            }
+        }
+
+        // One topology has to contain the other, and something of it has to be on, including
+        // the panel if the lid is open
+        if (match.matched < std::min(entry.outputs.count(), outputs.count()) || !enabled || panelOff) {
+            continue;
+        }
+        match.unmatched = int(entry.outputs.count() + outputs.count()) - 2 * match.matched;
+        if (!best || match.rank() < best->rank()) {
+            best = match;
+        }
+    }
+
+    if (!best) {
+        return std::nullopt;
+    }
+    qCDebug(KSCREEN_KDED) << "Nearest layout is" << best->fileName << "matching" << best->matched << "outputs," << best->unmatched << "unmatched";
+    return best->fileName;
+}
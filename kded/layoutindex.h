@@ -0,0 +1,103 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include "../common/schema.h"
+#include "../common/storage.h"
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+
+#include <kscreen/output.h>
+#include <kscreen/types.h>
+
+#include <optional>
+
+/**
+ * The outputs of every stored layout, to find one for a topology that has none of its own.
+ *
+ * Layouts are named after the connectedOutputsHash() of their topology, so moving a monitor
+ * without EDID to another port of a dock, or connecting one more or one less monitor than
+ * before, misses the layout and ends up with the ideal config and the OSD asking the user.
+ * nearest() looks for a layout that knows all of the connected outputs, or all of whose
+ * outputs are connected, instead. Outputs are identified by their hash(), which is that of the
+ * EDID or, without one, the connector, preferring layouts where they were on the same
+ * connector. A layout only qualifies if it shares an external monitor with the topology,
+ * otherwise the one of the laptop panel alone would be picked for every monitor connected.
+ * While the lid is open, layouts that turn off the laptop panel don't qualify either.
+ *
+ * The index is built on first use and kept up to date by insert() and remove(). Files changed
+ * by somebody else are passed to changed() by the watch of the LayoutCache and only those are
+ * read again by the next lookup. It is meant to be used on the IoWorker thread, changed() may
+ * be called from any thread.
+ */
+class LayoutIndex
+{
+public:
+    static LayoutIndex *self();
+    static void destroy();
+
+    // An output of the topology to find a layout for
+    struct OutputKey {
+        QString hash;
+        QString connector;
+        KScreen::Output::Type type = KScreen::Output::Unknown;
+    };
+    /**
+     * @returns the keys of the connected outputs of @p config
+     */
+    static QList<OutputKey> keys(const KScreen::ConfigPtr &config);
+
+    /**
+     * @returns whether @p fileName is that of a regular layout, not one with the lid opened,
+     * the fixed config or any other file in Config::configsDirPath()
+     */
+    static bool isLayoutName(QStringView fileName);
+
+    /**
+     * @returns the file name of the stored layout closest to @p outputs, if any qualifies
+     */
+    std::optional<QString> nearest(const QList<OutputKey> &outputs, bool lidOpen = false);
+
+    void insert(const QString &fileName, const Schema::Layout &layout);
+    void remove(const QString &fileName);
+    /**
+     * Has the next lookup read @p fileName again, or every file if it is empty
+     */
+    void changed(const QString &fileName = QString());
+    int count() const;
+
+private:
+    LayoutIndex() = default;
+
+    struct StoredOutput {
+        QString hash;
+        QString connector;
+        bool enabled = false;
+    };
+    struct Entry {
+        QList<StoredOutput> outputs;
+        Storage::Stamp stamp;
+    };
+
+    void build();
+    void update(const QString &fileName);
+    void insertEntry(const QString &fileName, const Schema::Layout &layout, const Storage::Stamp &stamp);
+    void removeEntry(const QString &fileName);
+
+    mutable QMutex m_mutex;
+    bool m_built = false;
+    // Changed by somebody else since the last lookup
+    QSet<QString> m_changed;
+    QHash<QString, Entry> m_entries;
+    // The layouts with an output of a hash
+    QHash<QString, QSet<QString>> m_byHash;
+
+    static LayoutIndex *s_instance;
+};
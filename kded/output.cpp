@@ -5,16 +5,17 @@
     SPDX-License-Identifier: GPL-2.0-or-later
 */
 #include "output.h"
+#include "../common/modeindex.h"
+#include "../common/storage.h"
 #include "config.h"
 
-#include "generator.h"
 #include "kscreen_daemon_debug.h"
+#include "layoutcache.h"
+#include "storecompactor.h"
 
-#include <QDir>
-#include <QFile>
-#include <QJsonDocument>
 #include <QLoggingCategory>
 #include <QRect>
+#include <QSet>
 #include <QStringBuilder>
 #include <QStringList>
 
@@ -27,53 +28,35 @@ QString Output::dirPath()
     return Globals::dirPath() % s_dirName;
 }
 
-static Output::GlobalConfig fromInfo(const KScreen::OutputPtr output, const QVariantMap &info)
+static Output::GlobalConfig fromInfo(const KScreen::OutputPtr output, const Schema::OutputRecord &info)
 {
     Output::GlobalConfig config;
-    bool ok = false;
-    if (int rotation = info.value(QStringLiteral("rotation")).toInt(&ok); ok) {
-        config.rotation = static_cast<KScreen::Output::Rotation>(rotation);
+    if (info.rotation) {
+        config.rotation = static_cast<KScreen::Output::Rotation>(*info.rotation);
     }
-
-    if (qreal scale = info.value(QStringLiteral("scale")).toDouble(&ok); ok) {
-        config.scale = scale;
-    }
-
-    if (auto vrr = static_cast<KScreen::Output::VrrPolicy>(info.value(QStringLiteral("vrrpolicy")).toUInt(&ok)); ok) {
-        config.vrrPolicy = vrr;
-    }
-
-    if (auto overscan = info.value(QStringLiteral("overscan")).toUInt(&ok); ok) {
-        config.overscan = overscan;
+    config.scale = info.scale;
+    if (info.vrrPolicy) {
+        config.vrrPolicy = static_cast<KScreen::Output::VrrPolicy>(*info.vrrPolicy);
     }
-
-    if (auto rgbRange = static_cast<KScreen::Output::RgbRange>(info.value(QStringLiteral("rgbrange")).toUInt(&ok)); ok) {
-        config.rgbRange = rgbRange;
+    config.overscan = info.overscan;
+    if (info.rgbRange) {
+        config.rgbRange = static_cast<KScreen::Output::RgbRange>(*info.rgbRange);
     }
 
-    const QVariantMap modeInfo = info[QStringLiteral("mode")].toMap();
-    const QVariantMap modeSize = modeInfo[QStringLiteral("size")].toMap();
-    const QSize size = QSize(modeSize[QStringLiteral("width")].toInt(), modeSize[QStringLiteral("height")].toInt());
+    const Schema::ModeRecord mode = info.mode.value_or(Schema::ModeRecord());
+    const QSize size = mode.size;
+    const ModeKey key = mode.key();
 
-    qCDebug(KSCREEN_KDED) << "Finding a mode for" << size << "@" << modeInfo[QStringLiteral("refresh")].toFloat();
-
-    const KScreen::ModeList modes = output->modes();
-    for (const KScreen::ModePtr &mode : modes) {
-        if (mode->size() != size) {
-            continue;
-        }
-        if (!qFuzzyCompare(mode->refreshRate(), modeInfo[QStringLiteral("refresh")].toFloat())) {
-            continue;
-        }
+    qCDebug(KSCREEN_KDED) << "Finding a mode for" << size << "@" << key.refreshMilliHz << "mHz";
 
+    if (const KScreen::ModePtr mode = ModeIndex::of(output)->find(key)) {
         qCDebug(KSCREEN_KDED) << "\tFound: " << mode->id() << " " << mode->size() << "@" << mode->refreshRate();
         config.modeId = mode->id();
-        break;
     }
     return config;
 }
 
-void Output::readInGlobalPartFromInfo(KScreen::OutputPtr output, const QVariantMap &info)
+void Output::readInGlobalPartFromInfo(KScreen::OutputPtr output, const Schema::OutputRecord &info)
 {
     GlobalConfig config = fromInfo(output, info);
     output->setRotation(config.rotation.value_or(KScreen::Output::Rotation::None));
@@ -94,7 +77,7 @@ void Output::readInGlobalPartFromInfo(KScreen::OutputPtr output, const QVariantM
     }
     if (!matchingMode) {
         qCWarning(KSCREEN_KDED) << "\tFailed to get a preferred mode, falling back to biggest mode.";
-        matchingMode = Generator::biggestMode(output->modes());
+        matchingMode = ModeIndex::of(output)->biggest();
     }
     if (!matchingMode) {
         qCWarning(KSCREEN_KDED) << "\tFailed to get biggest mode. Which means there are no modes. Turning off the screen.";
@@ -105,34 +88,57 @@ void Output::readInGlobalPartFromInfo(KScreen::OutputPtr output, const QVariantM
     output->setCurrentModeId(matchingMode->id());
 }
 
-QVariantMap Output::getGlobalData(KScreen::OutputPtr output)
+QStringList Output::globalDataNames(const KScreen::OutputPtr &output)
+{
+    return {s_dirName % output->hashMd5() % output->name(), s_dirName % output->hashMd5()};
+}
+
+static Schema::OutputRecord readGlobalFile(const QString &name)
 {
-    const auto tryFile = [output](const auto &name) {
-        QString fileName = Globals::findFile(name);
-        if (fileName.isEmpty()) {
-            qCDebug(KSCREEN_KDED) << "No file for" << name;
-            return QVariantMap();
+    if (auto cached = LayoutCache::self()->globalData(name)) {
+        if (!cached->isEmpty()) {
+            StoreCompactor::self()->markUsed(name);
         }
-        QFile file(fileName);
-        if (!file.open(QIODevice::ReadOnly)) {
-            qCDebug(KSCREEN_KDED) << "Failed to open file" << file.fileName();
-            return QVariantMap();
+        return *cached;
+    }
+    const QString fileName = Globals::findFile(name);
+    if (fileName.isEmpty()) {
+        qCDebug(KSCREEN_KDED) << "No file for" << name;
+        LayoutCache::self()->insertGlobalData(name, QString(), Schema::OutputRecord());
+        return Schema::OutputRecord();
+    }
+    const auto content = Storage::readValue(fileName);
+    if (!content) {
+        qCDebug(KSCREEN_KDED) << "Failed to open file" << fileName;
+        return Schema::OutputRecord();
+    }
+    qCDebug(KSCREEN_KDED) << "Found global data at" << fileName;
+    const Schema::OutputRecord data = Schema::OutputRecord::decode(*content);
+    LayoutCache::self()->insertGlobalData(name, fileName, data);
+    StoreCompactor::self()->markUsed(name);
+    return data;
+}
+
+Schema::OutputRecord Output::readGlobalData(const QStringList &names)
+{
+    for (const QString &name : names) {
+        const Schema::OutputRecord data = readGlobalFile(name);
+        if (!data.isEmpty()) {
+            return data;
         }
-        qCDebug(KSCREEN_KDED) << "Found global data at" << file.fileName();
-        QJsonDocument parser;
-        return parser.fromJson(file.readAll()).toVariant().toMap();
-    };
-    auto specific = tryFile(s_dirName % output->hashMd5() % output->name());
-    if (!specific.isEmpty()) {
-        return specific;
-    }
-    return tryFile(s_dirName % output->hashMd5());
+    }
+    return Schema::OutputRecord();
+}
+
+Schema::OutputRecord Output::getGlobalData(KScreen::OutputPtr output)
+{
+    return readGlobalData(globalDataNames(output));
 }
 
 bool Output::readInGlobal(KScreen::OutputPtr output)
 {
-    const QVariantMap info = getGlobalData(output);
-    if (info.empty()) {
+    const Schema::OutputRecord info = getGlobalData(output);
+    if (info.isEmpty()) {
         // if info is empty, the global file does not exists, or is in an unreadable state
         return false;
     }
@@ -182,7 +188,7 @@ bool Output::updateOrientation(KScreen::OutputPtr &output, QOrientationReading::
 }
 
 // TODO: move this into the Layouter class.
-void Output::adjustPositions(KScreen::ConfigPtr config, const QVariantList &outputsInfo)
+void Output::adjustPositions(KScreen::ConfigPtr config, const Schema::Layout &outputsInfo)
 {
     typedef QPair<int, QPoint> Out;
 
@@ -206,41 +212,26 @@ void Output::adjustPositions(KScreen::ConfigPtr config, const QVariantList &outp
             }
             const auto hash = output->hash();
 
-            auto it = std::find_if(outputsInfo.begin(), outputsInfo.end(), [hash](QVariant v) {
-                const QVariantMap info = v.toMap();
-                return info[QStringLiteral("id")].toString() == hash;
+            auto it = std::find_if(outputsInfo.begin(), outputsInfo.end(), [hash](const Schema::OutputRecord &info) {
+                return info.id == hash;
             });
             if (it == outputsInfo.end()) {
                 return false;
             }
 
-            auto isPortrait = [](const QVariant &info) {
-                bool ok;
-                const int rot = info.toInt(&ok);
-                if (!ok) {
-                    return false;
-                }
-                return rot & KScreen::Output::Rotation::Left || rot & KScreen::Output::Rotation::Right;
-            };
-
-            const QVariantMap outputInfo = it->toMap();
+            const Schema::OutputRecord &outputInfo = *it;
+            const bool portrait = outputInfo.rotation && (*outputInfo.rotation & (KScreen::Output::Rotation::Left | KScreen::Output::Rotation::Right));
 
-            const QVariantMap posInfo = outputInfo[QStringLiteral("pos")].toMap();
-            const QVariant scaleInfo = outputInfo[QStringLiteral("scale")];
-            const QVariantMap modeInfo = outputInfo[QStringLiteral("mode")].toMap();
-            const QVariantMap modeSize = modeInfo[QStringLiteral("size")].toMap();
-            const bool portrait = isPortrait(outputInfo[QStringLiteral("rotation")]);
-
-            if (posInfo.isEmpty() || modeSize.isEmpty() || !scaleInfo.canConvert<int>()) {
+            if (!outputInfo.pos || !outputInfo.mode || !outputInfo.scale) {
                 return false;
             }
 
-            const qreal scale = scaleInfo.toDouble();
+            const qreal scale = *outputInfo.scale;
             if (scale <= 0) {
                 return false;
             }
-            const QPoint pos = QPoint(posInfo[QStringLiteral("x")].toInt(), posInfo[QStringLiteral("y")].toInt());
-            QSize size = QSize(modeSize[QStringLiteral("width")].toInt() / scale, modeSize[QStringLiteral("height")].toInt() / scale);
+            const QPoint pos = *outputInfo.pos;
+            QSize size = QSize(outputInfo.mode->size.width() / scale, outputInfo.mode->size.height() / scale);
             if (portrait) {
                 size.transpose();
             }
@@ -324,12 +315,10 @@ void Output::adjustPositions(KScreen::ConfigPtr config, const QVariantList &outp
     }
 }
 
-void Output::readIn(KScreen::OutputPtr output, const QVariantMap &info)
+void Output::readIn(KScreen::OutputPtr output, const Schema::OutputRecord &info)
 {
-    const QVariantMap posInfo = info[QStringLiteral("pos")].toMap();
-    QPoint point(posInfo[QStringLiteral("x")].toInt(), posInfo[QStringLiteral("y")].toInt());
-    output->setPos(point);
-    output->setEnabled(info[QStringLiteral("enabled")].toBool());
+    output->setPos(info.pos.value_or(QPoint()));
+    output->setEnabled(info.enabled.value_or(false));
 
     if (readInGlobal(output)) {
         // output data read from global output file
@@ -339,27 +328,17 @@ void Output::readIn(KScreen::OutputPtr output, const QVariantMap &info)
     readInGlobalPartFromInfo(output, info);
 }
 
-void Output::readInOutputs(KScreen::ConfigPtr config, const QVariantList &outputsInfo)
+void Output::readInOutputs(KScreen::ConfigPtr config, const Schema::Layout &outputsInfo)
 {
     const KScreen::OutputList outputs = config->outputs();
     ControlConfig control(config);
     // As global outputs are indexed by a hash of their edid, which is not unique,
     // to be able to tell apart multiple identical outputs, these need special treatment
-    QStringList duplicateIds;
-    {
-        QStringList allConnectedIds;
-        allConnectedIds.reserve(outputs.count());
-        for (const KScreen::OutputPtr &output : outputs) {
-            if (!output->isConnected()) {
-                // Duplicated IDs only matter if the duplicates are actually connected. Duplicates may also be transient.
-                continue;
-            }
-            const auto outputId = output->hash();
-            if (allConnectedIds.contains(outputId) && !duplicateIds.contains(outputId)) {
-                duplicateIds << outputId;
-            }
-            allConnectedIds << outputId;
-        }
+    const OutputIdentityTable &identities = control.identities();
+
+    QHash<QString, QList<const Schema::OutputRecord *>> infosById;
+    for (const Schema::OutputRecord &info : outputsInfo) {
+        infosById[info.id].append(&info);
     }
 
     QMap<KScreen::OutputPtr, uint32_t> priorities;
@@ -369,32 +348,28 @@ void Output::readInOutputs(KScreen::ConfigPtr config, const QVariantList &output
             output->setEnabled(false);
             continue;
         }
-        const auto outputId = output->hash();
+        const OutputIdentityTable::Identity *identity = identities.identity(output->id());
         bool infoFound = false;
-        for (const auto &variantInfo : outputsInfo) {
-            const QVariantMap info = variantInfo.toMap();
-            if (outputId != info[QStringLiteral("id")].toString()) {
-                continue;
-            }
-            if (!output->name().isEmpty() && duplicateIds.contains(outputId)) {
+        const QList<const Schema::OutputRecord *> infos = infosById.value(identity->hash);
+        for (const Schema::OutputRecord *info : infos) {
+            if (!identity->name.isEmpty() && identity->connectedDuplicate) {
                 // We may have identical outputs connected, these will have the same id in the config
                 // in order to find the right one, also check the output's name (usually the connector)
-                const auto metadata = info[QStringLiteral("metadata")].toMap();
-                const auto outputName = metadata[QStringLiteral("name")].toString();
-                if (output->name() != outputName) {
+                const QString outputName = info->metadata ? info->metadata->name : QString();
+                if (identity->name != outputName) {
                     // was a duplicate id, but info not for this output
                     continue;
                 }
             }
             infoFound = true;
-            readIn(output, info);
+            readIn(output, *info);
 
             // the deprecated "primary" property may exist for compatibility, but "priority" should override it whenever present.
             uint32_t priority = 0;
-            if (info.contains(QStringLiteral("priority"))) {
-                priority = info[QStringLiteral("priority")].toUInt();
-            } else if (info.contains(QStringLiteral("primary"))) {
-                priority = info[QStringLiteral("primary")].toBool() ? 1 : 2;
+            if (info->priority) {
+                priority = *info->priority;
+            } else if (info->primary) {
+                priority = *info->primary ? 1 : 2;
             }
             priorities[output] = priority;
             break;
@@ -407,7 +382,7 @@ void Output::readInOutputs(KScreen::ConfigPtr config, const QVariantList &output
             if (!readInGlobal(output)) {
                 // set some default values instead
                 output->setEnabled(true);
-                readInGlobalPartFromInfo(output, QVariantMap());
+                readInGlobalPartFromInfo(output, Schema::OutputRecord());
             }
         }
     }
@@ -431,28 +406,68 @@ void Output::readInOutputs(KScreen::ConfigPtr config, const QVariantList &output
 #endif
 }
 
-static QVariantMap metadata(const KScreen::OutputPtr &output)
+void Output::placeUnknownOutputs(KScreen::ConfigPtr config, const Schema::Layout &outputsInfo)
 {
-    QVariantMap metadata;
-    metadata[QStringLiteral("name")] = output->name();
+    QSet<QString> known;
+    for (const Schema::OutputRecord &info : outputsInfo) {
+        known.insert(info.id);
+    }
+
+    QList<KScreen::OutputPtr> knownOutputs;
+    QList<KScreen::OutputPtr> unknownOutputs;
+    QRect bounds;
+    uint32_t priority = 0;
+    const auto outputs = config->connectedOutputs();
+    for (const KScreen::OutputPtr &output : outputs) {
+        if (!known.contains(output->hash())) {
+            unknownOutputs.append(output);
+            continue;
+        }
+        knownOutputs.append(output);
+        if (output->isPositionable()) {
+            bounds |= output->geometry();
+        }
+        priority = std::max(priority, output->priority());
+    }
+
+    for (const KScreen::OutputPtr &output : std::as_const(knownOutputs)) {
+        if (output->isPositionable()) {
+            output->setPos(output->pos() - bounds.topLeft());
+        }
+    }
+    int x = bounds.width();
+    for (const KScreen::OutputPtr &output : std::as_const(unknownOutputs)) {
+        if (!output->currentMode()) {
+            // Without modes readInOutputs() turned it off
+            continue;
+        }
+        output->setEnabled(true);
+        output->setPos(QPoint(x, 0));
+        config->setOutputPriority(output, ++priority);
+        x += output->geometry().width();
+    }
+}
+
+static Schema::OutputMetadata metadata(const KScreen::OutputPtr &output)
+{
+    Schema::OutputMetadata metadata{output->name(), std::nullopt};
     if (!output->edid() || !output->edid()->isValid()) {
         return metadata;
     }
 
-    metadata[QStringLiteral("fullname")] = output->edid()->deviceId();
+    metadata.fullName = output->edid()->deviceId();
     return metadata;
 }
 
-bool Output::writeGlobalPart(const KScreen::OutputPtr &output, QVariantMap &info, const KScreen::OutputPtr &fallback)
+bool Output::writeGlobalPart(const KScreen::OutputPtr &output, Schema::OutputRecord &info, const KScreen::OutputPtr &fallback)
 {
-    info[QStringLiteral("id")] = output->hash();
-    info[QStringLiteral("metadata")] = metadata(output);
-    info[QStringLiteral("rotation")] = output->rotation();
+    info.id = output->hash();
+    info.metadata = metadata(output);
+    info.rotation = output->rotation();
 
     // Round scale to four digits
-    info[QStringLiteral("scale")] = int(output->scale() * 10000 + 0.5) / 10000.;
+    info.scale = int(output->scale() * 10000 + 0.5) / 10000.;
 
-    QVariantMap modeInfo;
     float refreshRate = -1.;
     QSize modeSize;
     if (output->currentMode() && output->isEnabled()) {
@@ -467,43 +482,53 @@ bool Output::writeGlobalPart(const KScreen::OutputPtr &output, QVariantMap &info
         return false;
     }
 
-    modeInfo[QStringLiteral("refresh")] = refreshRate;
-
-    QVariantMap modeSizeMap;
-    modeSizeMap[QStringLiteral("width")] = modeSize.width();
-    modeSizeMap[QStringLiteral("height")] = modeSize.height();
-    modeInfo[QStringLiteral("size")] = modeSizeMap;
-
-    info[QStringLiteral("mode")] = modeInfo;
-    info[QStringLiteral("vrrpolicy")] = static_cast<uint32_t>(output->vrrPolicy());
-    info[QStringLiteral("overscan")] = output->overscan();
-    info[QStringLiteral("rgbrange")] = static_cast<uint32_t>(output->rgbRange());
+    // The float for older versions and the KCM, the key for finding the mode again
+    info.mode = Schema::ModeRecord{modeSize, refreshRate, ModeKey::of(modeSize, refreshRate).refreshMilliHz};
+    info.vrrPolicy = static_cast<uint32_t>(output->vrrPolicy());
+    info.overscan = output->overscan();
+    info.rgbRange = static_cast<uint32_t>(output->rgbRange());
 
     return true;
 }
 
+std::optional<Output::GlobalWrite> Output::prepareGlobal(const KScreen::OutputPtr &output, bool hasDuplicate)
+{
+    GlobalWrite write{output->hashMd5(), output->name(), hasDuplicate, Schema::OutputRecord()};
+    if (!writeGlobalPart(output, write.info, nullptr)) {
+        return std::nullopt;
+    }
+    return write;
+}
+
 void Output::writeGlobal(const KScreen::OutputPtr &output, bool hasDuplicate)
 {
-    // get old values and subsequently override
-    QVariantMap info = getGlobalData(output);
-    if (!writeGlobalPart(output, info, nullptr)) {
-        return;
+    if (const auto write = prepareGlobal(output, hasDuplicate)) {
+        writeGlobal(*write);
     }
+}
+
+void Output::writeGlobal(const GlobalWrite &write)
+{
+    const QString specificName = s_dirName % write.hashMd5 % write.name;
+    const QString genericName = s_dirName % write.hashMd5;
 
-    if (!QDir().mkpath(dirPath())) {
+    // get old values and subsequently override
+    Schema::OutputRecord info = readGlobalData({specificName, genericName});
+    info.update(write.info);
+
+    if (!Globals::mkpath(dirPath())) {
         return;
     }
-    QString fileName = dirPath() % output->hashMd5() % output->name();
-    if (!hasDuplicate && !QFile(fileName).exists()) {
+    QString name = specificName;
+    if (!write.hasDuplicate && !Storage::exists(Globals::dirPath() % name)) {
         // connector-specific file doesn't exist yet, use the non-specific one instead
-        fileName = dirPath() % output->hashMd5();
+        name = genericName;
     }
-    QFile file(fileName);
-    if (!file.open(QIODevice::WriteOnly)) {
-        qCWarning(KSCREEN_KDED) << "Failed to open global output file for writing! " << file.errorString();
+    const QString fileName = Globals::dirPath() % name;
+    if (!Storage::writeValue(fileName, info.encode())) {
+        qCWarning(KSCREEN_KDED) << "Failed to write global output file" << fileName;
         return;
     }
-
-    file.write(QJsonDocument::fromVariant(info).toJson());
-    return;
+    LayoutCache::self()->insertGlobalData(name, fileName, info);
+    StoreCompactor::self()->markUsed(name);
 }
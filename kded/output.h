@@ -8,22 +8,51 @@
 
 #include "../common/control.h"
 #include "../common/globals.h"
+#include "../common/schema.h"
 
 #include <kscreen/output.h>
 #include <kscreen/types.h>
 
 #include <QOrientationReading>
-#include <QVariantMap>
 
 #include <optional>
 
 class Output
 {
 public:
-    static void readInOutputs(KScreen::ConfigPtr config, const QVariantList &outputsInfo);
+    static void readInOutputs(KScreen::ConfigPtr config, const Schema::Layout &outputsInfo);
+    /**
+     * For a layout of another topology read in with readInOutputs(): moves the outputs
+     * @p outputsInfo knows to the origin, which may have been taken by one that isn't connected,
+     * and enables the connected outputs it doesn't know to the right of them.
+     */
+    static void placeUnknownOutputs(KScreen::ConfigPtr config, const Schema::Layout &outputsInfo);
 
+    /**
+     * The global output data of an output, detached from the output so that it
+     * can be written from the IoWorker thread.
+     */
+    struct GlobalWrite {
+        QString hashMd5;
+        QString name;
+        bool hasDuplicate = false;
+        Schema::OutputRecord info;
+    };
+    static std::optional<GlobalWrite> prepareGlobal(const KScreen::OutputPtr &output, bool hasDuplicate);
+    static void writeGlobal(const GlobalWrite &write);
     static void writeGlobal(const KScreen::OutputPtr &output, bool hasDuplicate);
-    static bool writeGlobalPart(const KScreen::OutputPtr &output, QVariantMap &info, const KScreen::OutputPtr &fallback);
+    static bool writeGlobalPart(const KScreen::OutputPtr &output, Schema::OutputRecord &info, const KScreen::OutputPtr &fallback);
+
+    /**
+     * @returns the names of the files holding the global data of @p output relative
+     * to Globals::dirPath(), the most specific one first
+     */
+    static QStringList globalDataNames(const KScreen::OutputPtr &output);
+    /**
+     * Reads the first existing global data file of @p names. Safe to call from the IoWorker
+     * thread, which uses it to load the data into the LayoutCache ahead of time.
+     */
+    static Schema::OutputRecord readGlobalData(const QStringList &names);
 
     static QString dirPath();
 
@@ -40,16 +69,16 @@ public:
     static GlobalConfig readGlobal(const KScreen::OutputPtr &output);
 
 private:
-    static QVariantMap getGlobalData(KScreen::OutputPtr output);
+    static Schema::OutputRecord getGlobalData(KScreen::OutputPtr output);
 
-    static void readIn(KScreen::OutputPtr output, const QVariantMap &info);
+    static void readIn(KScreen::OutputPtr output, const Schema::OutputRecord &info);
     static bool readInGlobal(KScreen::OutputPtr output);
-    static void readInGlobalPartFromInfo(KScreen::OutputPtr output, const QVariantMap &info);
+    static void readInGlobalPartFromInfo(KScreen::OutputPtr output, const Schema::OutputRecord &info);
     /*
      * When a global output value (scale, rotation) is changed we might
      * need to reposition the outputs when another config is read.
      */
-    static void adjustPositions(KScreen::ConfigPtr config, const QVariantList &outputsInfo);
+    static void adjustPositions(KScreen::ConfigPtr config, const Schema::Layout &outputsInfo);
 
     static QString s_dirName;
 };
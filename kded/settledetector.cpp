@@ -0,0 +1,130 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "settledetector.h"
+#include "kscreen_daemon_debug.h"
+
+#include <QTimer>
+
+#include <chrono>
+
+SettleDetector::SettleDetector(QObject *parent, const Clock &clock)
+    : QObject(parent)
+    , m_clock(clock ? clock : []() -> qint64 {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    })
+    , m_settleTimer(new QTimer(this))
+    , m_burstTimer(new QTimer(this))
+{
+    m_settleTimer->setSingleShot(true);
+    connect(m_settleTimer, &QTimer::timeout, this, &SettleDetector::settle);
+
+    m_burstTimer->setSingleShot(true);
+    m_burstTimer->setInterval(BurstWindow);
+    connect(m_burstTimer, &QTimer::timeout, this, &SettleDetector::endBurst);
+}
+
+SettleDetector::~SettleDetector()
+{
+}
+
+void SettleDetector::addChange(const QString &outputHash)
+{
+    const qint64 now = m_clock();
+    if (m_burstTimer->isActive()) {
+        const qint64 gap = now - m_lastChange;
+        m_burstMaxGapMs = qMax(m_burstMaxGapMs, gap);
+        if (m_settleTimer->isActive() && gap > BaseInterval) {
+            // The fixed delay would have applied in between
+            ++m_avoidedApplies;
+        }
+    }
+    m_lastChange = now;
+    m_burstOutputs.insert(outputHash);
+    m_burstTimer->start();
+
+    const int wait = interval();
+    qCDebug(KSCREEN_KDED) << "Waiting" << wait << "ms for the outputs to settle";
+    m_settleTimer->start(wait);
+}
+
+bool SettleDetector::isSettling() const
+{
+    return m_settleTimer->isActive();
+}
+
+int SettleDetector::interval() const
+{
+    const Dock *dock = matchingDock();
+    if (!dock || dock->outputs == m_burstOutputs) {
+        // Unknown, or all outputs of the dock are there
+        return BaseInterval;
+    }
+    return qMin<qint64>(dock->gapMs * 3 / 2 + BaseInterval, MaxInterval);
+}
+
+const SettleDetector::Dock *SettleDetector::matchingDock() const
+{
+    for (const Dock &dock : m_docks) {
+        if (dock.outputs.contains(m_burstOutputs)) {
+            return &dock;
+        }
+    }
+    return nullptr;
+}
+
+void SettleDetector::settle()
+{
+    m_settleTimer->stop();
+    ++m_settledCount;
+    Q_EMIT settled();
+}
+
+void SettleDetector::endBurst()
+{
+    m_burstTimer->stop();
+    // A single output has nothing to wait for
+    if (m_burstOutputs.size() > 1) {
+        Dock dock{m_burstOutputs, m_burstMaxGapMs};
+        for (auto it = m_docks.begin(); it != m_docks.end(); ++it) {
+            if (it->outputs == m_burstOutputs) {
+                // Let the gap shrink slowly if the dock became faster
+                dock.gapMs = qMax(m_burstMaxGapMs, it->gapMs * 3 / 4);
+                m_docks.erase(it);
+                break;
+            }
+        }
+        qCDebug(KSCREEN_KDED) << "Learned dock with" << dock.outputs.size() << "outputs, arriving" << dock.gapMs << "ms apart";
+        m_docks.prepend(dock);
+        if (m_docks.size() > MaxDocks) {
+            m_docks.removeLast();
+        }
+    }
+    m_burstOutputs.clear();
+    m_burstMaxGapMs = 0;
+}
+
+quint64 SettleDetector::settledCount() const
+{
+    return m_settledCount;
+}
+
+quint64 SettleDetector::avoidedApplies() const
+{
+    return m_avoidedApplies;
+}
+
+int SettleDetector::dockCount() const
+{
+    return m_docks.size();
+}
+
+void SettleDetector::resetStatistics()
+{
+    m_settledCount = 0;
+    m_avoidedApplies = 0;
+}
+
+#include "moc_settledetector.cpp"
@@ -0,0 +1,95 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+#include <functional>
+
+class QTimer;
+
+/**
+ * Decides when a burst of connection changes is over and the topology can be applied.
+ *
+ * Docks, in particular DisplayPort MST hubs, bring their outputs up one after another, spread
+ * over several hundred milliseconds. Applying after every one of them costs a modeset each and
+ * makes the screens flicker through intermediate layouts.
+ *
+ * Every burst of changes is remembered as a dock, keyed by the hashes of the outputs involved,
+ * together with the longest gap between two of its changes. When a new burst looks like a known
+ * dock, settled() waits for that gap before firing, or fires right away once all outputs of the
+ * dock are there. Unknown outputs are applied after a short fixed delay, like before.
+ *
+ * The gaps are measured with the Clock passed in, a monotonic one in ms by default.
+ */
+class SettleDetector : public QObject
+{
+    Q_OBJECT
+public:
+    // The delay for outputs that are not part of a known dock
+    static constexpr int BaseInterval = 10;
+    // Never wait longer than this for the rest of a dock
+    static constexpr int MaxInterval = 1500;
+    // Changes closer than this to the previous one belong to the same burst
+    static constexpr int BurstWindow = 2000;
+    static constexpr int MaxDocks = 16;
+
+    using Clock = std::function<qint64()>;
+
+    explicit SettleDetector(QObject *parent = nullptr, const Clock &clock = Clock());
+    ~SettleDetector() override;
+
+    /**
+     * Called for every output that was connected or disconnected.
+     */
+    void addChange(const QString &outputHash);
+    bool isSettling() const;
+    /**
+     * @returns the time settled() will wait after the last change of the current burst in ms
+     */
+    int interval() const;
+
+    quint64 settledCount() const;
+    /**
+     * @returns how many applies a fixed BaseInterval would have caused in addition
+     */
+    quint64 avoidedApplies() const;
+    int dockCount() const;
+    void resetStatistics();
+
+Q_SIGNALS:
+    void settled();
+
+private:
+    friend class TestSettleDetector;
+
+    struct Dock {
+        QSet<QString> outputs;
+        qint64 gapMs = 0;
+    };
+
+    // When the timers expire
+    void settle();
+    void endBurst();
+    const Dock *matchingDock() const;
+
+    const Clock m_clock;
+    QTimer *const m_settleTimer;
+    QTimer *const m_burstTimer;
+
+    QSet<QString> m_burstOutputs;
+    qint64 m_lastChange = 0;
+    qint64 m_burstMaxGapMs = 0;
+
+    // Most recently seen first
+    QList<Dock> m_docks;
+
+    quint64 m_settledCount = 0;
+    quint64 m_avoidedApplies = 0;
+};
@@ -0,0 +1,382 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "storecompactor.h"
+#include "../common/globals.h"
+#include "../common/schema.h"
+#include "../common/statestore.h"
+#include "../common/storage.h"
+#include "config.h"
+#include "kscreen_daemon_debug.h"
+#include "layoutcache.h"
+#include "layoutindex.h"
+#include "output.h"
+
+#include <QCborMap>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QSet>
+#include <QStringBuilder>
+
+#include <algorithm>
+
+StoreCompactor *StoreCompactor::s_instance = nullptr;
+
+static const QString s_usageFileName = QStringLiteral("usage");
+static const QString s_outputsDirName = QStringLiteral("outputs/");
+static const QString s_lidOpenedSuffix = QStringLiteral("_lidOpened");
+// The connectedOutputsHash() of a topology and the hashMd5() of an output are both md5 hex
+static constexpr int s_hashLength = 32;
+
+StoreCompactor *StoreCompactor::self()
+{
+    if (!s_instance) {
+        s_instance = new StoreCompactor();
+    }
+    return s_instance;
+}
+
+void StoreCompactor::destroy()
+{
+    delete s_instance;
+    s_instance = nullptr;
+}
+
+int StoreCompactor::budget()
+{
+    bool ok = false;
+    const int env = qEnvironmentVariableIntValue("KSCREEN_STORE_BUDGET", &ok);
+    return ok && env > 0 ? env : DefaultBudget;
+}
+
+void StoreCompactor::markUsed(const QString &name, const QDateTime &time)
+{
+    const qint64 msecs = time.toMSecsSinceEpoch();
+    QMutexLocker locker(&m_mutex);
+    qint64 &usage = m_usage[name];
+    usage = std::max(usage, msecs);
+}
+
+StoreCompactor::Statistics StoreCompactor::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_statistics;
+}
+
+// The names of the files in @p dirName relative to Globals::dirPath(), not those in subdirectories
+static QStringList fileNames(const QString &dirName)
+{
+    QStringList names;
+    if (StateStore *store = Storage::stateStore()) {
+        const QStringList storeNames = store->names();
+        for (const QString &name : storeNames) {
+            if (name.startsWith(dirName) && !name.mid(dirName.length()).contains(QLatin1Char('/'))) {
+                names.append(name);
+            }
+        }
+        return names;
+    }
+    const QStringList entries = QDir(Globals::dirPath() % dirName).entryList(QDir::Files | QDir::Hidden);
+    for (const QString &entry : entries) {
+        names.append(dirName % entry);
+    }
+    return names;
+}
+
+static bool isHash(QStringView text)
+{
+    static const QRegularExpression hash(QStringLiteral("^[0-9a-f]{%1}$").arg(s_hashLength));
+    return hash.match(text).hasMatch();
+}
+
+QHash<QString, qint64> StoreCompactor::loadUsage() const
+{
+    QHash<QString, qint64> usage;
+    if (const auto data = Storage::readValue(Globals::dirPath() % s_usageFileName)) {
+        const QCborMap map = data->toMap();
+        for (auto it = map.cbegin(); it != map.cend(); ++it) {
+            usage.insert(it.key().toString(), it.value().toInteger());
+        }
+    }
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_usage.cbegin(); it != m_usage.cend(); ++it) {
+        qint64 &msecs = usage[it.key()];
+        msecs = std::max(msecs, it.value());
+    }
+    return usage;
+}
+
+void StoreCompactor::saveUsage()
+{
+    const QHash<QString, qint64> usage = loadUsage();
+    QCborMap map;
+    for (auto it = usage.cbegin(); it != usage.cend(); ++it) {
+        map.insert(it.key(), it.value());
+    }
+    if (!Globals::mkpath(Globals::dirPath())) {
+        return;
+    }
+    writeUsage(usage, map);
+}
+
+void StoreCompactor::writeUsage(const QHash<QString, qint64> &usage, const QCborMap &map)
+{
+    if (!Storage::writeValue(Globals::dirPath() % s_usageFileName, map)) {
+        qCWarning(KSCREEN_KDED) << "Failed to write usage file";
+        return;
+    }
+    // Keeps marks made meanwhile
+    QMutexLocker locker(&m_mutex);
+    m_usage.removeIf([&usage](const auto &it) {
+        return it.value() <= usage.value(it.key(), -1);
+    });
+}
+
+namespace
+{
+// A layout with its lid opened variant, or the global data of a monitor for all its connectors
+struct Entry {
+    QString key;
+    QStringList names;
+    qint64 lastUsed = 0;
+};
+
+// When files were used last, for those never marked when they were last written
+qint64 lastUsedOf(const QString &name, QHash<QString, qint64> &usage, qint64 now)
+{
+    auto it = usage.find(name);
+    if (it == usage.end()) {
+        // The store has no modification times, start aging from now then
+        const QDateTime modified = Storage::stamp(Globals::dirPath() % name).lastModified;
+        it = usage.insert(name, modified.isValid() ? std::min(modified.toMSecsSinceEpoch(), now) : now);
+    }
+    return it.value();
+}
+
+// @returns the entries beyond @p budget, which counts the protected entries as well
+QList<Entry> lruEvictions(QList<Entry> entries, const QSet<QString> &protectedKeys, int budget)
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry &left, const Entry &right) {
+        return left.lastUsed != right.lastUsed ? left.lastUsed > right.lastUsed : left.key < right.key;
+    });
+    int kept = std::count_if(entries.cbegin(), entries.cend(), [&protectedKeys](const Entry &entry) {
+        return protectedKeys.contains(entry.key);
+    });
+    QList<Entry> evicted;
+    for (const Entry &entry : std::as_const(entries)) {
+        if (protectedKeys.contains(entry.key)) {
+            continue;
+        }
+        if (kept < budget) {
+            ++kept;
+            continue;
+        }
+        evicted.append(entry);
+    }
+    return evicted;
+}
+
+void removeFiles(const QStringList &names, QHash<QString, qint64> &usage)
+{
+    for (const QString &name : names) {
+        const QString path = Globals::dirPath() % name;
+        if (Storage::exists(path) && !Storage::remove(path)) {
+            qCWarning(KSCREEN_KDED) << "Failed to remove" << path;
+        }
+        usage.remove(name);
+    }
+}
+
+Schema::LastLayoutRecord lastLayout()
+{
+    if (const auto data = Storage::readValue(Config::lastLayoutFilePath())) {
+        return Schema::LastLayoutRecord::decode(*data);
+    }
+    return Schema::LastLayoutRecord();
+}
+}
+
+void StoreCompactor::evictLayouts(int budget, QHash<QString, qint64> &usage)
+{
+    const QString dirName = Config::configsDirPath().mid(Globals::dirPath().length());
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    QHash<QString, Entry> layouts;
+    const QStringList names = fileNames(dirName);
+    for (const QString &name : names) {
+        QStringView id = QStringView(name).mid(dirName.length());
+        if (id.endsWith(s_lidOpenedSuffix)) {
+            id.chop(s_lidOpenedSuffix.length());
+        }
+        // Leaves the fixed config, the last layout, the usage and anything we don't know alone
+        if (!LayoutIndex::isLayoutName(id)) {
+            continue;
+        }
+        Entry &entry = layouts[id.toString()];
+        entry.key = id.toString();
+        entry.names.append(name);
+        entry.lastUsed = std::max(entry.lastUsed, lastUsedOf(name, usage, now));
+    }
+
+    QSet<QString> protectedIds;
+    if (const QString id = lastLayout().id; !id.isEmpty()) {
+        protectedIds.insert(id);
+    }
+
+    const QList<Entry> evictions = lruEvictions(layouts.values(), protectedIds, budget);
+    for (const Entry &entry : evictions) {
+        qCDebug(KSCREEN_KDED) << "Evicting layout" << entry.key << "last used" << QDateTime::fromMSecsSinceEpoch(entry.lastUsed);
+        removeFiles(entry.names, usage);
+        removeFiles({QStringLiteral("control/configs/") % entry.key}, usage);
+        LayoutCache::self()->remove(entry.key);
+        LayoutCache::self()->remove(entry.key % s_lidOpenedSuffix);
+        LayoutIndex::self()->remove(entry.key);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_statistics.layouts = layouts.count() - evictions.count();
+    m_statistics.evicted += evictions.count();
+}
+
+void StoreCompactor::evictOutputs(int budget, QHash<QString, qint64> &usage)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    QHash<QString, Entry> outputs;
+    const QStringList names = fileNames(s_outputsDirName);
+    for (const QString &name : names) {
+        const QStringView hash = QStringView(name).mid(s_outputsDirName.length(), s_hashLength);
+        if (!isHash(hash)) {
+            continue;
+        }
+        Entry &entry = outputs[hash.toString()];
+        entry.key = hash.toString();
+        entry.names.append(name);
+        entry.lastUsed = std::max(entry.lastUsed, lastUsedOf(name, usage, now));
+    }
+
+    QSet<QString> protectedHashes;
+    const QList<QStringList> globalDataNames = lastLayout().globalDataNames;
+    for (const QStringList &names : globalDataNames) {
+        for (const QString &name : names) {
+            protectedHashes.insert(name.mid(s_outputsDirName.length(), s_hashLength));
+        }
+    }
+
+    const QList<Entry> evictions = lruEvictions(outputs.values(), protectedHashes, budget);
+    for (const Entry &entry : evictions) {
+        qCDebug(KSCREEN_KDED) << "Evicting global data of" << entry.key << "last used" << QDateTime::fromMSecsSinceEpoch(entry.lastUsed);
+        removeFiles(entry.names, usage);
+        removeFiles({QStringLiteral("control/outputs/") % entry.key}, usage);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_statistics.outputs = outputs.count() - evictions.count();
+    m_statistics.evicted += evictions.count();
+}
+
+void StoreCompactor::mergeOutputs()
+{
+    // The global data of a connector is only read if it exists, otherwise that of the monitor is.
+    // Where both are the same but for the connector the data was written for, the former can go.
+    QHash<QString, QStringList> specificNames;
+    const QStringList names = fileNames(s_outputsDirName);
+    for (const QString &name : names) {
+        if (name.length() > s_outputsDirName.length() + s_hashLength) {
+            specificNames[name.left(s_outputsDirName.length() + s_hashLength)].append(name);
+        }
+    }
+
+    quint64 merged = 0;
+    for (auto it = specificNames.cbegin(); it != specificNames.cend(); ++it) {
+        const auto generic = Storage::readValue(Globals::dirPath() % it.key());
+        if (!generic || generic->isUndefined()) {
+            // Without it the connectors would fall back to each other
+            continue;
+        }
+        const Schema::OutputRecord genericData = Schema::OutputRecord::decode(*generic);
+        for (const QString &name : it.value()) {
+            const auto specific = Storage::readValue(Globals::dirPath() % name);
+            if (!specific) {
+                continue;
+            }
+            Schema::OutputRecord specificData = Schema::OutputRecord::decode(*specific);
+            if (specificData.metadata && genericData.metadata) {
+                specificData.metadata->name = genericData.metadata->name;
+            }
+            if (specificData != genericData) {
+                continue;
+            }
+            qCDebug(KSCREEN_KDED) << "Merging" << name << "into" << it.key();
+            if (Storage::remove(Globals::dirPath() % name)) {
+                ++merged;
+            }
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_statistics.merged += merged;
+}
+
+// The bytes taken by the files below Globals::dirPath()
+static qint64 storeSize()
+{
+    if (StateStore *store = Storage::stateStore()) {
+        return QFileInfo(store->path()).size();
+    }
+    qint64 size = 0;
+    QDirIterator it(Globals::dirPath(), QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        size += it.fileInfo().size();
+    }
+    return size;
+}
+
+void StoreCompactor::compact(int budget)
+{
+    if (!QFileInfo::exists(Globals::dirPath())) {
+        return;
+    }
+    QHash<QString, qint64> usage = loadUsage();
+    const qint64 bytesBefore = storeSize();
+
+    const quint64 evictedBefore = statistics().evicted;
+    evictLayouts(budget, usage);
+    evictOutputs(budget, usage);
+    mergeOutputs();
+
+    // Drops marks of files that are gone, so the usage file doesn't grow forever itself
+    QCborMap map;
+    for (auto it = usage.cbegin(); it != usage.cend(); ++it) {
+        if (Storage::exists(Globals::dirPath() % it.key())) {
+            map.insert(it.key(), it.value());
+        }
+    }
+    writeUsage(usage, map);
+
+    if (statistics().evicted != evictedBefore) {
+        // Readers may still hold on to global data that is gone
+        LayoutCache::self()->clear();
+    }
+
+    if (StateStore *store = Storage::stateStore(); store && store->deadSize() > 0) {
+        // Evicting only appended tombstones to the store
+        if (!store->compact()) {
+            qCWarning(KSCREEN_KDED) << "Failed to compact" << store->path();
+        }
+    }
+
+    const qint64 bytes = storeSize();
+    QMutexLocker locker(&m_mutex);
+    m_statistics.bytes = bytes;
+    m_statistics.reclaimed += std::max(bytesBefore - bytes, qint64(0));
+    m_statistics.lastRun = QDateTime::currentDateTimeUtc();
+    qCDebug(KSCREEN_KDED) << "Compacted store to" << m_statistics.layouts << "layouts and" << m_statistics.outputs << "monitors," << bytes << "bytes, from"
+                          << bytesBefore;
+}
@@ -0,0 +1,90 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QCborMap>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+/**
+ * Keeps the files below Globals::dirPath() from piling up.
+ *
+ * Every combination of outputs that was ever connected leaves a layout and a control file
+ * behind, and every monitor its global output data. On shared desks that adds up to thousands
+ * of files. compact() evicts the layouts used least recently beyond the budget, together with
+ * their control files, and does the same for the global data of monitors. It also drops the
+ * connector-specific global data of a monitor wherever it doesn't differ from its generic data,
+ * which is what reading it would fall back to anyway.
+ *
+ * The layout that was saved last, the fixed config and the global data of its outputs are
+ * never evicted. When a file was last used is recorded by markUsed() and kept in the usage
+ * file, files that were never marked count as used when they were last written. The budget is
+ * DefaultBudget layouts and monitors, it can be set with the KSCREEN_STORE_BUDGET environment
+ * variable.
+ *
+ * With a StateStore, evicted files only leave tombstones behind, so the store is rewritten
+ * afterwards.
+ *
+ * Compaction is meant to be run on the IoWorker thread, markUsed() may be called from any thread.
+ */
+class StoreCompactor
+{
+public:
+    static constexpr int DefaultBudget = 256;
+    // After login things are busy enough, and then once a day
+    static constexpr int StartDelay = 10 * 60 * 1000;
+    static constexpr int Interval = 24 * 60 * 60 * 1000;
+
+    static StoreCompactor *self();
+    static void destroy();
+
+    static int budget();
+
+    /**
+     * Records that the file @p name relative to Globals::dirPath() was read or written at @p time.
+     */
+    void markUsed(const QString &name, const QDateTime &time = QDateTime::currentDateTimeUtc());
+    /**
+     * Writes the usage recorded since the last compaction to the usage file.
+     */
+    void saveUsage();
+
+    struct Statistics {
+        quint64 layouts = 0;
+        quint64 outputs = 0;
+        // Of all files below Globals::dirPath(), or of the StateStore if there is one
+        qint64 bytes = 0;
+        // Layouts and monitors, connector-specific files and bytes, over all compactions
+        quint64 evicted = 0;
+        quint64 merged = 0;
+        qint64 reclaimed = 0;
+        QDateTime lastRun;
+    };
+    /**
+     * @returns the statistics of the last compaction
+     */
+    Statistics statistics() const;
+
+    void compact(int budget = budget());
+
+private:
+    StoreCompactor() = default;
+
+    QHash<QString, qint64> loadUsage() const;
+    void writeUsage(const QHash<QString, qint64> &usage, const QCborMap &map);
+    void evictLayouts(int budget, QHash<QString, qint64> &usage);
+    void evictOutputs(int budget, QHash<QString, qint64> &usage);
+    void mergeOutputs();
+
+    mutable QMutex m_mutex;
+    // Marks since the usage file was last written, in ms since the epoch
+    QHash<QString, qint64> m_usage;
+    Statistics m_statistics;
+
+    static StoreCompactor *s_instance;
+};
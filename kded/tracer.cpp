@@ -0,0 +1,166 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "tracer.h"
+#include "kscreen_daemon_debug.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+HotplugTracer *HotplugTracer::s_instance = nullptr;
+
+HotplugTracer *HotplugTracer::self()
+{
+    if (!s_instance) {
+        s_instance = new HotplugTracer();
+    }
+    return s_instance;
+}
+
+void HotplugTracer::destroy()
+{
+    delete s_instance;
+    s_instance = nullptr;
+}
+
+HotplugTracer::HotplugTracer()
+{
+    m_clock.start();
+    m_stageStarts.fill(-1);
+}
+
+QString HotplugTracer::stageName(Stage stage)
+{
+    switch (stage) {
+    case Stage::Settle:
+        return QStringLiteral("settle");
+    case Stage::ReadConfig:
+        return QStringLiteral("readConfig");
+    case Stage::GenerateConfig:
+        return QStringLiteral("generateConfig");
+    case Stage::WriteConfig:
+        return QStringLiteral("writeConfig");
+    case Stage::Backend:
+        return QStringLiteral("backend");
+    case Stage::Total:
+        return QStringLiteral("total");
+    }
+    Q_UNREACHABLE();
+}
+
+qint64 HotplugTracer::now() const
+{
+    return m_clock.nsecsElapsed();
+}
+
+quint64 HotplugTracer::begin()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_transactionId != 0) {
+        return m_transactionId;
+    }
+    m_transactionId = ++m_lastTransactionId;
+    const qint64 start = now();
+    m_stageStarts[static_cast<int>(Stage::Settle)] = start;
+    m_stageStarts[static_cast<int>(Stage::Total)] = start;
+    qCDebug(KSCREEN_KDED) << "Hotplug transaction" << m_transactionId << "started";
+    return m_transactionId;
+}
+
+void HotplugTracer::end()
+{
+    if (transactionId() == 0) {
+        return;
+    }
+    finishStage(Stage::Total);
+
+    QMutexLocker locker(&m_mutex);
+    qCDebug(KSCREEN_KDED) << "Hotplug transaction" << m_transactionId << "finished";
+    m_transactionId = 0;
+    m_stageStarts.fill(-1);
+}
+
+quint64 HotplugTracer::transactionId() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_transactionId;
+}
+
+void HotplugTracer::startStage(Stage stage)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_transactionId == 0) {
+        // Like a Span, applies not caused by a hotplug, e.g. by the KCM, aren't recorded
+        return;
+    }
+    m_stageStarts[static_cast<int>(stage)] = now();
+}
+
+void HotplugTracer::finishStage(Stage stage)
+{
+    qint64 start;
+    {
+        QMutexLocker locker(&m_mutex);
+        start = std::exchange(m_stageStarts[static_cast<int>(stage)], -1);
+    }
+    if (start < 0) {
+        // The stage was never started in this transaction.
+        return;
+    }
+    record(stage, now() - start);
+}
+
+void HotplugTracer::record(Stage stage, qint64 nsecs)
+{
+    const qint64 us = nsecs / 1000;
+    const quint64 ms = static_cast<quint64>(std::max<qint64>(us / 1000, 0));
+    const int bucket = std::min<int>(std::bit_width(ms), BucketCount - 1);
+
+    QMutexLocker locker(&m_mutex);
+    Histogram &histogram = m_histograms[static_cast<int>(stage)];
+    histogram.count++;
+    histogram.totalUs += us;
+    histogram.maxUs = std::max(histogram.maxUs, us);
+    histogram.buckets[bucket]++;
+
+    qCDebug(KSCREEN_KDED) << "Hotplug transaction" << m_transactionId << stageName(stage) << "took" << us << "us";
+}
+
+HotplugTracer::Histogram HotplugTracer::histogram(Stage stage) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_histograms[static_cast<int>(stage)];
+}
+
+quint64 HotplugTracer::lastTransactionId() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_lastTransactionId;
+}
+
+void HotplugTracer::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_histograms = {};
+}
+
+HotplugTracer::Span::Span(Stage stage)
+    : m_stage(stage)
+    , m_start(HotplugTracer::self()->now())
+    , m_transactionId(HotplugTracer::self()->transactionId())
+{
+}
+
+HotplugTracer::Span::~Span()
+{
+    if (m_transactionId == 0) {
+        return;
+    }
+    auto *tracer = HotplugTracer::self();
+    tracer->record(m_stage, tracer->now() - m_start);
+}
@@ -0,0 +1,100 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+#include <array>
+
+/**
+ * Collects the time spent in the individual stages of a hotplug transaction.
+ *
+ * A transaction starts with the first connection change the daemon sees and ends
+ * once the resulting config has been applied by the backend. Every stage that runs in
+ * between is timestamped under the transaction id and accumulated into a per-stage
+ * histogram, which the daemon exposes over D-Bus.
+ */
+class HotplugTracer
+{
+public:
+    enum class Stage {
+        Settle, ///< First connection change until the compressed apply runs
+        ReadConfig, ///< Reading a known layout from disk
+        GenerateConfig, ///< Computing an ideal layout for an unknown topology
+        WriteConfig, ///< Persisting the current layout
+        Backend, ///< SetConfigOperation round-trip through the backend
+        Total, ///< Whole transaction
+    };
+    static constexpr int StageCount = static_cast<int>(Stage::Total) + 1;
+
+    // Bucket i counts durations below 2^i ms, the last bucket takes everything above.
+    static constexpr int BucketCount = 16;
+
+    struct Histogram {
+        quint64 count = 0;
+        qint64 totalUs = 0;
+        qint64 maxUs = 0;
+        std::array<uint, BucketCount> buckets = {};
+    };
+
+    /**
+     * Measures the lifetime of the object as the given stage, if a transaction is running
+     * when it is created. Reads, writes and generator calls outside of a hotplug, e.g. on
+     * behalf of the KCM, are not recorded.
+     */
+    class Span
+    {
+    public:
+        explicit Span(Stage stage);
+        ~Span();
+
+    private:
+        Stage m_stage;
+        qint64 m_start;
+        quint64 m_transactionId;
+    };
+
+    static HotplugTracer *self();
+    static void destroy();
+
+    static QString stageName(Stage stage);
+
+    /**
+     * Starts a new transaction unless one is already running.
+     * @returns the id of the running transaction
+     */
+    quint64 begin();
+    void end();
+    quint64 transactionId() const;
+
+    /**
+     * Starts timing @p stage of the running transaction, does nothing without one.
+     */
+    void startStage(Stage stage);
+    void finishStage(Stage stage);
+    void record(Stage stage, qint64 nsecs);
+
+    Histogram histogram(Stage stage) const;
+    quint64 lastTransactionId() const;
+    void reset();
+
+private:
+    HotplugTracer();
+
+    qint64 now() const;
+
+    mutable QMutex m_mutex;
+    QElapsedTimer m_clock;
+    quint64 m_transactionId = 0;
+    quint64 m_lastTransactionId = 0;
+    std::array<qint64, StageCount> m_stageStarts;
+    std::array<Histogram, StageCount> m_histograms;
+
+    static HotplugTracer *s_instance;
+};
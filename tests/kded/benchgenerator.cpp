@@ -0,0 +1,264 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "../../common/globals.h"
+#include "../../common/schema.h"
+#include "../../common/storage.h"
+#include "../../kded/config.h"
+#include "../../kded/generator.h"
+#include "../../kded/output.h"
+
+#include <QDir>
+#include <QObject>
+#include <QStandardPaths>
+#include <QStringBuilder>
+#include <QTest>
+
+#include <kscreen/config.h>
+#include <kscreen/mode.h>
+#include <kscreen/output.h>
+#include <kscreen/screen.h>
+
+/**
+ * Times the daemon on synthetic topologies of up to 64 outputs with up to 300 modes each.
+ *
+ * All outputs are the same monitor model, as on a video wall, so that the code telling identical
+ * outputs apart is part of the measurement. Run with -csv or -o <file>,csv for machine-readable
+ * results, the benchmark-generator target does so.
+ */
+class BenchGenerator : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void idealConfig_data();
+    void idealConfig();
+    void displaySwitch_data();
+    void displaySwitch();
+    void cloneScreens_data();
+    void cloneScreens();
+    void extendToRight_data();
+    void extendToRight();
+    void readInOutputs_data();
+    void readInOutputs();
+    void readFile_data();
+    void readFile();
+    void writeFile_data();
+    void writeFile();
+
+private:
+    static void addTopologies();
+    static KScreen::ConfigPtr createTopology(int outputCount, int modeCount);
+    // A topology as the daemon sees it once the generator initialized it
+    static KScreen::ConfigPtr idealTopology();
+};
+
+void BenchGenerator::addTopologies()
+{
+    QTest::addColumn<int>("outputCount");
+    QTest::addColumn<int>("modeCount");
+
+    for (int outputCount : {1, 2, 4, 8, 16, 32, 64}) {
+        for (int modeCount : {10, 100, 300}) {
+            QTest::addRow("%d outputs, %d modes", outputCount, modeCount) << outputCount << modeCount;
+        }
+    }
+}
+
+KScreen::ConfigPtr BenchGenerator::createTopology(int outputCount, int modeCount)
+{
+    // The EDID of a DELL U2410
+    static const QByteArray edid = QByteArray::fromBase64(
+        "AP///////wAQrBbwTExLQQ4WAQOANCB46h7Frk80sSYOUFSlSwCBgKlA0QBxTwEBAQEBAQEBKDyAoHCwI0AwIDYABkQhAAAaAAAA/wBGNTI1TTI0NUFLTEwKAAAA/ABERUxMIFUyNDEwCiAgAAAA/"
+        "QA4TB5REQAKICAgICAgAToCAynxUJAFBAMCBxYBHxITFCAVEQYjCQcHZwMMABAAOC2DAQAA4wUDAQI6gBhxOC1AWCxFAAZEIQAAHgEdgBhxHBYgWCwlAAZEIQAAngEdAHJR0B4gbihVAAZEIQAAHow"
+        "K0Iog4C0QED6WAAZEIQAAGAAAAAAAAAAAAAAAAAAAPg==");
+    static const QList<float> refreshRates({60.0, 59.94, 50.0, 75.0, 120.0, 144.0});
+
+    KScreen::ModeList modes;
+    QString preferredModeId;
+    for (int i = 0; i < modeCount; ++i) {
+        const int step = i / refreshRates.count();
+        KScreen::ModePtr mode = KScreen::ModePtr::create();
+        mode->setId(QString::number(i));
+        mode->setSize(QSize(640 + step * 64, 480 + step * 36));
+        mode->setRefreshRate(refreshRates.at(i % refreshRates.count()));
+        mode->setName(QStringLiteral("%1x%2").arg(mode->size().width()).arg(mode->size().height()));
+        modes.insert(mode->id(), mode);
+        if (i % refreshRates.count() == 0) {
+            preferredModeId = mode->id();
+        }
+    }
+
+    KScreen::ScreenPtr screen = KScreen::ScreenPtr::create();
+    screen->setMinSize(QSize(8, 8));
+    // Large walls exceed it and take the fallback path of the generator, like on X11
+    screen->setMaxSize(QSize(32768, 32768));
+    screen->setMaxActiveOutputsCount(outputCount);
+
+    KScreen::ConfigPtr config = KScreen::ConfigPtr::create();
+    config->setScreen(screen);
+    config->setSupportedFeatures(KScreen::Config::Feature::Writable | KScreen::Config::Feature::PrimaryDisplay
+                                 | KScreen::Config::Feature::PerOutputScaling);
+    for (int i = 0; i < outputCount; ++i) {
+        KScreen::OutputPtr output = KScreen::OutputPtr::create();
+        output->setId(i + 1);
+        output->setName(QStringLiteral("DP-%1").arg(i + 1));
+        output->setType(KScreen::Output::DisplayPort);
+        output->setEdid(edid);
+        output->setSizeMm(QSize(520, 320));
+        output->setConnected(true);
+        output->setEnabled(false);
+        output->setModes(modes);
+        output->setPreferredModes({preferredModeId});
+        config->addOutput(output);
+    }
+    return config;
+}
+
+KScreen::ConfigPtr BenchGenerator::idealTopology()
+{
+    QFETCH(int, outputCount);
+    QFETCH(int, modeCount);
+
+    const KScreen::ConfigPtr config = createTopology(outputCount, modeCount);
+    Generator::self()->setCurrentConfig(config);
+    return Generator::self()->idealConfig(config);
+}
+
+void BenchGenerator::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QDir(Globals::dirPath()).removeRecursively();
+    qputenv("KSCREEN_LOGGING", "false");
+    Generator::self()->setForceNotLaptop(true);
+}
+
+void BenchGenerator::cleanupTestCase()
+{
+    QDir(Globals::dirPath()).removeRecursively();
+    Generator::destroy();
+}
+
+void BenchGenerator::idealConfig_data()
+{
+    addTopologies();
+}
+
+void BenchGenerator::idealConfig()
+{
+    QFETCH(int, outputCount);
+    QFETCH(int, modeCount);
+
+    const KScreen::ConfigPtr config = createTopology(outputCount, modeCount);
+    Generator *generator = Generator::self();
+    generator->setCurrentConfig(config);
+
+    QBENCHMARK {
+        generator->idealConfig(config);
+    }
+}
+
+void BenchGenerator::displaySwitch_data()
+{
+    addTopologies();
+}
+
+void BenchGenerator::displaySwitch()
+{
+    // Switches the current config in place, which ends up the same for every iteration
+    Generator *generator = Generator::self();
+    generator->setCurrentConfig(idealTopology());
+
+    QBENCHMARK {
+        generator->displaySwitch(Generator::Clone);
+    }
+}
+
+void BenchGenerator::cloneScreens_data()
+{
+    addTopologies();
+}
+
+void BenchGenerator::cloneScreens()
+{
+    const KScreen::ConfigPtr config = idealTopology();
+
+    QBENCHMARK {
+        Generator::self()->cloneScreens(config);
+    }
+}
+
+void BenchGenerator::extendToRight_data()
+{
+    addTopologies();
+}
+
+void BenchGenerator::extendToRight()
+{
+    KScreen::ConfigPtr config = idealTopology();
+    const KScreen::OutputList outputs = config->connectedOutputs();
+
+    QBENCHMARK {
+        Generator::self()->extendToRight(config, outputs);
+    }
+}
+
+void BenchGenerator::readInOutputs_data()
+{
+    addTopologies();
+}
+
+void BenchGenerator::readInOutputs()
+{
+    const KScreen::ConfigPtr config = idealTopology();
+    Config configWrapper(config);
+    QVERIFY(configWrapper.writeFile());
+    const auto outputsInfo = Storage::readValue(Config::configsDirPath() % configWrapper.id());
+    QVERIFY(outputsInfo);
+    const Schema::Layout infos = Schema::decodeLayout(*outputsInfo);
+    QCOMPARE(infos.count(), config->connectedOutputs().count());
+
+    QBENCHMARK {
+        Output::readInOutputs(config, infos);
+    }
+}
+
+void BenchGenerator::readFile_data()
+{
+    addTopologies();
+}
+
+void BenchGenerator::readFile()
+{
+    // Layouts are served from the LayoutCache after the first read, as in the daemon
+    Config configWrapper(idealTopology());
+    QVERIFY(configWrapper.writeFile());
+
+    QBENCHMARK {
+        QVERIFY(configWrapper.readFile());
+    }
+}
+
+void BenchGenerator::writeFile_data()
+{
+    addTopologies();
+}
+
+void BenchGenerator::writeFile()
+{
+    // Unchanged files aren't written again after the first iteration, as in the daemon
+    Config configWrapper(idealTopology());
+
+    QBENCHMARK {
+        QVERIFY(configWrapper.writeFile());
+    }
+}
+
+QTEST_MAIN(BenchGenerator)
+
+#include "benchgenerator.moc"
@@ -5,7 +5,10 @@
     SPDX-License-Identifier: GPL-2.0-or-later
 */
 #include "../../kded/config.h"
-#include "../../common/globals.h"
+#include "../../kded/configdiff.h"
+#include "../../common/outputidentity.h"
+#include "../../common/schema.h"
+#include "../../common/storage.h"
 
 #include <QObject>
 #include <QStandardPaths>
@@ -37,6 +40,10 @@ private Q_SLOTS:
     void testNullConfig();
     void testIdenticalOutputs();
     void testMoveConfig();
+    void testBinaryConfig();
+    void testSchema();
+    void testConfigDiff();
+    void testWriteDeduplication();
     void testFixedConfig();
 
 private:
@@ -362,6 +369,31 @@ void TestConfig::testIdenticalOutputs()
     config->addOutput(output3);
     config->addOutput(output1);
 
+    const OutputIdentityTable identities(config->outputs());
+    QCOMPARE(identities.identities().count(), 6);
+    QCOMPARE(identities.outputIds(output1->hashMd5()), QList<int>({1, 2, 3, 4, 5, 6}));
+    QCOMPARE(identities.find(output1->hashMd5(), QStringLiteral("DVI-0")).value_or(0), 6);
+    QVERIFY(!identities.find(output1->hashMd5(), QStringLiteral("HDMI-0")));
+    QVERIFY(identities.isDuplicate(output1->hashMd5()));
+    QCOMPARE(identities.identity(5)->name, QStringLiteral("DVI-1"));
+    QCOMPARE(identities.identity(5)->hash, output5->hash());
+    QVERIFY(identities.identity(5)->connectedDuplicate);
+    QVERIFY(!identities.identity(7));
+
+    // Only connected duplicates need telling apart by the connector when reading a config
+    output2->setConnected(false);
+    output3->setConnected(false);
+    output4->setConnected(false);
+    output5->setConnected(false);
+    output6->setConnected(false);
+    const OutputIdentityTable disconnected(config->outputs());
+    QVERIFY(disconnected.identity(1)->duplicate);
+    QVERIFY(!disconnected.identity(1)->connectedDuplicate);
+    QVERIFY(!disconnected.identity(2)->connectedDuplicate);
+    for (const KScreen::OutputPtr &output : {output2, output3, output4, output5, output6}) {
+        output->setConnected(true);
+    }
+
     Config configWrapper(config);
 
     QHash<QString, QPoint> positions;
@@ -478,6 +510,158 @@ void TestConfig::testMoveConfig()
     QCOMPARE(output2->isPrimary(), false);
 }
 
+void TestConfig::testBinaryConfig()
+{
+    // A config converted to CBOR must read back exactly like the JSON file it came from
+    const auto json = Storage::readFile(Config::configsDirPath() % QStringLiteral("twoScreenConfig.json"));
+    QVERIFY(json);
+    QVERIFY(json->isValid());
+
+    const QByteArray cbor = Storage::encode(*json, Storage::Format::Cbor);
+    QVERIFY(cbor.size() < Storage::encode(*json, Storage::Format::Json).size());
+
+    const QString cborPath = Config::configsDirPath() % QStringLiteral("twoScreenConfig.cbor");
+    QFile cborFile(cborPath);
+    QVERIFY(cborFile.open(QIODevice::WriteOnly));
+    cborFile.write(cbor);
+    cborFile.close();
+
+    auto configWrapper = createConfig(true, true);
+    configWrapper = configWrapper->readFile(QStringLiteral("twoScreenConfig.cbor"));
+    cborFile.remove();
+    QVERIFY(configWrapper);
+
+    auto config = configWrapper->data();
+    QCOMPARE(config->connectedOutputs().count(), 2);
+    auto output = config->connectedOutputs().first();
+    QCOMPARE(output->name(), QLatin1String("OUTPUT-1"));
+    QCOMPARE(output->currentModeId(), QLatin1String("MODE-4"));
+    QCOMPARE(output->pos(), QPoint(0, 0));
+    QCOMPARE(output->isPrimary(), true);
+    auto output2 = config->connectedOutputs().last();
+    QCOMPARE(output2->name(), QLatin1String("OUTPUT-2"));
+    QCOMPARE(output2->currentModeId(), QLatin1String("MODE-3"));
+    QCOMPARE(output2->pos(), QPoint(1920, 0));
+    QCOMPARE(output2->isPrimary(), false);
+
+    // Unknown versions are not guessed at
+    QVERIFY(!Storage::decode(QByteArray::fromHex("d9d9f78202f6")).isValid());
+}
+
+void TestConfig::testSchema()
+{
+    const auto data = Storage::readValue(Config::configsDirPath() % QStringLiteral("twoScreenConfig.json"));
+    QVERIFY(data);
+    const Schema::Layout layout = Schema::decodeLayout(*data);
+    QCOMPARE(layout.count(), 2);
+
+    const Schema::OutputRecord &output = layout.first();
+    QCOMPARE(output.id, QStringLiteral("OUTPUT-1"));
+    QCOMPARE(output.metadata.value_or(Schema::OutputMetadata()).name, QStringLiteral("OUTPUT-1"));
+    QCOMPARE(output.enabled.value_or(false), true);
+    QCOMPARE(output.primary.value_or(false), true);
+    QVERIFY(!output.priority);
+    QCOMPARE(output.pos.value_or(QPoint(-1, -1)), QPoint(0, 0));
+    QCOMPARE(output.rotation.value_or(0), 1);
+    QVERIFY(!output.scale);
+    QVERIFY(output.mode);
+    QCOMPARE(output.mode->size, QSize(1920, 1080));
+    QVERIFY(output.mode->key() == ModeKey::of(QSize(1920, 1080), 60.0));
+    QCOMPARE(layout.last().pos.value_or(QPoint()), QPoint(1920, 0));
+
+    // Written back, the file keeps its bytes
+    const QVariant variant = Storage::readFile(Config::configsDirPath() % QStringLiteral("twoScreenConfig.json")).value_or(QVariant());
+    QCOMPARE(Storage::encodeValue(Schema::encodeLayout(layout), Storage::Format::Json), Storage::encode(variant, Storage::Format::Json));
+    QVERIFY(Schema::decodeLayout(Storage::decodeValue(Storage::encodeValue(Schema::encodeLayout(layout), Storage::Format::Cbor))) == layout);
+
+    // Keys of other versions survive a round trip, and global data written over them
+    QCborMap map = layout.first().encode();
+    map.insert(QStringLiteral("future"), 42);
+    Schema::OutputRecord record = Schema::OutputRecord::decode(map);
+    QCOMPARE(record.extra.value(QStringLiteral("future")).toInteger(), qint64(42));
+    Schema::OutputRecord update;
+    update.scale = 2.0;
+    record.update(update);
+    QCOMPARE(record.scale.value_or(0), 2.0);
+    QCOMPARE(record.rotation.value_or(0), 1);
+    QCOMPARE(record.encode().value(QStringLiteral("future")).toInteger(), qint64(42));
+    // They are written in alphabetical order along with the known keys, like QVariantMap did
+    map.insert(QStringLiteral("replicate-hash"), QStringLiteral("abc"));
+    const QCborMap sorted = QCborMap::fromVariantMap(map.toVariantMap());
+    QCOMPARE(Schema::OutputRecord::decode(map).encode().toCborValue().toCbor(), sorted.toCborValue().toCbor());
+
+    // Corrupt content decodes to empty records rather than failing
+    QVERIFY(Schema::OutputRecord::decode(QCborValue(QStringLiteral("garbage"))).isEmpty());
+    QVERIFY(Schema::decodeLayout(QCborMap()).isEmpty());
+
+    const auto control = Storage::readValue(QStringLiteral(TEST_DATA "serializerdata/control/configs/8684e883209d7644eb76feea2081c431"));
+    QVERIFY(control);
+    const Schema::ControlRecord controlRecord = Schema::ControlRecord::decode(*control);
+    QCOMPARE(controlRecord.outputs.count(), 2);
+    QCOMPARE(controlRecord.outputs.first().id, QStringLiteral("OUTPUT-1"));
+    QCOMPARE(controlRecord.outputs.first().extra.value(QStringLiteral("retention")).toInteger(), qint64(1));
+    QVERIFY(Schema::ControlRecord::decode(controlRecord.encode()) == controlRecord);
+    QVERIFY(Schema::ControlRecord().encode().isEmpty());
+}
+
+void TestConfig::testConfigDiff()
+{
+    auto configWrapper = createConfig(true, true);
+    configWrapper = configWrapper->readFile(QStringLiteral("twoScreenConfig.json"));
+    QVERIFY(configWrapper);
+    const KScreen::ConfigPtr current = configWrapper->data();
+
+    // Reading the same file again results in nothing to do
+    const KScreen::ConfigPtr same = configWrapper->readFile(QStringLiteral("twoScreenConfig.json"))->data();
+    QVERIFY(ConfigDiff(current, same).isEmpty());
+    QVERIFY(ConfigDiff(current, current->clone()).isEmpty());
+
+    KScreen::ConfigPtr target = current->clone();
+    target->output(2)->setPos(QPoint(1920, 100));
+    target->output(2)->setCurrentModeId(QStringLiteral("MODE-2"));
+    target->output(1)->setVrrPolicy(KScreen::Output::VrrPolicy::Never);
+    ConfigDiff diff(current, target);
+    QVERIFY(!diff.isEmpty());
+    QCOMPARE(diff.changes().value(1), ConfigDiff::Properties(ConfigDiff::VrrPolicy));
+    QCOMPARE(diff.changes().value(2), ConfigDiff::Position | ConfigDiff::Mode);
+
+    // Once an output is disabled, nothing else about it matters
+    target = current->clone();
+    target->output(2)->setEnabled(false);
+    target->output(2)->setScale(2.0);
+    diff = ConfigDiff(current, target);
+    QCOMPARE(diff.changes().value(2), ConfigDiff::Properties(ConfigDiff::Enabled));
+    QVERIFY(ConfigDiff(target, target->clone()).isEmpty());
+
+    target = current->clone();
+    target->removeOutput(2);
+    diff = ConfigDiff(current, target);
+    QCOMPARE(diff.changes().keys(), QList<int>{2});
+    QCOMPARE(diff.changes().value(2), ConfigDiff::Properties(ConfigDiff::Presence));
+}
+
+void TestConfig::testWriteDeduplication()
+{
+    const QString path = m_temporaryDir.filePath(QStringLiteral("dedup"));
+    const QVariantMap data{{QStringLiteral("scale"), 1.5}};
+    Storage::resetWriteStatistics();
+
+    QVERIFY(Storage::writeFile(path, data));
+    QVERIFY(Storage::writeFile(path, data));
+    QCOMPARE(Storage::writeStatistics().performed, quint64(1));
+    QCOMPARE(Storage::writeStatistics().skipped, quint64(1));
+
+    // Changes by somebody else are not overlooked
+    QFile::remove(path);
+    QVERIFY(Storage::writeFile(path, data));
+    QCOMPARE(Storage::writeStatistics().performed, quint64(2));
+    QVERIFY(QFile::exists(path));
+
+    QVERIFY(Storage::writeFile(path, QVariantMap{{QStringLiteral("scale"), 2.0}}));
+    QCOMPARE(Storage::writeStatistics().performed, quint64(3));
+    QCOMPARE(Storage::readFile(path).value_or(QVariant()).toMap().value(QStringLiteral("scale")).toDouble(), 2.0);
+}
+
 void TestConfig::testFixedConfig()
 {
     // Load a dualhead config
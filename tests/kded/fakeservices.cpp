@@ -0,0 +1,289 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "fakeservices.h"
+
+#include <QDBusError>
+#include <QDBusMessage>
+#include <QDebug>
+
+#include <utility>
+
+static const QString s_connectionName = QStringLiteral("kscreen-fake-services");
+static const QString s_upowerService = QStringLiteral("org.freedesktop.UPower");
+static const QString s_upowerPath = QStringLiteral("/org/freedesktop/UPower");
+static const QString s_powerManagementService = QStringLiteral("org.kde.Solid.PowerManagement");
+static const QString s_suspendSessionPath = QStringLiteral("/org/kde/Solid/PowerManagement/Actions/SuspendSession");
+static const QString s_handleButtonEventsPath = QStringLiteral("/org/kde/Solid/PowerManagement/Actions/HandleButtonEvents");
+static const QString s_login1Service = QStringLiteral("org.freedesktop.login1");
+static const QString s_login1Path = QStringLiteral("/org/freedesktop/login1");
+
+FakeUPower::FakeUPower(const QDBusConnection &connection)
+    : QObject()
+    , m_connection(connection)
+{
+}
+
+bool FakeUPower::lidIsPresent() const
+{
+    return m_lidIsPresent;
+}
+
+bool FakeUPower::lidIsClosed() const
+{
+    return m_lidIsClosed;
+}
+
+bool FakeUPower::onBattery() const
+{
+    return m_onBattery;
+}
+
+void FakeUPower::setLidPresent(bool present)
+{
+    if (m_lidIsPresent != present) {
+        m_lidIsPresent = present;
+        notifyChanged(QStringLiteral("LidIsPresent"), present);
+    }
+}
+
+void FakeUPower::setLidClosed(bool closed)
+{
+    if (m_lidIsClosed != closed) {
+        m_lidIsClosed = closed;
+        notifyChanged(QStringLiteral("LidIsClosed"), closed);
+    }
+}
+
+void FakeUPower::setOnBattery(bool onBattery)
+{
+    if (m_onBattery != onBattery) {
+        m_onBattery = onBattery;
+        notifyChanged(QStringLiteral("OnBattery"), onBattery);
+    }
+}
+
+void FakeUPower::invalidateOnBattery(bool onBattery)
+{
+    m_onBattery = onBattery;
+    QDBusMessage message = QDBusMessage::createSignal(s_upowerPath, QStringLiteral("org.freedesktop.DBus.Properties"), QStringLiteral("PropertiesChanged"));
+    message << s_upowerService << QVariantMap() << QStringList{QStringLiteral("OnBattery")};
+    m_connection.send(message);
+}
+
+void FakeUPower::notifyChanged(const QString &property, bool value)
+{
+    QDBusMessage message = QDBusMessage::createSignal(s_upowerPath, QStringLiteral("org.freedesktop.DBus.Properties"), QStringLiteral("PropertiesChanged"));
+    message << s_upowerService << QVariantMap{{property, value}} << QStringList();
+    m_connection.send(message);
+}
+
+void FakeSuspendSession::suspend()
+{
+    Q_EMIT aboutToSuspend();
+}
+
+void FakeSuspendSession::resume()
+{
+    Q_EMIT resumingFromSuspend();
+}
+
+int FakeHandleButtonEvents::lidAction() const
+{
+    return m_lidAction;
+}
+
+bool FakeHandleButtonEvents::triggersLidAction() const
+{
+    return m_triggersLidAction;
+}
+
+void FakeHandleButtonEvents::setLidAction(int action)
+{
+    m_lidAction = action;
+}
+
+void FakeHandleButtonEvents::setTriggersLidAction(bool triggers)
+{
+    m_triggersLidAction = triggers;
+}
+
+QString FakeLogin1Manager::blockInhibited() const
+{
+    return m_blockInhibited;
+}
+
+QString FakeLogin1Manager::handleLidSwitch() const
+{
+    return m_handleLidSwitch;
+}
+
+QString FakeLogin1Manager::handleLidSwitchDocked() const
+{
+    return QStringLiteral("ignore");
+}
+
+bool FakeLogin1Manager::isDocked() const
+{
+    return false;
+}
+
+void FakeLogin1Manager::setBlockInhibited(const QString &blockInhibited)
+{
+    m_blockInhibited = blockInhibited;
+}
+
+void FakeLogin1Manager::setHandleLidSwitch(const QString &handleLidSwitch)
+{
+    m_handleLidSwitch = handleLidSwitch;
+}
+
+FakeServices::FakeServices()
+{
+    m_thread.setObjectName(QStringLiteral("FakeServices"));
+    m_upowerThread.setObjectName(QStringLiteral("FakeUPower"));
+}
+
+FakeServices::~FakeServices()
+{
+    QDBusConnection connection(s_connectionName);
+    if (connection.isConnected()) {
+        connection.unregisterService(s_upowerService);
+        connection.unregisterService(s_powerManagementService);
+        connection.unregisterService(s_login1Service);
+        connection.unregisterObject(s_upowerPath);
+        connection.unregisterObject(s_suspendSessionPath);
+        connection.unregisterObject(s_handleButtonEventsPath);
+        connection.unregisterObject(s_login1Path);
+    }
+    releaseUPower();
+    m_thread.quit();
+    m_thread.wait();
+    m_upowerThread.quit();
+    m_upowerThread.wait();
+    QDBusConnection::disconnectFromBus(s_connectionName);
+}
+
+bool FakeServices::start()
+{
+    QDBusConnection connection = QDBusConnection::connectToBus(QDBusConnection::SessionBus, s_connectionName);
+    if (!connection.isConnected()) {
+        qWarning() << "Could not connect to the test bus:" << connection.lastError().message();
+        return false;
+    }
+
+    m_upower = new FakeUPower(connection);
+    m_suspendSession = new FakeSuspendSession();
+    m_handleButtonEvents = new FakeHandleButtonEvents();
+    m_login1Manager = new FakeLogin1Manager();
+    m_upower->moveToThread(&m_upowerThread);
+    QObject::connect(&m_upowerThread, &QThread::finished, m_upower, &QObject::deleteLater);
+    m_upowerThread.start();
+    for (QObject *service : {static_cast<QObject *>(m_suspendSession),
+                             static_cast<QObject *>(m_handleButtonEvents),
+                             static_cast<QObject *>(m_login1Manager)}) {
+        service->moveToThread(&m_thread);
+        QObject::connect(&m_thread, &QThread::finished, service, &QObject::deleteLater);
+    }
+    m_thread.start();
+
+    return connection.registerObject(s_upowerPath, m_upower, QDBusConnection::ExportAllProperties)
+        && connection.registerObject(s_suspendSessionPath, m_suspendSession, QDBusConnection::ExportAllSignals)
+        && connection.registerObject(s_handleButtonEventsPath, m_handleButtonEvents, QDBusConnection::ExportScriptableSlots)
+        && connection.registerObject(s_login1Path, m_login1Manager, QDBusConnection::ExportAllProperties)
+        && connection.registerService(s_upowerService) && connection.registerService(s_powerManagementService)
+        && connection.registerService(s_login1Service);
+}
+
+void FakeServices::setLidPresent(bool present)
+{
+    invoke(m_upower, "setLidPresent", present);
+}
+
+void FakeServices::setLidClosed(bool closed)
+{
+    invoke(m_upower, "setLidClosed", closed);
+}
+
+void FakeServices::setOnBattery(bool onBattery)
+{
+    invoke(m_upower, "setOnBattery", onBattery);
+}
+
+void FakeServices::invalidateOnBattery(bool onBattery)
+{
+    invoke(m_upower, "invalidateOnBattery", onBattery);
+}
+
+void FakeServices::suspend()
+{
+    invoke(m_suspendSession, "suspend");
+}
+
+void FakeServices::resume()
+{
+    invoke(m_suspendSession, "resume");
+}
+
+void FakeServices::setLidAction(int action)
+{
+    invoke(m_handleButtonEvents, "setLidAction", action);
+}
+
+void FakeServices::setTriggersLidAction(bool triggers)
+{
+    invoke(m_handleButtonEvents, "setTriggersLidAction", triggers);
+}
+
+void FakeServices::setBlockInhibited(const QString &blockInhibited)
+{
+    invoke(m_login1Manager, "setBlockInhibited", blockInhibited);
+}
+
+void FakeServices::setHandleLidSwitch(const QString &handleLidSwitch)
+{
+    invoke(m_login1Manager, "setHandleLidSwitch", handleLidSwitch);
+}
+
+void FakeServices::holdUPower()
+{
+    if (std::exchange(m_upowerHeld, true)) {
+        return;
+    }
+    // Blocks the thread, calls pile up in its event queue until it goes on
+    QMetaObject::invokeMethod(m_upower, [this]() {
+        m_upowerReleased.acquire();
+    });
+}
+
+void FakeServices::releaseUPower()
+{
+    if (std::exchange(m_upowerHeld, false)) {
+        m_upowerReleased.release();
+    }
+}
+
+void FakeServices::invoke(QObject *object, const char *method, bool argument)
+{
+    // Blocks until the signal is on the bus, so that measurements start after it was sent
+    QMetaObject::invokeMethod(object, method, Qt::BlockingQueuedConnection, Q_ARG(bool, argument));
+}
+
+void FakeServices::invoke(QObject *object, const char *method, int argument)
+{
+    QMetaObject::invokeMethod(object, method, Qt::BlockingQueuedConnection, Q_ARG(int, argument));
+}
+
+void FakeServices::invoke(QObject *object, const char *method, const QString &argument)
+{
+    QMetaObject::invokeMethod(object, method, Qt::BlockingQueuedConnection, Q_ARG(QString, argument));
+}
+
+void FakeServices::invoke(QObject *object, const char *method)
+{
+    QMetaObject::invokeMethod(object, method, Qt::BlockingQueuedConnection);
+}
+
+#include "moc_fakeservices.cpp"
@@ -0,0 +1,179 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QDBusConnection>
+#include <QObject>
+#include <QSemaphore>
+#include <QThread>
+
+/**
+ * Stands in for org.freedesktop.UPower.
+ */
+class FakeUPower : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.UPower")
+    Q_PROPERTY(bool LidIsPresent READ lidIsPresent)
+    Q_PROPERTY(bool LidIsClosed READ lidIsClosed)
+    Q_PROPERTY(bool OnBattery READ onBattery)
+
+public:
+    explicit FakeUPower(const QDBusConnection &connection);
+
+    bool lidIsPresent() const;
+    bool lidIsClosed() const;
+    bool onBattery() const;
+
+public Q_SLOTS:
+    void setLidPresent(bool present);
+    void setLidClosed(bool closed);
+    void setOnBattery(bool onBattery);
+    // Announces the change without the value, which UPower doesn't do but is allowed to
+    void invalidateOnBattery(bool onBattery);
+
+private:
+    void notifyChanged(const QString &property, bool value);
+
+    QDBusConnection m_connection;
+    bool m_lidIsPresent = true;
+    bool m_lidIsClosed = false;
+    bool m_onBattery = false;
+};
+
+/**
+ * Stands in for PowerDevil's SuspendSession action.
+ */
+class FakeSuspendSession : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.Solid.PowerManagement.Actions.SuspendSession")
+
+public:
+    using QObject::QObject;
+
+public Q_SLOTS:
+    void suspend();
+    void resume();
+
+Q_SIGNALS:
+    void aboutToSuspend();
+    void resumingFromSuspend();
+};
+
+/**
+ * Stands in for PowerDevil's HandleButtonEvents action, as far as the lid is concerned.
+ */
+class FakeHandleButtonEvents : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.Solid.PowerManagement.Actions.HandleButtonEvents")
+
+public:
+    using QObject::QObject;
+
+public Q_SLOTS:
+    // Only these are on the bus
+    Q_SCRIPTABLE int lidAction() const;
+    Q_SCRIPTABLE bool triggersLidAction() const;
+
+    void setLidAction(int action);
+    void setTriggersLidAction(bool triggers);
+
+private:
+    int m_lidAction = 1; // SuspendToRam
+    // PowerDevil doesn't act on the lid while an external screen is connected
+    bool m_triggersLidAction = false;
+};
+
+/**
+ * Stands in for the lid related properties of logind's Manager.
+ */
+class FakeLogin1Manager : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.login1.Manager")
+    Q_PROPERTY(QString BlockInhibited READ blockInhibited)
+    Q_PROPERTY(QString HandleLidSwitch READ handleLidSwitch)
+    Q_PROPERTY(QString HandleLidSwitchDocked READ handleLidSwitchDocked)
+    Q_PROPERTY(bool Docked READ isDocked)
+
+public:
+    using QObject::QObject;
+
+    QString blockInhibited() const;
+    QString handleLidSwitch() const;
+    QString handleLidSwitchDocked() const;
+    bool isDocked() const;
+
+public Q_SLOTS:
+    void setBlockInhibited(const QString &blockInhibited);
+    void setHandleLidSwitch(const QString &handleLidSwitch);
+    /**
+     * Leaves the calls to UPower unanswered until releaseUPower(), e.g. to tell what the daemon
+     * does before the Device is ready.
+     */
+    void holdUPower();
+    void releaseUPower();
+
+private:
+    QString m_blockInhibited;
+    QString m_handleLidSwitch = QStringLiteral("suspend");
+};
+
+/**
+ * Owns the fake services and runs them on a thread of their own.
+ *
+ * They are meant for a test running on a bus of its own, see dbus-run-session, which also serves
+ * as the system bus so that UPower and logind are found where Device looks for them.
+ *
+ * The services are registered on a connection of their own as well, so that the daemon's calls go
+ * through the bus like they would in a real session and blocking calls made during the daemon's
+ * startup, like the introspection done by QDBusInterface, don't dead-lock the test.
+ *
+ * UPower runs on a thread of its own, so that holdUPower() can keep it from answering while the
+ * other services keep going.
+ */
+class FakeServices
+{
+public:
+    FakeServices();
+    ~FakeServices();
+
+    bool start();
+
+    void setLidPresent(bool present);
+    void setLidClosed(bool closed);
+    void setOnBattery(bool onBattery);
+    void invalidateOnBattery(bool onBattery);
+    void suspend();
+    void resume();
+    /**
+     * PowerDevil's PowerButtonAction for the lid, e.g. 1 for SuspendToRam or 0 for NoAction.
+     */
+    void setLidAction(int action);
+    void setTriggersLidAction(bool triggers);
+    /**
+     * Colon separated, like logind's, e.g. "sleep:handle-lid-switch".
+     */
+    void setBlockInhibited(const QString &blockInhibited);
+    void setHandleLidSwitch(const QString &handleLidSwitch);
+
+private:
+    void invoke(QObject *object, const char *method, bool argument);
+    void invoke(QObject *object, const char *method, int argument);
+    void invoke(QObject *object, const char *method, const QString &argument);
+    void invoke(QObject *object, const char *method);
+
+    QThread m_thread;
+    QThread m_upowerThread;
+    QSemaphore m_upowerReleased;
+    bool m_upowerHeld = false;
+    FakeUPower *m_upower = nullptr;
+    FakeSuspendSession *m_suspendSession = nullptr;
+    FakeHandleButtonEvents *m_handleButtonEvents = nullptr;
+    FakeLogin1Manager *m_login1Manager = nullptr;
+};
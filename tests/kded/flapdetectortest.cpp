@@ -0,0 +1,48 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "../../kded/flapdetector.h"
+
+#include <QObject>
+#include <QSignalSpy>
+#include <QTest>
+
+class TestFlapDetector : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testQuarantine();
+};
+
+void TestFlapDetector::testQuarantine()
+{
+    FlapDetector detector;
+    QSignalSpy released(&detector, &FlapDetector::released);
+    const QString connector = QStringLiteral("HDMI-1");
+
+    for (int i = 1; i < FlapDetector::FlapThreshold; ++i) {
+        QVERIFY(detector.addToggle(connector));
+    }
+    QVERIFY(!detector.addToggle(connector));
+    QVERIFY(detector.isQuarantined(connector));
+    QCOMPARE(detector.quarantined(), QStringList{connector});
+    QVERIFY(!detector.addToggle(connector));
+    // Other connectors are not affected
+    QVERIFY(detector.addToggle(QStringLiteral("DP-1")));
+
+    QCOMPARE(detector.toggleCount(), quint64(FlapDetector::FlapThreshold + 2));
+    QCOMPARE(detector.suppressedCount(), quint64(2));
+    QCOMPARE(detector.quarantineCount(), quint64(1));
+
+    // Toggled during the quarantine, so it is extended with twice the time
+    QVERIFY(!released.wait(FlapDetector::BaseBackoff + 500));
+    QVERIFY(detector.remainingQuarantine(connector) > FlapDetector::BaseBackoff);
+    QCOMPARE(detector.quarantineCount(), quint64(2));
+}
+
+QTEST_GUILESS_MAIN(TestFlapDetector)
+
+#include "flapdetectortest.moc"
@@ -0,0 +1,162 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "../../common/globals.h"
+#include "../../common/schema.h"
+#include "../../common/storage.h"
+#include "../../kded/config.h"
+#include "../../kded/layoutcache.h"
+#include "../../kded/layoutindex.h"
+
+#include <QDir>
+#include <QObject>
+#include <QStringBuilder>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <KScreen/Config>
+#include <KScreen/Mode>
+#include <KScreen/Output>
+#include <KScreen/Screen>
+
+#include <memory>
+#include <tuple>
+
+class TestLayoutIndex : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testNearestLayout();
+    void testLidOpen();
+
+private:
+    std::unique_ptr<Config> createConfig();
+    static QString writeLayout(QChar digit, const QList<std::tuple<QString, QPoint, bool>> &outputs);
+
+    QTemporaryDir m_temporaryDir;
+};
+
+void TestLayoutIndex::initTestCase()
+{
+    qputenv("XDG_DATA_HOME", m_temporaryDir.path().toUtf8());
+    qputenv("KSCREEN_LOGGING", "false");
+    QVERIFY(QDir().mkpath(Config::configsDirPath()));
+    // The watch tells the index about files changed by somebody else
+    Globals::watchPaths({Config::configsDirPath()});
+    LayoutCache::self();
+}
+
+// OUTPUT-1 and OUTPUT-2, both connected and without EDID
+std::unique_ptr<Config> TestLayoutIndex::createConfig()
+{
+    KScreen::ScreenPtr screen = KScreen::ScreenPtr::create();
+    screen->setCurrentSize(QSize(1920, 1080));
+    screen->setMaxSize(QSize(32768, 32768));
+    screen->setMinSize(QSize(8, 8));
+
+    KScreen::ModePtr mode = KScreen::ModePtr::create();
+    mode->setId(QStringLiteral("MODE-0"));
+    mode->setSize(QSize(1920, 1280));
+    mode->setRefreshRate(60.0);
+
+    KScreen::ConfigPtr config = KScreen::ConfigPtr::create();
+    config->setScreen(screen);
+    for (int id = 1; id <= 2; ++id) {
+        KScreen::OutputPtr output = KScreen::OutputPtr::create();
+        output->setId(id);
+        output->setName(QStringLiteral("OUTPUT-%1").arg(id));
+        output->setConnected(true);
+        output->setEnabled(true);
+        output->setModes({{mode->id(), mode}});
+        config->addOutput(output);
+    }
+    return std::unique_ptr<Config>(new Config(config));
+}
+
+QString TestLayoutIndex::writeLayout(QChar digit, const QList<std::tuple<QString, QPoint, bool>> &outputs)
+{
+    const QString id(32, digit);
+    Schema::Layout layout;
+    for (const auto &[name, pos, enabled] : outputs) {
+        Schema::OutputRecord info;
+        // Without EDID outputs are identified by their connector
+        info.id = name;
+        info.metadata = Schema::OutputMetadata{name, std::nullopt};
+        info.enabled = enabled;
+        info.pos = pos;
+        info.scale = 1.0;
+        info.mode = Schema::ModeRecord{QSize(1920, 1280), 60.0, 60000};
+        layout.append(info);
+    }
+    Storage::writeValue(Config::configsDirPath() % id, Schema::encodeLayout(layout));
+    return id;
+}
+
+void TestLayoutIndex::testNearestLayout()
+{
+    const QString output1 = QStringLiteral("OUTPUT-1");
+    const QString output2 = QStringLiteral("OUTPUT-2");
+    const QString output3 = QStringLiteral("OUTPUT-3");
+    const QString subsetId = writeLayout(QLatin1Char('1'), {{output1, QPoint(0, 0), true}});
+    writeLayout(QLatin1Char('2'), {{output1, QPoint(0, 0), true}, {output3, QPoint(1920, 0), true}});
+    const QString supersetId = writeLayout(QLatin1Char('3'), {{output3, QPoint(0, 0), true}, {output1, QPoint(1920, 0), true}, {output2, QPoint(3840, 0), true}});
+    // Not a layout
+    Storage::writeValue(Config::lastLayoutFilePath(), Schema::LastLayoutRecord{subsetId, {}}.encode());
+
+    auto configWrapper = createConfig();
+    const QList<LayoutIndex::OutputKey> keys = LayoutIndex::keys(configWrapper->data());
+    QCOMPARE(keys.count(), 2);
+
+    // The layout with both outputs wins over the one with only one of them, the one with a
+    // third output that isn't connected either doesn't qualify
+    QCOMPARE(LayoutIndex::self()->nearest(keys).value_or(QString()), supersetId);
+    QCOMPARE(LayoutIndex::self()->count(), 3);
+
+    auto config = configWrapper->readNearestFile();
+    QVERIFY(config);
+    // Moved to the origin, where OUTPUT-3 was
+    QCOMPARE(config->data()->output(1)->pos(), QPoint(0, 0));
+    QCOMPARE(config->data()->output(2)->pos(), QPoint(1920, 0));
+
+    // Files removed by somebody else are dropped from the index once the watch tells
+    QVERIFY(QFile::remove(Config::configsDirPath() % supersetId));
+    QTRY_COMPARE(LayoutIndex::self()->nearest(keys).value_or(QString()), subsetId);
+    config = configWrapper->readNearestFile();
+    QVERIFY(config);
+    QCOMPARE(config->data()->output(1)->pos(), QPoint(0, 0));
+    // Not in the layout, put right of the others
+    QVERIFY(config->data()->output(2)->isEnabled());
+    QCOMPARE(config->data()->output(2)->pos(), QPoint(1920, 0));
+
+    // Sharing only the laptop panel isn't enough
+    const QList<LayoutIndex::OutputKey> panelKeys{{output1, output1, KScreen::Output::Panel}, {QStringLiteral("OUTPUT-9"), QStringLiteral("OUTPUT-9")}};
+    QVERIFY(!LayoutIndex::self()->nearest(panelKeys));
+}
+
+void TestLayoutIndex::testLidOpen()
+{
+    const QString panel = QStringLiteral("eDP-1");
+    const QString external = QStringLiteral("DP-7");
+    // Equally close, the first one wins by name
+    const QString closedId = writeLayout(QLatin1Char('7'), {{panel, QPoint(0, 0), false}, {external, QPoint(0, 0), true}});
+    const QString openId = writeLayout(QLatin1Char('8'), {{panel, QPoint(0, 0), true}, {external, QPoint(1920, 0), true}});
+
+    const QList<LayoutIndex::OutputKey> keys{{panel, panel, KScreen::Output::Panel}, {external, external, KScreen::Output::DisplayPort}};
+    // Written by somebody else after the index was built
+    QTRY_COMPARE(LayoutIndex::self()->nearest(keys, false).value_or(QString()), closedId);
+    // The panel would stay dark while it can be seen
+    QTRY_COMPARE(LayoutIndex::self()->nearest(keys, true).value_or(QString()), openId);
+
+    QVERIFY(QFile::remove(Config::configsDirPath() % openId));
+    QTRY_VERIFY(!LayoutIndex::self()->nearest(keys, true));
+    QCOMPARE(LayoutIndex::self()->nearest(keys, false).value_or(QString()), closedId);
+}
+
+QTEST_MAIN(TestLayoutIndex)
+
+#include "layoutindextest.moc"
@@ -0,0 +1,66 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "../../common/globals.h"
+#include "../../common/storage.h"
+
+#include <QCborMap>
+#include <QDir>
+#include <QObject>
+#include <QStringBuilder>
+#include <QTemporaryDir>
+#include <QTest>
+
+class TestPathCache : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testWatch();
+
+private:
+    QTemporaryDir m_temporaryDir;
+};
+
+void TestPathCache::initTestCase()
+{
+    qputenv("XDG_DATA_HOME", m_temporaryDir.path().toUtf8());
+    qputenv("KSCREEN_LOGGING", "false");
+}
+
+void TestPathCache::testWatch()
+{
+    if (Storage::stateStore()) {
+        QSKIP("Files are kept in the state store");
+    }
+    const QString dir = Globals::dirPath() % QStringLiteral("pathcache/");
+    Globals::watchPaths({dir});
+    const QString name = QStringLiteral("pathcache/output");
+    const QString path = Globals::dirPath() % name;
+
+    QVERIFY(Globals::mkpath(dir));
+    QVERIFY(Globals::findFile(name).isEmpty());
+
+    // Our own writes are seen right away
+    QVERIFY(Storage::writeValue(path, QCborMap{{QStringLiteral("scale"), 2.0}}));
+    QCOMPARE(Globals::findFile(name), path);
+
+    // Those of others once the watch tells
+    QFile::remove(path);
+    QTRY_VERIFY(Globals::findFile(name).isEmpty());
+
+    // Directories removed by others are created again
+    QDir(dir).removeRecursively();
+    QTRY_VERIFY(Globals::mkpath(dir) && QDir(dir).exists());
+
+    Globals::stopWatchingPaths();
+    QDir(dir).removeRecursively();
+}
+
+QTEST_MAIN(TestPathCache)
+
+#include "pathcachetest.moc"
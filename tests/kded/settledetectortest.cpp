@@ -0,0 +1,96 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "../../kded/settledetector.h"
+
+#include <QObject>
+#include <QSignalSpy>
+#include <QTest>
+
+/**
+ * Runs the SettleDetector on a clock of its own, expiring its timers by hand instead of
+ * waiting for them.
+ */
+class TestSettleDetector : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testDock();
+    void testMaxInterval();
+
+private:
+    qint64 m_now = 0;
+};
+
+void TestSettleDetector::testDock()
+{
+    SettleDetector detector(nullptr, [this] {
+        return m_now;
+    });
+    QSignalSpy settled(&detector, &SettleDetector::settled);
+    const QStringList dock = {QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("c")};
+
+    // Not known yet, every output is applied on its own
+    for (const QString &output : dock) {
+        detector.addChange(output);
+        QCOMPARE(detector.interval(), SettleDetector::BaseInterval);
+        QVERIFY(detector.isSettling());
+        m_now += SettleDetector::BaseInterval;
+        detector.settle();
+        m_now += 40;
+    }
+    QCOMPARE(settled.count(), 3);
+    QCOMPARE(detector.avoidedApplies(), quint64(0));
+    QCOMPARE(detector.dockCount(), 0);
+    m_now += SettleDetector::BurstWindow;
+    detector.endBurst();
+    QCOMPARE(detector.dockCount(), 1);
+
+    // Now it waits for the rest of the dock, half again as long as the largest gap
+    settled.clear();
+    detector.addChange(dock.at(0));
+    QCOMPARE(detector.interval(), 50 * 3 / 2 + SettleDetector::BaseInterval);
+    m_now += 30;
+    detector.addChange(dock.at(1));
+    m_now += 30;
+    QCOMPARE(detector.interval(), 50 * 3 / 2 + SettleDetector::BaseInterval);
+    detector.addChange(dock.at(2));
+    // Complete, no need to wait any longer
+    QCOMPARE(detector.interval(), SettleDetector::BaseInterval);
+    QCOMPARE(settled.count(), 0);
+    detector.settle();
+    QCOMPARE(settled.count(), 1);
+    QCOMPARE(detector.settledCount(), quint64(4));
+    // The fixed delay would have applied after the first and the second output
+    QCOMPARE(detector.avoidedApplies(), quint64(2));
+
+    // The dock got faster, the gap shrinks slowly
+    m_now += SettleDetector::BurstWindow;
+    detector.endBurst();
+    detector.addChange(dock.at(0));
+    QCOMPARE(detector.interval(), 50 * 3 / 4 * 3 / 2 + SettleDetector::BaseInterval);
+}
+
+void TestSettleDetector::testMaxInterval()
+{
+    SettleDetector detector(nullptr, [this] {
+        return m_now;
+    });
+    const QStringList dock = {QStringLiteral("d"), QStringLiteral("e")};
+
+    detector.addChange(dock.at(0));
+    m_now += SettleDetector::BurstWindow - 1;
+    detector.addChange(dock.at(1));
+    m_now += SettleDetector::BurstWindow;
+    detector.endBurst();
+
+    detector.addChange(dock.at(0));
+    QCOMPARE(detector.interval(), SettleDetector::MaxInterval);
+}
+
+QTEST_GUILESS_MAIN(TestSettleDetector)
+
+#include "settledetectortest.moc"
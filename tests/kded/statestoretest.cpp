@@ -0,0 +1,127 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "../../common/statestore.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+class TestStateStore : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testReadWrite();
+    void testCompaction();
+    void testTornWrite();
+
+private:
+    QTemporaryDir m_temporaryDir;
+};
+
+void TestStateStore::testReadWrite()
+{
+    const QString path = m_temporaryDir.filePath(QStringLiteral("state"));
+    {
+        StateStore store(path);
+        QVERIFY(store.isValid());
+        QVERIFY(store.insert(QStringLiteral("outputs/abc"), QByteArrayLiteral("first")));
+        QVERIFY(store.insert(QStringLiteral("control/configs/abc"), QByteArrayLiteral("control")));
+        const qint64 revision = store.revision(QStringLiteral("outputs/abc"));
+        QVERIFY(store.insert(QStringLiteral("outputs/abc"), QByteArrayLiteral("second")));
+        QVERIFY(store.revision(QStringLiteral("outputs/abc")) != revision);
+        QCOMPARE(store.value(QStringLiteral("outputs/abc")).value_or(QByteArray()), QByteArrayLiteral("second"));
+        QVERIFY(store.remove(QStringLiteral("control/configs/abc")));
+        QVERIFY(!store.contains(QStringLiteral("control/configs/abc")));
+    }
+
+    StateStore store(path);
+    QVERIFY(store.isValid());
+    QCOMPARE(store.names(), QStringList{QStringLiteral("outputs/abc")});
+    QCOMPARE(store.value(QStringLiteral("outputs/abc")).value_or(QByteArray()), QByteArrayLiteral("second"));
+
+    // Another process appending is picked up on refresh
+    StateStore other(path);
+    QVERIFY(other.insert(QStringLiteral("abc"), QByteArrayLiteral("layout")));
+    QVERIFY(!store.contains(QStringLiteral("abc")));
+    store.refresh();
+    QCOMPARE(store.value(QStringLiteral("abc")).value_or(QByteArray()), QByteArrayLiteral("layout"));
+    QCOMPARE(store.value(QStringLiteral("outputs/abc")).value_or(QByteArray()), QByteArrayLiteral("second"));
+}
+
+void TestStateStore::testCompaction()
+{
+    const QString path = m_temporaryDir.filePath(QStringLiteral("compaction"));
+    StateStore store(path);
+    StateStore other(path);
+    QVERIFY(store.isValid());
+    QVERIFY(store.insert(QStringLiteral("outputs/abc"), QByteArrayLiteral("kept")));
+
+    // Every write of the same name leaves the previous record behind, until there is enough of it
+    const QByteArray value(64 * 1024, 'x');
+    for (int i = 0; i < 16; ++i) {
+        QVERIFY(store.insert(QStringLiteral("abc"), value + QByteArray::number(i)));
+        QVERIFY(store.size() < 8 * value.size());
+    }
+    QCOMPARE(QFileInfo(path).size(), store.size());
+    QCOMPARE(store.value(QStringLiteral("abc")).value_or(QByteArray()), value + "15");
+    QCOMPARE(store.value(QStringLiteral("outputs/abc")).value_or(QByteArray()), QByteArrayLiteral("kept"));
+
+    // The other process still reads its mapping of the old file, until it switches to the new one
+    QVERIFY(other.contains(QStringLiteral("outputs/abc")));
+    other.refresh();
+    QCOMPARE(other.value(QStringLiteral("abc")).value_or(QByteArray()), value + "15");
+    QVERIFY(other.insert(QStringLiteral("def"), QByteArrayLiteral("other")));
+    store.refresh();
+    QCOMPARE(store.value(QStringLiteral("def")).value_or(QByteArray()), QByteArrayLiteral("other"));
+
+    // Tombstones go as well
+    const qint64 revision = store.revision(QStringLiteral("def"));
+    QVERIFY(store.remove(QStringLiteral("abc")));
+    QVERIFY(store.deadSize() > 0);
+    QVERIFY(store.compact());
+    // Revisions don't repeat across compactions, even though the records move
+    QCOMPARE(store.revision(QStringLiteral("def")), revision);
+    QVERIFY(store.insert(QStringLiteral("abc"), QByteArrayLiteral("again")));
+    QVERIFY(store.revision(QStringLiteral("abc")) > revision);
+    QVERIFY(store.remove(QStringLiteral("abc")));
+    QVERIFY(store.compact());
+    QCOMPARE(store.deadSize(), qint64(0));
+    QVERIFY(!store.contains(QStringLiteral("abc")));
+    QCOMPARE(store.names().count(), qsizetype(2));
+}
+
+void TestStateStore::testTornWrite()
+{
+    const QString path = m_temporaryDir.filePath(QStringLiteral("torn"));
+    StateStore store(path);
+    QVERIFY(store.insert(QStringLiteral("outputs/abc"), QByteArrayLiteral("first")));
+
+    // Simulate a write that was cut short
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::Append));
+    file.write(QByteArray::fromHex("05000000ff0000000000000000000000") + "short");
+    file.close();
+    const qint64 tornSize = QFileInfo(path).size();
+
+    StateStore reader(path);
+    QVERIFY(reader.isValid());
+    QCOMPARE(reader.names(), QStringList{QStringLiteral("outputs/abc")});
+
+    // The file isn't cut in place, where the reader has it mapped, but replaced
+    QVERIFY(store.insert(QStringLiteral("abc"), QByteArrayLiteral("layout")));
+    QCOMPARE(reader.value(QStringLiteral("outputs/abc")).value_or(QByteArray()), QByteArrayLiteral("first"));
+    QVERIFY(QFileInfo(path).size() != tornSize);
+    reader.refresh();
+    QCOMPARE(reader.value(QStringLiteral("abc")).value_or(QByteArray()), QByteArrayLiteral("layout"));
+    QCOMPARE(reader.value(QStringLiteral("outputs/abc")).value_or(QByteArray()), QByteArrayLiteral("first"));
+}
+
+QTEST_GUILESS_MAIN(TestStateStore)
+
+#include "statestoretest.moc"
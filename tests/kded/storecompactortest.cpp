@@ -0,0 +1,121 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "../../common/globals.h"
+#include "../../common/schema.h"
+#include "../../common/storage.h"
+#include "../../kded/config.h"
+#include "../../kded/storecompactor.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QDir>
+#include <QObject>
+#include <QStringBuilder>
+#include <QTemporaryDir>
+#include <QTest>
+
+class TestStoreCompactor : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testCompaction();
+
+private:
+    QTemporaryDir m_temporaryDir;
+};
+
+void TestStoreCompactor::initTestCase()
+{
+    qputenv("XDG_DATA_HOME", m_temporaryDir.path().toUtf8());
+    qputenv("KSCREEN_LOGGING", "false");
+}
+
+void TestStoreCompactor::testCompaction()
+{
+    if (Storage::stateStore()) {
+        QSKIP("Files are kept in the state store");
+    }
+    const QString dir = Globals::dirPath();
+    QVERIFY(QDir().mkpath(dir % QStringLiteral("outputs")));
+    QVERIFY(QDir().mkpath(dir % QStringLiteral("control/configs")));
+
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    auto writeLayout = [&](QChar digit, int daysAgo, const QCborArray &layout = QCborArray()) {
+        const QString id(32, digit);
+        Storage::writeValue(dir % id, layout);
+        StoreCompactor::self()->markUsed(id, now.addDays(-daysAgo));
+        return id;
+    };
+    // Oldest first, the oldest one was saved last though
+    const QString protectedId = writeLayout(QLatin1Char('a'), 4);
+    // Big enough for the space it took to outweigh the usage file written by the compaction
+    const QString evictedIds[] = {writeLayout(QLatin1Char('b'), 3, {QByteArray(4096, 'x')}), writeLayout(QLatin1Char('c'), 2)};
+    const QString recentId = writeLayout(QLatin1Char('d'), 1);
+    Storage::writeValue(dir % QStringLiteral("control/configs/") % evictedIds[0], QCborMap());
+    Storage::writeValue(dir % QStringLiteral("fixed-config"), QCborArray());
+    Storage::writeValue(dir % QStringLiteral("notes"), QCborMap());
+
+    auto writeOutput = [&](const QString &name, const QString &connector, qreal scale, int daysAgo) {
+        Schema::OutputRecord record;
+        record.id = name.left(32);
+        record.metadata = Schema::OutputMetadata{connector, std::nullopt};
+        record.scale = scale;
+        Storage::writeValue(dir % QStringLiteral("outputs/") % name, record.encode());
+        StoreCompactor::self()->markUsed(QStringLiteral("outputs/") % name, now.addDays(-daysAgo));
+    };
+    const QString protectedHash(32, QLatin1Char('e'));
+    const QString recentHash(32, QLatin1Char('f'));
+    const QString evictedHash(32, QLatin1Char('0'));
+    writeOutput(protectedHash, QStringLiteral("DP-1"), 1.0, 5);
+    writeOutput(recentHash, QStringLiteral("DP-2"), 1.5, 1);
+    // The same as the generic data but for the connector, and different from it
+    writeOutput(recentHash % QStringLiteral("DP-1"), QStringLiteral("DP-1"), 1.5, 1);
+    writeOutput(recentHash % QStringLiteral("HDMI-1"), QStringLiteral("HDMI-1"), 2.0, 1);
+    writeOutput(evictedHash, QStringLiteral("DP-3"), 1.0, 3);
+
+    const Schema::LastLayoutRecord lastLayout{protectedId, {{QStringLiteral("outputs/") % protectedHash % QStringLiteral("DP-1"), QStringLiteral("outputs/") % protectedHash}}};
+    Storage::writeValue(Config::lastLayoutFilePath(), lastLayout.encode());
+
+    const StoreCompactor::Statistics before = StoreCompactor::self()->statistics();
+    StoreCompactor::self()->compact(2);
+    const StoreCompactor::Statistics after = StoreCompactor::self()->statistics();
+
+    QCOMPARE(after.layouts, quint64(2));
+    QCOMPARE(after.outputs, quint64(2));
+    QCOMPARE(after.evicted - before.evicted, quint64(3));
+    QCOMPARE(after.merged - before.merged, quint64(1));
+    QVERIFY(after.bytes > 0);
+    QVERIFY(after.reclaimed > before.reclaimed);
+    QVERIFY(after.lastRun.isValid());
+
+    QVERIFY(QFile::exists(dir % protectedId));
+    QVERIFY(QFile::exists(dir % recentId));
+    for (const QString &id : evictedIds) {
+        QVERIFY(!QFile::exists(dir % id));
+    }
+    QVERIFY(!QFile::exists(dir % QStringLiteral("control/configs/") % evictedIds[0]));
+    QVERIFY(QFile::exists(dir % QStringLiteral("fixed-config")));
+    QVERIFY(QFile::exists(dir % QStringLiteral("notes")));
+    QVERIFY(QFile::exists(Config::lastLayoutFilePath()));
+
+    QVERIFY(QFile::exists(dir % QStringLiteral("outputs/") % protectedHash));
+    QVERIFY(QFile::exists(dir % QStringLiteral("outputs/") % recentHash));
+    QVERIFY(!QFile::exists(dir % QStringLiteral("outputs/") % recentHash % QStringLiteral("DP-1")));
+    QVERIFY(QFile::exists(dir % QStringLiteral("outputs/") % recentHash % QStringLiteral("HDMI-1")));
+    QVERIFY(!QFile::exists(dir % QStringLiteral("outputs/") % evictedHash));
+
+    // Usage is kept, a second run evicts nothing more
+    StoreCompactor::self()->compact(2);
+    QCOMPARE(StoreCompactor::self()->statistics().evicted, after.evicted);
+    QCOMPARE(StoreCompactor::self()->statistics().merged, after.merged);
+}
+
+QTEST_MAIN(TestStoreCompactor)
+
+#include "storecompactortest.moc"
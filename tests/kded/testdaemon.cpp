@@ -0,0 +1,526 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "../../common/globals.h"
+#include "../../common/storage.h"
+#include "../../kded/config.h"
+#include "../../kded/daemon.h"
+#include "../../kded/device.h"
+#include "../../kded/diagnosticsadaptor.h"
+#include "../../kded/eventrecorder.h"
+#include "../../kded/ioworker.h"
+#include "../../kded/layoutcache.h"
+#include "../../kded/tracer.h"
+#include "fakeservices.h"
+#include "tracereplay.h"
+
+#include <QDBusInterface>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QObject>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QStringBuilder>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QTimer>
+
+#include <kscreen/backendmanager_p.h>
+#include <kscreen/config.h>
+#include <kscreen/getconfigoperation.h>
+#include <kscreen/output.h>
+#include <kscreen/setconfigoperation.h>
+
+#include <functional>
+#include <memory>
+
+// laptopAndExternal.json
+static constexpr int s_panelId = 1;
+static constexpr int s_externalId = 2;
+// Generous, the fake backend runs in a process of its own
+static constexpr int s_timeout = 10000;
+
+/**
+ * Runs the daemon against the fake backend and the services in fakeservices.h.
+ *
+ * The benchmark reports the wall time of every scenario, run it with e.g. "-csv" or
+ * "-o result.xml,xml" for machine-readable output. KSCREEN_BENCHMARK_ITERATIONS sets how often
+ * each scenario runs, the reported number is the average.
+ *
+ * replayTrace feeds the trace in KSCREEN_REPLAY_TRACE, as recorded by the daemon with
+ * KSCREEN_RECORD_TRACE set, into the daemon and reports how long it took.
+ */
+class TestDaemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Scenario {
+        HotplugDisconnect,
+        HotplugConnect,
+        LidClose,
+        LidOpen,
+        Resume,
+    };
+    Q_ENUM(Scenario)
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testHotplug();
+    void testLidClose();
+    void testSuspendResume();
+    void testUPowerProperties();
+    void testRecordingName();
+    void testRecordAndReplay();
+    void testRestart();
+    void replayTrace();
+
+    void benchmarkScenarios_data();
+    void benchmarkScenarios();
+
+private:
+    /**
+     * Brings the fake hardware into the state the scenario starts from, then runs it.
+     * @returns the time from the event until the daemon is done with it in ns, -1 on timeout
+     */
+    qint64 run(Scenario scenario);
+
+    void setConnected(int outputId, bool connected);
+    bool isConnected(int outputId) const;
+    bool isEnabled(int outputId) const;
+    bool isIdle() const;
+    bool waitForTransaction(quint64 finishedBefore);
+    bool waitFor(const std::function<bool()> &condition);
+
+    QTemporaryDir m_temporaryDir;
+    std::unique_ptr<FakeServices> m_services;
+    std::unique_ptr<QDBusInterface> m_fakeBackend;
+    KScreenDaemon *m_daemon = nullptr;
+};
+
+void TestDaemon::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    qputenv("KSCREEN_LOGGING", "false");
+    setenv("KSCREEN_BACKEND", "Fake", 1);
+    QDir(Globals::dirPath()).removeRecursively();
+
+    m_services.reset(new FakeServices);
+    if (!m_services->start()) {
+        QSKIP("Could not register the fake services, the test needs a bus of its own");
+    }
+
+    KScreen::BackendManager::instance()->setBackendArgs({{QStringLiteral("TEST_DATA"), QStringLiteral(TEST_DATA "configs/laptopAndExternal.json")}});
+
+    m_daemon = new KScreenDaemon(nullptr, {});
+    QVERIFY(waitFor([this] {
+        return !m_daemon->m_startingUp && isIdle();
+    }));
+
+    // The backend launcher is up by now
+    m_fakeBackend.reset(new QDBusInterface(QStringLiteral("org.kde.KScreen"), QStringLiteral("/fake"), QStringLiteral("org.kde.kscreen.FakeBackend")));
+    QVERIFY(m_fakeBackend->isValid());
+
+    QVERIFY(isEnabled(s_panelId));
+    QVERIFY(isEnabled(s_externalId));
+}
+
+void TestDaemon::cleanupTestCase()
+{
+    delete m_daemon;
+    m_daemon = nullptr;
+    m_fakeBackend.reset();
+    KScreen::BackendManager::instance()->shutdownBackend();
+    m_services.reset();
+}
+
+void TestDaemon::testHotplug()
+{
+    QVERIFY(run(Scenario::HotplugDisconnect) >= 0);
+    QVERIFY(!isConnected(s_externalId));
+    QVERIFY(isEnabled(s_panelId));
+
+    QVERIFY(run(Scenario::HotplugConnect) >= 0);
+    QVERIFY(isEnabled(s_panelId));
+    QVERIFY(isEnabled(s_externalId));
+
+    // Stages outside of a transaction, like sets made for the KCM, aren't recorded
+    QCOMPARE(HotplugTracer::self()->transactionId(), quint64(0));
+    const quint64 backendCount = HotplugTracer::self()->histogram(HotplugTracer::Stage::Backend).count;
+    HotplugTracer::self()->startStage(HotplugTracer::Stage::Backend);
+    HotplugTracer::self()->finishStage(HotplugTracer::Stage::Backend);
+    QCOMPARE(HotplugTracer::self()->histogram(HotplugTracer::Stage::Backend).count, backendCount);
+}
+
+void TestDaemon::testLidClose()
+{
+    // Computed once the layout is saved
+    QTRY_VERIFY(m_daemon->m_lidClosedTarget);
+    QVERIFY(m_daemon->m_lidOpenedTarget);
+    // Only written when the lid closes, it would otherwise replace newer layouts when read
+    const QString openLidFilePath = Config::configsDirPath() % m_daemon->m_monitoredConfig->id() % QStringLiteral("_lidOpened");
+    IoWorker::self()->waitForDone();
+    QVERIFY(!Storage::exists(openLidFilePath));
+
+    // PowerDevil doesn't act on the lid with an external screen, no need to wait for a suspend
+    const qint64 elapsed = run(Scenario::LidClose);
+    QVERIFY(elapsed >= 0);
+    QVERIFY(elapsed < KScreenDaemon::LidClosedDelay * 1000000LL);
+    QVERIFY(!isEnabled(s_panelId));
+    QVERIFY(isEnabled(s_externalId));
+    IoWorker::self()->waitForDone();
+    QVERIFY(Storage::exists(openLidFilePath));
+
+    QVERIFY(run(Scenario::LidOpen) >= 0);
+    QVERIFY(isEnabled(s_panelId));
+    QVERIFY(isEnabled(s_externalId));
+    IoWorker::self()->waitForDone();
+    QVERIFY(!Storage::exists(openLidFilePath));
+
+    // Closing the lid would suspend, but something inhibits it
+    m_services->setTriggersLidAction(true);
+    m_services->setBlockInhibited(QStringLiteral("sleep"));
+    QVERIFY(run(Scenario::LidClose) >= 0);
+    QVERIFY(!isEnabled(s_panelId));
+    QVERIFY(run(Scenario::LidOpen) >= 0);
+    QVERIFY(isEnabled(s_panelId));
+    m_services->setBlockInhibited(QString());
+    m_services->setTriggersLidAction(false);
+
+    // Only the panel left, closing the lid must not turn off the last screen
+    const quint64 finished = HotplugTracer::self()->histogram(HotplugTracer::Stage::Total).count;
+    setConnected(s_externalId, false);
+    QVERIFY(waitForTransaction(finished));
+    m_services->setLidClosed(true);
+    QTest::qWait(KScreenDaemon::LidClosedDelay * 2);
+    QVERIFY(isEnabled(s_panelId));
+    m_services->setLidClosed(false);
+    setConnected(s_externalId, true);
+    QVERIFY(waitFor([this] {
+        return isEnabled(s_externalId) && isIdle();
+    }));
+}
+
+void TestDaemon::testSuspendResume()
+{
+    // Closing the lid suspends, the panel has to stay on for when the lid is opened again
+    m_services->setTriggersLidAction(true);
+    m_services->setLidClosed(true);
+    QVERIFY(waitFor([this] {
+        return Device::self()->isLidClosed();
+    }));
+    QVERIFY(m_daemon->m_lidClosedTimer->isActive());
+    // Knowing that a suspend is coming doesn't make the daemon wait any longer for it
+    QCOMPARE(m_daemon->m_lidClosedTimer->interval(), KScreenDaemon::LidClosedDelay);
+    m_services->suspend();
+    QVERIFY(waitFor([this] {
+        return !m_daemon->m_lidClosedTimer->isActive();
+    }));
+    QTest::qWait(KScreenDaemon::LidClosedDelay * 2);
+    QVERIFY(isEnabled(s_panelId));
+    m_services->setLidClosed(false);
+    m_services->setTriggersLidAction(false);
+
+    QVERIFY(run(Scenario::Resume) >= 0);
+    QVERIFY(isEnabled(s_panelId));
+    QVERIFY(!isConnected(s_externalId));
+
+    setConnected(s_externalId, true);
+    QVERIFY(waitFor([this] {
+        return isEnabled(s_externalId) && isIdle();
+    }));
+}
+
+void TestDaemon::testUPowerProperties()
+{
+    QSignalSpy lidSpy(Device::self(), &Device::lidClosedChanged);
+    QSignalSpy batterySpy(Device::self(), &Device::onBatteryChanged);
+
+    // Taken from the signal, without asking UPower again
+    m_services->setOnBattery(true);
+    QVERIFY(batterySpy.wait());
+    QVERIFY(Device::self()->isOnBattery());
+    m_services->setOnBattery(false);
+    QVERIFY(batterySpy.wait());
+    QVERIFY(!Device::self()->isOnBattery());
+    QCOMPARE(lidSpy.count(), 0);
+    QVERIFY(Device::self()->isLaptop());
+
+    // Fetched again when only the name comes along, which doesn't make the device ready again
+    QSignalSpy readySpy(Device::self(), &Device::ready);
+    m_services->invalidateOnBattery(true);
+    QVERIFY(batterySpy.wait());
+    QVERIFY(Device::self()->isOnBattery());
+    m_services->invalidateOnBattery(false);
+    QVERIFY(batterySpy.wait());
+    QVERIFY(!Device::self()->isOnBattery());
+    QCOMPARE(readySpy.count(), 0);
+    QCOMPARE(lidSpy.count(), 0);
+}
+
+void TestDaemon::testRecordingName()
+{
+    auto adaptor = m_daemon->findChild<DiagnosticsAdaptor *>();
+    QVERIFY(adaptor);
+
+    // Only files in the daemon's own directory
+    const QString outside = m_temporaryDir.filePath(QStringLiteral("outside"));
+    QVERIFY(!adaptor->startRecording(outside));
+    QVERIFY(!QFile::exists(outside));
+    for (const QString &fileName : {QString(), QStringLiteral(".."), QStringLiteral("../trace"), QStringLiteral("traces/trace"), QStringLiteral(".trace")}) {
+        QVERIFY2(!adaptor->startRecording(fileName), qPrintable(fileName));
+    }
+    QVERIFY(!EventRecorder::self()->isRecording());
+
+    QVERIFY(adaptor->startRecording(QStringLiteral("trace")));
+    QVERIFY(EventRecorder::self()->isRecording());
+    adaptor->stopRecording();
+    IoWorker::self()->waitForDone();
+    QVERIFY(QFile::exists(EventRecorder::tracesDirPath() % QStringLiteral("trace")));
+}
+
+void TestDaemon::testRecordAndReplay()
+{
+    const QString path = m_temporaryDir.filePath(QStringLiteral("trace"));
+    QVERIFY(EventRecorder::self()->start(path, m_daemon->m_monitoredConfig->data()));
+    QVERIFY(run(Scenario::HotplugDisconnect) >= 0);
+    QVERIFY(run(Scenario::HotplugConnect) >= 0);
+    QVERIFY(run(Scenario::LidClose) >= 0);
+    QVERIFY(run(Scenario::LidOpen) >= 0);
+    EventRecorder::self()->stop();
+    IoWorker::self()->waitForDone();
+
+    TraceReplay replay;
+    QVERIFY2(replay.load(path), qPrintable(replay.errorString()));
+    // At least the start, the two connection changes and the lid events
+    QVERIFY(replay.eventCount() > 5);
+
+    const TraceReplay::Result result = replay.replay(m_daemon, m_services.get(), s_timeout);
+    QVERIFY(result.finished);
+    QVERIFY(result.events > 0);
+    QVERIFY(result.matchesRecording);
+    QVERIFY(isEnabled(s_panelId));
+    QVERIFY(isEnabled(s_externalId));
+}
+
+void TestDaemon::testRestart()
+{
+    QVERIFY(waitFor([this] {
+        return isIdle() && (!m_daemon->m_saveTimer || !m_daemon->m_saveTimer->isActive());
+    }));
+    IoWorker::self()->waitForDone();
+    const QString id = m_daemon->m_monitoredConfig->id();
+
+    // The layout saved last is the one prefetched at the next start
+    LayoutCache::self()->clear();
+    QCOMPARE(Config::prefetchLastLayout(), id);
+    QVERIFY(LayoutCache::self()->layout(id));
+
+    delete m_daemon;
+    m_daemon = nullptr;
+
+    // Changed behind the daemon's back, so that the layout has to be set again
+    auto *getOperation = new KScreen::GetConfigOperation;
+    QVERIFY(getOperation->exec());
+    const KScreen::ConfigPtr config = getOperation->config();
+    config->output(s_panelId)->setEnabled(false);
+    QVERIFY((new KScreen::SetConfigOperation(config))->exec());
+
+    // Without UPower answering the device isn't known, the prefetched layout is set anyway
+    m_services->holdUPower();
+    m_daemon = new KScreenDaemon(nullptr, {});
+    QVERIFY(waitFor([this] {
+        return m_daemon->m_prefetchedLayoutApplies == 1 && !m_daemon->m_setConfigPending;
+    }));
+    QVERIFY(!Device::self()->isReady());
+    QVERIFY(m_daemon->m_startingUp);
+    QCOMPARE(m_daemon->m_setConfigOperations, quint64(1));
+    QVERIFY(isEnabled(s_panelId));
+
+    // Reading the layout again once the device is known finds nothing left to set
+    m_services->releaseUPower();
+    QVERIFY(waitFor([this] {
+        return !m_daemon->m_startingUp && isIdle();
+    }));
+    QCOMPARE(m_daemon->m_setConfigOperations, quint64(1));
+    QCOMPARE(m_daemon->m_prefetchedLayoutApplies, quint64(1));
+    QCOMPARE(m_daemon->m_monitoredConfig->id(), id);
+    QVERIFY(m_daemon->m_prefetchedLayoutId.isEmpty());
+    // The layout is already set, which must not keep the daemon from watching for changes
+    QVERIFY(m_daemon->m_monitoring);
+    QVERIFY(m_daemon->m_lidClosedTarget);
+    QVERIFY(isEnabled(s_panelId));
+    QVERIFY(isEnabled(s_externalId));
+}
+
+void TestDaemon::replayTrace()
+{
+    const QString path = qEnvironmentVariable("KSCREEN_REPLAY_TRACE");
+    if (path.isEmpty()) {
+        QSKIP("Set KSCREEN_REPLAY_TRACE to replay a recorded trace");
+    }
+
+    TraceReplay replay;
+    QVERIFY2(replay.load(path), qPrintable(replay.errorString()));
+    const TraceReplay::Result result = replay.replay(m_daemon, m_services.get(), s_timeout);
+    QVERIFY(result.finished);
+    qDebug() << "Replayed" << result.events << "events in" << result.elapsedNs / 1000000 << "ms";
+    if (!result.matchesRecording) {
+        qWarning() << "The daemon ended up with a different layout than the one recorded";
+    }
+    QTest::setBenchmarkResult(qreal(result.elapsedNs) / 1000000, QTest::WalltimeMilliseconds);
+}
+
+void TestDaemon::benchmarkScenarios_data()
+{
+    QTest::addColumn<Scenario>("scenario");
+
+    QTest::newRow("hotplug-disconnect") << Scenario::HotplugDisconnect;
+    QTest::newRow("hotplug-connect") << Scenario::HotplugConnect;
+    // Includes the time the daemon waits to see whether the lid close causes a suspend
+    QTest::newRow("lid-close") << Scenario::LidClose;
+    QTest::newRow("lid-open") << Scenario::LidOpen;
+    QTest::newRow("resume") << Scenario::Resume;
+}
+
+void TestDaemon::benchmarkScenarios()
+{
+    QFETCH(Scenario, scenario);
+
+    const int iterations = qEnvironmentVariableIsSet("KSCREEN_BENCHMARK_ITERATIONS") ? qEnvironmentVariableIntValue("KSCREEN_BENCHMARK_ITERATIONS") : 3;
+    QVERIFY(iterations > 0);
+
+    qint64 total = 0;
+    for (int i = 0; i < iterations; ++i) {
+        const qint64 elapsed = run(scenario);
+        QVERIFY2(elapsed >= 0, "Timed out waiting for the daemon");
+        total += elapsed;
+    }
+    QTest::setBenchmarkResult(qreal(total) / iterations / 1000000, QTest::WalltimeMilliseconds);
+
+    // Leave everything connected and the lid open for the next row
+    m_services->setLidClosed(false);
+    if (!isConnected(s_externalId)) {
+        setConnected(s_externalId, true);
+    }
+    QVERIFY(waitFor([this] {
+        return isEnabled(s_panelId) && isEnabled(s_externalId) && isIdle();
+    }));
+}
+
+qint64 TestDaemon::run(Scenario scenario)
+{
+    const HotplugTracer::Histogram before = HotplugTracer::self()->histogram(HotplugTracer::Stage::Total);
+    QElapsedTimer timer;
+    bool done = false;
+
+    switch (scenario) {
+    case Scenario::HotplugDisconnect:
+    case Scenario::HotplugConnect: {
+        const bool connect = scenario == Scenario::HotplugConnect;
+        if (isConnected(s_externalId) == connect) {
+            setConnected(s_externalId, !connect);
+            if (!waitForTransaction(before.count)) {
+                return -1;
+            }
+        }
+        const quint64 finished = HotplugTracer::self()->histogram(HotplugTracer::Stage::Total).count;
+        timer.start();
+        setConnected(s_externalId, connect);
+        done = waitForTransaction(finished);
+        break;
+    }
+    case Scenario::LidClose:
+    case Scenario::LidOpen: {
+        const bool close = scenario == Scenario::LidClose;
+        if (close != isEnabled(s_panelId)) {
+            m_services->setLidClosed(!close);
+            if (!waitFor([this, close] {
+                    return isEnabled(s_panelId) == close && isIdle();
+                })) {
+                return -1;
+            }
+        }
+        timer.start();
+        m_services->setLidClosed(close);
+        done = waitFor([this, close] {
+            return isEnabled(s_panelId) != close && isIdle();
+        });
+        break;
+    }
+    case Scenario::Resume: {
+        // Stands in for a screen unplugged while the machine was asleep, which the backend
+        // only notices once it is resumed
+        m_services->suspend();
+        setConnected(s_externalId, true);
+        if (!waitFor([this] {
+                return isEnabled(s_externalId) && isIdle();
+            })) {
+            return -1;
+        }
+        const quint64 finished = HotplugTracer::self()->histogram(HotplugTracer::Stage::Total).count;
+        timer.start();
+        m_services->resume();
+        setConnected(s_externalId, false);
+        done = waitForTransaction(finished);
+        break;
+    }
+    }
+
+    return done ? timer.nsecsElapsed() : -1;
+}
+
+void TestDaemon::setConnected(int outputId, bool connected)
+{
+    m_fakeBackend->call(QStringLiteral("setConnected"), outputId, connected);
+}
+
+bool TestDaemon::isConnected(int outputId) const
+{
+    const KScreen::OutputPtr output = m_daemon->m_monitoredConfig->data()->output(outputId);
+    return output && output->isConnected();
+}
+
+bool TestDaemon::isEnabled(int outputId) const
+{
+    const KScreen::OutputPtr output = m_daemon->m_monitoredConfig->data()->output(outputId);
+    return output && output->isConnected() && output->isEnabled();
+}
+
+bool TestDaemon::isIdle() const
+{
+    return TraceReplay::isIdle(m_daemon);
+}
+
+bool TestDaemon::waitForTransaction(quint64 finishedBefore)
+{
+    return waitFor([this, finishedBefore] {
+        return HotplugTracer::self()->histogram(HotplugTracer::Stage::Total).count > finishedBefore && isIdle();
+    });
+}
+
+bool TestDaemon::waitFor(const std::function<bool()> &condition)
+{
+    return QTest::qWaitFor(condition, s_timeout);
+}
+
+int main(int argc, char *argv[])
+{
+    // Device looks for UPower on the system bus, the fake one is on the test's own bus
+    qputenv("DBUS_SYSTEM_BUS_ADDRESS", qgetenv("DBUS_SESSION_BUS_ADDRESS"));
+    // The daemon needs a QGuiApplication, but no display
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QGuiApplication app(argc, argv);
+    TestDaemon test;
+    QTEST_SET_MAIN_SOURCE_PATH
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "testdaemon.moc"
@@ -5,7 +5,9 @@
     SPDX-License-Identifier: GPL-2.0-or-later
 */
 
+#include "../../common/modeindex.h"
 #include "../../kded/generator.h"
+#include "../../kded/layoutcache.h"
 #include "../../kded/output.h"
 
 #include <QObject>
@@ -15,6 +17,8 @@
 #include <kscreen/backendmanager_p.h>
 #include <kscreen/config.h>
 #include <kscreen/getconfigoperation.h>
+#include <kscreen/mode.h>
+#include <kscreen/screen.h>
 
 using namespace KScreen;
 
@@ -47,6 +51,9 @@ private Q_SLOTS:
     void globalOutputData();
     void outputPreset();
     void autogeneratedScreenScales();
+    void initialStateMemo();
+    void modeIndex();
+    void fallbackCandidates();
 };
 
 KScreen::ConfigPtr testScreenConfig::loadConfig(const QByteArray &fileName)
@@ -570,6 +577,8 @@ void testScreenConfig::globalOutputData()
 
     // cleanup
     QFile::remove(::Output::dirPath() + output->hashMd5());
+    // The cache only notices changes made behind its back from the event loop
+    LayoutCache::self()->clear();
 }
 
 void testScreenConfig::outputPreset()
@@ -593,6 +602,7 @@ void testScreenConfig::outputPreset()
     QDir(dataDir.path()).mkpath(QStringLiteral("kscreen/outputs"));
     QFile::copy(::Output::dirPath() + presetOutput->hashMd5(), dataDir.filePath(QStringLiteral("kscreen/outputs/") % presetOutput->hashMd5()));
     QFile::remove(::Output::dirPath() + presetOutput->hashMd5());
+    LayoutCache::self()->clear();
 
     auto config = Generator::self()->idealConfig(currentConfig);
     auto output = config->connectedOutputs().first();
@@ -609,6 +619,7 @@ void testScreenConfig::outputPreset()
     QCOMPARE(output->scale(), 1.0);
 
     QFile::remove(::Output::dirPath() + defaultOutput->hashMd5());
+    LayoutCache::self()->clear();
 }
 
 void testScreenConfig::autogeneratedScreenScales()
@@ -671,6 +682,174 @@ void testScreenConfig::autogeneratedScreenScales()
     }
 }
 
+void testScreenConfig::initialStateMemo()
+{
+    const ConfigPtr currentConfig = loadConfig("singleOutput.json");
+    QVERIFY(currentConfig);
+
+    Generator *generator = Generator::self();
+    generator->setCurrentConfig(currentConfig);
+    generator->setForceLaptop(false);
+    generator->setForceNotLaptop(true);
+
+    QCOMPARE(generator->idealConfig(currentConfig)->output(1)->currentModeId(), QLatin1String("3"));
+    // Known by now, the global output data isn't looked at again
+    const quint64 generation = LayoutCache::self()->globalDataGeneration();
+    QCOMPARE(generator->idealConfig(currentConfig)->output(1)->currentModeId(), QLatin1String("3"));
+    QCOMPARE(LayoutCache::self()->globalDataGeneration(), generation);
+
+    // Same monitor on the same connector, but without the mode that was picked before
+    const OutputPtr output = currentConfig->output(1);
+    KScreen::ModeList modes = output->modes();
+    modes.remove(QStringLiteral("3"));
+    output->setModes(modes);
+    output->setPreferredModes({QStringLiteral("2")});
+    QCOMPARE(generator->idealConfig(currentConfig)->output(1)->currentModeId(), QLatin1String("2"));
+
+    // Written global output data replaces what was decided before
+    const ConfigPtr config = generator->idealConfig(currentConfig);
+    config->output(1)->setCurrentModeId(QStringLiteral("1"));
+    ::Output::writeGlobal(config->output(1), false);
+    QVERIFY(LayoutCache::self()->globalDataGeneration() != generation);
+    QCOMPARE(generator->idealConfig(currentConfig)->output(1)->currentModeId(), QLatin1String("1"));
+
+    QFile::remove(::Output::dirPath() + output->hashMd5());
+    LayoutCache::self()->clear();
+}
+
+void testScreenConfig::modeIndex()
+{
+    const auto createOutput = [](const QList<std::tuple<QString, QSize, float>> &modes) {
+        KScreen::ModeList modeList;
+        for (const auto &[id, size, refreshRate] : modes) {
+            KScreen::ModePtr mode = KScreen::ModePtr::create();
+            mode->setId(id);
+            mode->setSize(size);
+            mode->setRefreshRate(refreshRate);
+            modeList.insert(id, mode);
+        }
+        KScreen::OutputPtr output = KScreen::OutputPtr::create();
+        output->setModes(modeList);
+        return output;
+    };
+
+    const OutputPtr laptop = createOutput({
+        {QStringLiteral("1"), QSize(1920, 1080), 60.0},
+        {QStringLiteral("2"), QSize(1920, 1080), 59.94},
+        {QStringLiteral("3"), QSize(1920, 1080), 144.0},
+        {QStringLiteral("4"), QSize(1280, 720), 60.0},
+        {QStringLiteral("5"), QSize(2560, 1440), 60.0},
+        {QStringLiteral("6"), QSize(2560, 1440), 60.0},
+        {QStringLiteral("7"), QSize(1024, 768), 60.0},
+    });
+    const OutputPtr external = createOutput({
+        {QStringLiteral("a"), QSize(1920, 1080), 75.0},
+        {QStringLiteral("b"), QSize(1280, 720), 60.0},
+        {QStringLiteral("c"), QSize(3840, 2160), 30.0},
+    });
+
+    const auto index = ModeIndex::of(laptop);
+    QCOMPARE(index->count(), 7);
+    // Same modes, same index
+    QCOMPARE(ModeIndex::of(laptop->clone()), index);
+
+    // The last of equal modes, like the scan it replaces
+    QCOMPARE(index->biggest()->id(), QStringLiteral("6"));
+    QCOMPARE(index->bestForSize(QSize(1920, 1080))->id(), QStringLiteral("3"));
+    QVERIFY(!index->bestForSize(QSize(800, 600)));
+    // 59.94 and 60 Hz are told apart exactly
+    QCOMPARE(ModeKey::of(QSize(1920, 1080), 59.94f).refreshMilliHz, 59940);
+    QCOMPARE(index->find(ModeKey{1920, 1080, 59940})->id(), QStringLiteral("2"));
+    QCOMPARE(index->find(ModeKey{1920, 1080, 60000})->id(), QStringLiteral("1"));
+    QVERIFY(!index->find(ModeKey{1920, 1080, 59900}));
+    QVERIFY(!index->find(ModeKey{1080, 1920, 60000}));
+    QCOMPARE(index->findClosest(QSize(1920, 1080), 59.9f, 0.5)->id(), QStringLiteral("2"));
+    QCOMPARE(index->findClosest(QSize(1920, 1080), 100.0f, 100.0)->id(), QStringLiteral("1"));
+    QVERIFY(!index->findClosest(QSize(1920, 1080), 100.0f, 0.5));
+    QCOMPARE(index->sizes(), (QList<QSize>{QSize(1024, 768), QSize(1280, 720), QSize(1920, 1080), QSize(2560, 1440)}));
+    QCOMPARE(index->refreshRates(QSize(1920, 1080)), (QList<float>{144.0, 60.0, 59.94f}));
+
+    QCOMPARE(ModeIndex::largestCommonSize({index, ModeIndex::of(external)}), QSize(1920, 1080));
+    QCOMPARE(ModeIndex::largestCommonSize({index, ModeIndex::of(external)}, QSize(1600, 1200)), QSize(1280, 720));
+    QVERIFY(!ModeIndex::largestCommonSize({index, ModeIndex::of(createOutput({}))}).isValid());
+    QCOMPARE(ModeIndex::smallestCommonSize({index, ModeIndex::of(external)}), QSize(1280, 720));
+    QVERIFY(!ModeIndex::smallestCommonSize({index, ModeIndex::of(createOutput({}))}).isValid());
+    QVERIFY(!ModeIndex::of(createOutput({}))->biggest());
+
+    // Sizes of the same area are sorted by width, a tie still goes to the last in the mode list
+    const OutputPtr rotated = createOutput({
+        {QStringLiteral("a"), QSize(1600, 1200), 60.0},
+        {QStringLiteral("b"), QSize(1200, 1600), 60.0},
+    });
+    QCOMPARE(ModeIndex::of(rotated)->biggest()->id(), QStringLiteral("b"));
+}
+
+void testScreenConfig::fallbackCandidates()
+{
+    const auto createConfig = [](int maxActiveOutputs, const QSize &maxSize) {
+        KScreen::ScreenPtr screen = KScreen::ScreenPtr::create();
+        screen->setMinSize(QSize(8, 8));
+        screen->setMaxSize(maxSize);
+        screen->setMaxActiveOutputsCount(maxActiveOutputs);
+        KScreen::ConfigPtr config = KScreen::ConfigPtr::create();
+        config->setScreen(screen);
+
+        for (int id : {1, 2}) {
+            KScreen::ModeList modes;
+            for (const QSize &size : {QSize(1280, 720), QSize(1920, 1080)}) {
+                KScreen::ModePtr mode = KScreen::ModePtr::create();
+                mode->setId(QString::number(modes.count() + 1));
+                mode->setSize(size);
+                mode->setRefreshRate(60.0);
+                modes.insert(mode->id(), mode);
+            }
+            KScreen::OutputPtr output = KScreen::OutputPtr::create();
+            output->setId(id);
+            output->setName(id == 1 ? QStringLiteral("eDP-1") : QStringLiteral("DP-1"));
+            output->setType(id == 1 ? KScreen::Output::Panel : KScreen::Output::DisplayPort);
+            output->setConnected(true);
+            output->setModes(modes);
+            config->addOutput(output);
+        }
+        return config;
+    };
+
+    Generator *generator = Generator::self();
+    generator->setForceLaptop(true);
+    generator->setForceNotLaptop(false);
+    generator->setForceDocked(false);
+    generator->setForceLidClosed(false);
+
+    // Cloning fits where extending doesn't
+    KScreen::ConfigPtr currentConfig = createConfig(2, QSize(2000, 2000));
+    generator->setCurrentConfig(currentConfig);
+    ConfigPtr config = generator->idealConfig(currentConfig);
+    QVERIFY(KScreen::Config::canBeApplied(config));
+    QCOMPARE(config->output(1)->pos(), QPoint(0, 0));
+    QCOMPARE(config->output(2)->pos(), QPoint(0, 0));
+    QVERIFY(config->output(1)->isEnabled());
+    QVERIFY(config->output(2)->isEnabled());
+    QVERIFY(config->output(1)->isPrimary());
+    // The current config is left alone
+    QVERIFY(!currentConfig->output(1)->isEnabled());
+
+    // Only one output can be lit, which rules out everything but turning off the panel
+    currentConfig = createConfig(1, QSize(8192, 8192));
+    generator->setCurrentConfig(currentConfig);
+    config = generator->idealConfig(currentConfig);
+    QVERIFY(KScreen::Config::canBeApplied(config));
+    QVERIFY(!config->output(1)->isEnabled());
+    QVERIFY(config->output(2)->isEnabled());
+    QVERIFY(config->output(2)->isPrimary());
+
+    // The smallest mode is too big, so none can be applied and the ideal config stays
+    currentConfig = createConfig(2, QSize(1000, 1000));
+    generator->setCurrentConfig(currentConfig);
+    config = generator->idealConfig(currentConfig);
+    QVERIFY(!KScreen::Config::canBeApplied(config));
+    QCOMPARE(config->output(2)->pos(), QPoint(1920, 0));
+}
+
 QTEST_MAIN(testScreenConfig)
 
 #include "testgenerator.moc"
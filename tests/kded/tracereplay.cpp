@@ -0,0 +1,174 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "tracereplay.h"
+#include "../../kded/config.h"
+#include "../../kded/configdiff.h"
+#include "../../kded/daemon.h"
+#include "../../kded/settledetector.h"
+#include "../../kded/tracer.h"
+#include "fakeservices.h"
+
+#include <kscreen/config.h>
+#include <kscreen/configmonitor.h>
+#include <kscreen/edid.h>
+#include <kscreen/output.h>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTest>
+#include <QTimer>
+
+bool TraceReplay::load(const QString &path)
+{
+    m_entries.clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_errorString = file.errorString();
+        return false;
+    }
+
+    int lineNumber = 0;
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty()) {
+            continue;
+        }
+        QJsonParseError error;
+        const QJsonObject object = QJsonDocument::fromJson(line, &error).object();
+        if (error.error != QJsonParseError::NoError) {
+            m_errorString = QStringLiteral("Line %1: %2").arg(lineNumber).arg(error.errorString());
+            return false;
+        }
+
+        const auto event = EventRecorder::eventFromName(object[QStringLiteral("event")].toString());
+        if (!event) {
+            m_errorString = QStringLiteral("Line %1: unknown event").arg(lineNumber);
+            return false;
+        }
+        if (*event == EventRecorder::Event::Start && object[QStringLiteral("version")].toInt() > EventRecorder::Version) {
+            m_errorString = QStringLiteral("Written by a newer version");
+            return false;
+        }
+
+        Entry entry{*event, object[QStringLiteral("timeUs")].toInteger(), nullptr};
+        if (object.contains(QStringLiteral("config"))) {
+            entry.config = EventRecorder::deserializeConfig(object[QStringLiteral("config")].toObject());
+        }
+        m_entries.append(entry);
+    }
+
+    if (m_entries.isEmpty() || m_entries.first().event != EventRecorder::Event::Start) {
+        m_errorString = QStringLiteral("Not a trace");
+        return false;
+    }
+    return true;
+}
+
+QString TraceReplay::errorString() const
+{
+    return m_errorString;
+}
+
+int TraceReplay::eventCount() const
+{
+    return m_entries.count();
+}
+
+bool TraceReplay::isIdle(KScreenDaemon *daemon)
+{
+    return !daemon->m_setConfigPending && !daemon->m_settleDetector->isSettling() && !daemon->m_lidClosedTimer->isActive()
+        && HotplugTracer::self()->transactionId() == 0;
+}
+
+TraceReplay::Result TraceReplay::replay(KScreenDaemon *daemon, FakeServices *services, int timeout)
+{
+    Result result;
+    KScreen::ConfigPtr lastSnapshot;
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < m_entries.count(); ++i) {
+        const Entry &entry = m_entries.at(i);
+        if (i > 0) {
+            const qint64 gapMs = (entry.timeUs - m_entries.at(i - 1).timeUs) / 1000;
+            QTest::qWaitFor(
+                [daemon] {
+                    return isIdle(daemon);
+                },
+                gapMs);
+        }
+
+        switch (entry.event) {
+        case EventRecorder::Event::Start:
+        case EventRecorder::Event::ConfigurationChanged:
+            if (entry.config) {
+                applyTopology(daemon, entry.config);
+                lastSnapshot = entry.config;
+            }
+            break;
+        case EventRecorder::Event::LidClosed:
+        case EventRecorder::Event::LidOpened:
+            services->setLidClosed(entry.event == EventRecorder::Event::LidClosed);
+            break;
+        case EventRecorder::Event::AboutToSuspend:
+            services->suspend();
+            break;
+        case EventRecorder::Event::ResumingFromSuspend:
+            services->resume();
+            break;
+        case EventRecorder::Event::OutputAdded:
+        case EventRecorder::Event::OutputConnected:
+        case EventRecorder::Event::OutputDisconnected:
+        case EventRecorder::Event::ControlChanged:
+            // Follow from the snapshots
+            continue;
+        }
+        ++result.events;
+    }
+
+    result.finished = QTest::qWaitFor(
+        [daemon] {
+            return isIdle(daemon);
+        },
+        timeout);
+    result.elapsedNs = timer.nsecsElapsed();
+    result.matchesRecording = lastSnapshot && ConfigDiff(lastSnapshot, daemon->m_monitoredConfig->data()).isEmpty();
+    return result;
+}
+
+void TraceReplay::applyTopology(KScreenDaemon *daemon, const KScreen::ConfigPtr &snapshot)
+{
+    const KScreen::ConfigPtr current = daemon->m_monitoredConfig->data();
+    const KScreen::ConfigPtr config = current->clone();
+
+    for (const KScreen::OutputPtr &recorded : snapshot->outputs()) {
+        const KScreen::OutputPtr output = config->output(recorded->id());
+        if (!output) {
+            config->addOutput(recorded->clone());
+            continue;
+        }
+        output->setConnected(recorded->isConnected());
+        output->setModes(recorded->modes());
+        output->setPreferredModes(recorded->preferredModes());
+        if (recorded->edid()) {
+            output->setEdid(recorded->edid()->rawData());
+        }
+    }
+    const KScreen::OutputList outputs = config->outputs();
+    for (const KScreen::OutputPtr &output : outputs) {
+        if (!snapshot->output(output->id())) {
+            config->removeOutput(output->id());
+        }
+    }
+
+    // What the ConfigMonitor does when the backend reports a change
+    current->apply(config);
+    Q_EMIT KScreen::ConfigMonitor::instance()->configurationChanged();
+}
@@ -0,0 +1,65 @@
+/*
+    SPDX-FileCopyrightText: 2026 KScreen contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include "../../kded/eventrecorder.h"
+
+#include <kscreen/types.h>
+
+#include <QList>
+#include <QString>
+
+class FakeServices;
+class KScreenDaemon;
+
+/**
+ * Feeds a trace written by EventRecorder back into a running daemon.
+ *
+ * Only what comes from outside is replayed: the connection state, modes and EDIDs of the outputs
+ * in each config snapshot, and the lid and suspend events through FakeServices. Everything the
+ * daemon decides, like which outputs are enabled where, is left to the daemon, so that the end
+ * result can be compared with the last recorded snapshot.
+ *
+ * Time where the daemon was idle is skipped, shorter gaps are kept, so that storms of events
+ * reach the daemon like they did when they were recorded.
+ */
+class TraceReplay
+{
+public:
+    struct Result {
+        int events = 0;
+        qint64 elapsedNs = 0;
+        bool finished = false;
+        /// The daemon ended up with the layout of the last recorded snapshot
+        bool matchesRecording = false;
+    };
+
+    bool load(const QString &path);
+    QString errorString() const;
+    int eventCount() const;
+
+    /**
+     * @param timeout how long to wait for the daemon to become idle after the last event, in ms
+     */
+    Result replay(KScreenDaemon *daemon, FakeServices *services, int timeout);
+
+    /**
+     * @returns whether @p daemon has nothing pending, no timers, operations or hotplug transaction
+     */
+    static bool isIdle(KScreenDaemon *daemon);
+
+private:
+    struct Entry {
+        EventRecorder::Event event;
+        qint64 timeUs = 0;
+        KScreen::ConfigPtr config;
+    };
+
+    void applyTopology(KScreenDaemon *daemon, const KScreen::ConfigPtr &snapshot);
+
+    QList<Entry> m_entries;
+    QString m_errorString;
+};